@@ -0,0 +1,241 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cstr.h"
+
+// Picking an exact matcher from a simple cost model. We predict the run time
+// of each engine from the text length, n, the pattern length, m, and the
+// alphabet size, sigma, and pick the cheapest. The per-operation costs are
+// measured on a machine (cstr_auto_calibrate) or taken from the defaults
+// below, which were measured on a typical x86-64 machine with an optimised
+// build. Only the ratios between the costs matter.
+
+// clang-format off
+const cstr_auto_costs cstr_auto_default_costs = {
+    .naive    = 0.9,  // per character comparison
+    .packed   = 0.8,  // per text position (packing included)
+    .ba       = 3.0,  // per text character
+    .kmp      = 3.0,  // per text character
+    .sa_probe = 25.0, // per binary search probe (two cache misses)
+    .fm_step  = 30.0, // per pattern character (two rank look-ups)
+};
+// clang-format on
+
+// Expected number of character comparisons per text position for the
+// naive algorithm on random text: 1 + 1/sigma + 1/sigma^2 + ... (at most m).
+static double naive_comparisons(long long m, long long sigma)
+{
+    if (sigma < 2)
+    {
+        return (double)m;
+    }
+    double expected = 0.0, term = 1.0;
+    for (long long k = 0; k < m && term > 1e-3; k++)
+    {
+        expected += term;
+        term /= (double)sigma;
+    }
+    return expected;
+}
+
+// Number of binary search steps over n elements, ceil(log2(n)) but at least one
+static double log2_ll(long long n)
+{
+    double steps = 1.0;
+    for (long long k = 2; k < n; k *= 2)
+    {
+        steps += 1.0;
+    }
+    return steps;
+}
+
+cstr_auto_engine cstr_auto_choose(cstr_auto_costs const *costs,
+                                  long long n, long long m, long long sigma,
+                                  bool dna, bool has_sa, bool has_fmindex)
+{
+    costs = costs ? costs : &cstr_auto_default_costs;
+
+    cstr_auto_engine best = CSTR_AUTO_NAIVE;
+    double best_cost = costs->naive * (double)n * naive_comparisons(m, sigma);
+
+// Update best if ENGINE is cheaper
+#define CONSIDER(ENGINE, COST)   \
+    do                           \
+    {                            \
+        double cost = (COST);    \
+        if (cost < best_cost)    \
+        {                        \
+            best = (ENGINE);     \
+            best_cost = cost;    \
+        }                        \
+    } while (0)
+
+    if (dna)
+    {
+        // One register compare per position, plus one per extra 32 bases
+        // for the (rare) hits on the first word.
+        CONSIDER(CSTR_AUTO_PACKED, costs->packed * (double)n);
+    }
+    CONSIDER(CSTR_AUTO_BA, costs->ba * (double)(n + m));
+    CONSIDER(CSTR_AUTO_KMP, costs->kmp * (double)(n + m));
+    if (has_sa)
+    {
+        // Two binary searches per pattern character
+        CONSIDER(CSTR_AUTO_SA, costs->sa_probe * 2.0 * (double)m * log2_ll(n));
+    }
+    if (has_fmindex)
+    {
+        CONSIDER(CSTR_AUTO_FMINDEX, costs->fm_step * (double)m);
+    }
+
+#undef CONSIDER
+
+    return best;
+}
+
+// The alphabet is estimated from a prefix of x, so picking an engine
+// doesn't cost a full scan of the text.
+#define SAMPLE_SIZE 4096
+
+static bool is_dna(uint8_t a)
+{
+    switch (a)
+    {
+    case 'A': case 'C': case 'G': case 'T': // NOLINT
+    case 'a': case 'c': case 'g': case 't': // NOLINT
+        return true;
+    default:
+        return false;
+    }
+}
+
+cstr_exact_matcher *cstr_auto_matcher(cstr_auto_costs const *costs,
+                                      cstr_const_sslice x, cstr_const_sslice p,
+                                      cstr_suffix_array const *sa,
+                                      cstr_bwt_preproc *fmindex)
+{
+    bool seen[CSTR_MAX_ALPHABET_SIZE] = {false};
+    long long sigma = 0;
+    bool dna = true;
+    cstr_const_sslice sample = CSTR_PREFIX(x, x.len < SAMPLE_SIZE ? x.len : SAMPLE_SIZE);
+    for (long long i = 0; i < sample.len; i++)
+    {
+        uint8_t a = sample.buf[i];
+        sigma += !seen[a];
+        seen[a] = true;
+        // We allow a sentinel, but otherwise it must look like DNA
+        dna = dna && (is_dna(a) || a == 0);
+    }
+    for (long long i = 0; i < p.len; i++)
+    {
+        dna = dna && is_dna(p.buf[i]);
+    }
+
+    switch (cstr_auto_choose(costs, x.len, p.len, sigma, dna, sa != 0, fmindex != 0))
+    {
+    case CSTR_AUTO_PACKED:
+        return cstr_packed_dna_matcher(x, p);
+    case CSTR_AUTO_BA:
+        return cstr_ba_matcher(x, p);
+    case CSTR_AUTO_KMP:
+        return cstr_kmp_matcher(x, p);
+    case CSTR_AUTO_SA:
+        return cstr_sa_bsearch(*sa, x, p);
+    case CSTR_AUTO_FMINDEX:
+        return cstr_fmindex_search(fmindex, p);
+    case CSTR_AUTO_NAIVE:
+    default:
+        return cstr_naive_matcher(x, p);
+    }
+}
+
+// MARK: Calibration
+
+// The micro-benchmark text. It is big enough that the index look-ups
+// aren't all in cache, but small enough that calibration is quick.
+#define BENCH_N (1 << 18)
+#define BENCH_M 16
+#define BENCH_QUERIES 2000
+
+static double seconds_since(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Nanoseconds per unit of work for scanning x for p with matcher f. A
+// single scan can be too quick for clock() to see, so we repeat it until
+// it has taken long enough to measure.
+#define MIN_SECONDS 0.01
+static double time_scan(cstr_exact_matcher *(*f)(cstr_const_sslice, cstr_const_sslice),
+                        cstr_const_sslice x, cstr_const_sslice p, double work)
+{
+    long long reps = 0;
+    double elapsed;
+    clock_t start = clock();
+    do
+    {
+        cstr_exact_matcher *m = f(x, p);
+        while (cstr_exact_next_match(m) != -1)
+            ;
+        cstr_free_exact_matcher(m);
+        reps++;
+        elapsed = seconds_since(start);
+    } while (elapsed < MIN_SECONDS);
+    return 1e9 * elapsed / ((double)reps * work);
+}
+
+cstr_auto_costs cstr_auto_calibrate(void)
+{
+    const long long n = BENCH_N, m = BENCH_M;
+
+    // Random DNA with a sentinel, so we can also build the indices.
+    cstr_sslice *x_buf = cstr_alloc_sslice(n);
+    for (long long i = 0; i < n - 1; i++)
+    {
+        x_buf->buf[i] = (uint8_t) "acgt"[rand() % 4];
+    }
+    x_buf->buf[n - 1] = 0;
+    cstr_const_sslice x = CSTR_SLICE_CONST_CAST(*x_buf);
+    cstr_const_sslice p = CSTR_SUBSLICE(x, n / 2, n / 2 + m);
+
+    cstr_auto_costs costs;
+    costs.naive = time_scan(cstr_naive_matcher, x, p, (double)n * naive_comparisons(m, 4));
+    costs.packed = time_scan(cstr_packed_dna_matcher, x, p, (double)n);
+    costs.ba = time_scan(cstr_ba_matcher, x, p, (double)(n + m));
+    costs.kmp = time_scan(cstr_kmp_matcher, x, p, (double)(n + m));
+
+    // The indices
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_sslice *w_buf = cstr_alloc_sslice(n);
+    cstr_alphabet_map(*w_buf, x, &alpha);
+    cstr_suffix_array *sa = cstr_alloc_uislice(n);
+    cstr_sais_sslice(*sa, CSTR_SLICE_CONST_CAST(*w_buf), &alpha);
+    cstr_bwt_preproc *fmindex = cstr_bwt_preprocess(x);
+
+    clock_t start = clock();
+    for (long long q = 0; q < BENCH_QUERIES; q++)
+    {
+        long long i = rand() % (n - m - 1);
+        cstr_exact_matcher *match = cstr_sa_bsearch(*sa, x, CSTR_SUBSLICE(x, i, i + m));
+        cstr_free_exact_matcher(match);
+    }
+    costs.sa_probe = 1e9 * seconds_since(start) / (BENCH_QUERIES * 2.0 * (double)m * log2_ll(n));
+
+    start = clock();
+    for (long long q = 0; q < BENCH_QUERIES; q++)
+    {
+        long long i = rand() % (n - m - 1);
+        cstr_exact_matcher *match = cstr_fmindex_search(fmindex, CSTR_SUBSLICE(x, i, i + m));
+        cstr_free_exact_matcher(match);
+    }
+    costs.fm_step = 1e9 * seconds_since(start) / (BENCH_QUERIES * (double)m);
+
+    cstr_free_bwt_preproc(fmindex);
+    free(sa);
+    free(w_buf);
+    free(x_buf);
+
+    return costs;
+}
@@ -92,32 +92,29 @@ struct cstr_bwt_preproc
     cstr_suffix_array *sa;
     struct c_table *ctab;
     struct o_table *otab;
+    cstr_kmer_table *kmers; // optional, to skip the first steps of searches
 };
 
 struct cstr_bwt_preproc *cstr_bwt_preprocess(cstr_const_sslice x)
 {
     struct cstr_bwt_preproc *preproc = cstr_malloc(sizeof *preproc);
     cstr_init_alphabet(&preproc->alpha, x);
+    preproc->kmers = 0;
 
     // We don't assume that the bwt string is mapped down to the alphabet here (although
     // maybe we should to save some time), so we also need to do that... Anyway, the
     // mapping is needed both for constructing the suffix array and for representing
     // the tables.
 
-    // Map the string into an integer slice so we can build the suffix array.
-    cstr_uislice *u_buf = cstr_alloc_uislice(x.len);
-    cstr_alphabet_map_to_uint(*u_buf, x, &preproc->alpha);
-    cstr_const_uislice u = CSTR_SLICE_CONST_CAST(*u_buf);
-
-    // Then build the suffix array
-    preproc->sa = cstr_alloc_uislice(x.len);
-    cstr_sais(*preproc->sa, u, &preproc->alpha);
-
-    // From the suffix array we can build the BWT of x
     cstr_sslice *w_buf = cstr_alloc_sslice(x.len);
     cstr_alphabet_map(*w_buf, x, &preproc->alpha);
     cstr_const_sslice w = CSTR_SLICE_CONST_CAST(*w_buf);
 
+    // Then build the suffix array, straight from the mapped bytes
+    preproc->sa = cstr_alloc_uislice(x.len);
+    cstr_sais_sslice(*preproc->sa, w, &preproc->alpha);
+
+    // From the suffix array we can build the BWT of x
     cstr_sslice *bwt_buf = cstr_alloc_sslice(x.len);
     cstr_bwt(*bwt_buf, w, *preproc->sa);
     cstr_const_sslice bwt = CSTR_SLICE_CONST_CAST(*bwt_buf);
@@ -130,16 +127,24 @@ struct cstr_bwt_preproc *cstr_bwt_preprocess(cstr_const_sslice x)
     // The information we need is all in the tables in preproc.
     free(bwt_buf);
     free(w_buf);
-    free(u_buf);
 
     return preproc;
 }
 
+struct cstr_bwt_preproc *cstr_bwt_preprocess_kmer(cstr_const_sslice x, size_t max_bytes)
+{
+    struct cstr_bwt_preproc *preproc = cstr_bwt_preprocess(x);
+    preproc->kmers = cstr_build_kmer_table(x, &preproc->alpha, max_bytes);
+    return preproc;
+}
+
 void cstr_free_bwt_preproc(struct cstr_bwt_preproc *preproc)
 {
     free(preproc->sa);
     free(preproc->ctab);
     free(preproc->otab);
+    free(preproc->kmers);
+    free(preproc);
 }
 
 typedef struct fmindex_matcher
@@ -180,15 +185,19 @@ cstr_fmindex_search(cstr_bwt_preproc *preproc, cstr_const_sslice raw_p)
 
         left = 0;
         right = otab->n;
-        for (long long i = p.len - 1; i >= 0; i--)
+        long long i = p.len - 1;
+        if (preproc->kmers)
+        {
+            // The table gives us the interval for the last k characters
+            long long k = cstr_kmer_table_k(preproc->kmers);
+            long long from = p.len < k ? 0 : p.len - k;
+            i -= cstr_kmer_table_lookup(preproc->kmers, CSTR_SUFFIX(raw_p, from), &left, &right);
+        }
+        for (; i >= 0 && left < right; i--)
         {
             uint8_t a = p.buf[i];
             left = C(a) + O(a, left);
             right = C(a) + O(a, right);
-            if (left >= right)
-            {
-                break;
-            }
         }
     }
     free(p_buf);
@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -105,6 +106,12 @@ GEN_ALLOC_SLICE_BUF(const_islice, const, int)
 GEN_ALLOC_SLICE_BUF(uislice, , unsigned int)
 GEN_APPEND_SLICE_BUF(uislice, , unsigned int)
 GEN_ALLOC_SLICE_BUF(const_uislice, const, unsigned int)
+GEN_ALLOC_SLICE_BUF(u16slice, , uint16_t)
+GEN_APPEND_SLICE_BUF(u16slice, , uint16_t)
+GEN_ALLOC_SLICE_BUF(const_u16slice, const, uint16_t)
+GEN_ALLOC_SLICE_BUF(u64slice, , uint64_t)
+GEN_APPEND_SLICE_BUF(u64slice, , uint64_t)
+GEN_ALLOC_SLICE_BUF(const_u64slice, const, uint64_t)
 
 #define GEN_SLICE_EQ(STYPE)                   \
     bool cstr_eq_##STYPE(cstr_##STYPE x,      \
@@ -127,6 +134,10 @@ GEN_SLICE_EQ(islice)
 GEN_SLICE_EQ(const_islice)
 GEN_SLICE_EQ(uislice)
 GEN_SLICE_EQ(const_uislice)
+GEN_SLICE_EQ(u16slice)
+GEN_SLICE_EQ(const_u16slice)
+GEN_SLICE_EQ(u64slice)
+GEN_SLICE_EQ(const_u64slice)
 
 #define GEN_SLICE_LE(STYPE)                            \
     bool cstr_le_##STYPE(cstr_##STYPE x,               \
@@ -149,6 +160,10 @@ GEN_SLICE_LE(islice)
 GEN_SLICE_LE(const_islice)
 GEN_SLICE_LE(uislice)
 GEN_SLICE_LE(const_uislice)
+GEN_SLICE_LE(u16slice)
+GEN_SLICE_LE(const_u16slice)
+GEN_SLICE_LE(u64slice)
+GEN_SLICE_LE(const_u64slice)
 
 #define GEN_SLICE_GE(STYPE)                            \
     bool cstr_ge_##STYPE(cstr_##STYPE x,               \
@@ -171,6 +186,10 @@ GEN_SLICE_GE(islice)
 GEN_SLICE_GE(const_islice)
 GEN_SLICE_GE(uislice)
 GEN_SLICE_GE(const_uislice)
+GEN_SLICE_GE(u16slice)
+GEN_SLICE_GE(const_u16slice)
+GEN_SLICE_GE(u64slice)
+GEN_SLICE_GE(const_u64slice)
 
 #define GEN_SLICE_LCP(STYPE)                           \
     long long cstr_lcp_##STYPE(cstr_##STYPE x,         \
@@ -192,6 +211,10 @@ GEN_SLICE_LCP(islice)
 GEN_SLICE_LCP(const_islice)
 GEN_SLICE_LCP(uislice)
 GEN_SLICE_LCP(const_uislice)
+GEN_SLICE_LCP(u16slice)
+GEN_SLICE_LCP(const_u16slice)
+GEN_SLICE_LCP(u64slice)
+GEN_SLICE_LCP(const_u64slice)
 
 #define CSTR_GEN_REV_SLICE(STYPE, BTYPE)  \
     void cstr_rev_##STYPE(cstr_##STYPE s) \
@@ -207,6 +230,8 @@ GEN_SLICE_LCP(const_uislice)
 CSTR_GEN_REV_SLICE(sslice, uint8_t)
 CSTR_GEN_REV_SLICE(islice, int)
 CSTR_GEN_REV_SLICE(uislice, unsigned int)
+CSTR_GEN_REV_SLICE(u16slice, uint16_t)
+CSTR_GEN_REV_SLICE(u64slice, uint64_t)
 
 #define GEN_FPRINT_SLICE(STYPE, FMT)                                      \
     void cstr_fprint_##STYPE(FILE *f, cstr_##STYPE x)                     \
@@ -226,3 +251,7 @@ GEN_FPRINT_SLICE(islice, "%d")
 GEN_FPRINT_SLICE(const_islice, "%d")
 GEN_FPRINT_SLICE(uislice, "%u")
 GEN_FPRINT_SLICE(const_uislice, "%u")
+GEN_FPRINT_SLICE(u16slice, "%" PRIu16)
+GEN_FPRINT_SLICE(const_u16slice, "%" PRIu16)
+GEN_FPRINT_SLICE(u64slice, "%" PRIu64)
+GEN_FPRINT_SLICE(const_u64slice, "%" PRIu64)
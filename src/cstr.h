@@ -25,6 +25,14 @@ long long cstr_strlen(const char *x); // returns length of x in bytes
 #define INLINE inline
 #endif
 
+// Hint that we will read the memory at ADDR soon. It is a no-op with
+// compilers where we don't know how to ask for it.
+#if defined(__GNUC__) || defined(__clang__)
+#define CSTR_PREFETCH(ADDR) __builtin_prefetch(ADDR)
+#else
+#define CSTR_PREFETCH(ADDR) ((void)(ADDR))
+#endif
+
 // Allocation that cannot fail (except by terminating the program).
 // With this, we don't need to test for allocation errors.
 void *cstr_malloc(size_t size);
@@ -212,6 +220,10 @@ CSTR_DEFINE_SLICE(islice,             ,  int)
 CSTR_DEFINE_SLICE(const_islice,  const,  int)
 CSTR_DEFINE_SLICE(uislice,            ,  unsigned int)
 CSTR_DEFINE_SLICE(const_uislice, const,  unsigned int)
+CSTR_DEFINE_SLICE(u16slice,           ,  uint16_t)
+CSTR_DEFINE_SLICE(const_u16slice, const, uint16_t)
+CSTR_DEFINE_SLICE(u64slice,           ,  uint64_t)
+CSTR_DEFINE_SLICE(const_u64slice, const, uint64_t)
 
 // clang-format on
 
@@ -229,7 +241,15 @@ CSTR_DEFINE_SLICE(const_uislice, const,  unsigned int)
            cstr_uislice                      \
            : cstr_##FUNC##_uislice,          \
            cstr_const_uislice                \
-           : cstr_##FUNC##_const_uislice)
+           : cstr_##FUNC##_const_uislice,    \
+           cstr_u16slice                     \
+           : cstr_##FUNC##_u16slice,         \
+           cstr_const_u16slice               \
+           : cstr_##FUNC##_const_u16slice,   \
+           cstr_u64slice                     \
+           : cstr_##FUNC##_u64slice,         \
+           cstr_const_u64slice               \
+           : cstr_##FUNC##_const_u64slice)
 
 #define CSTR_SLICE_DISPATCH_MUTABLE(X, FUNC) \
   _Generic((X),                              \
@@ -238,7 +258,11 @@ CSTR_DEFINE_SLICE(const_uislice, const,  unsigned int)
            cstr_islice                       \
            : cstr_##FUNC##_islice,           \
            cstr_uislice                      \
-           : cstr_##FUNC##_uislice)
+           : cstr_##FUNC##_uislice,          \
+           cstr_u16slice                     \
+           : cstr_##FUNC##_u16slice,         \
+           cstr_u64slice                     \
+           : cstr_##FUNC##_u64slice)
 
 #define CSTR_BASE_DISPATCH(B, FUNC)          \
   _Generic((B),                              \
@@ -253,7 +277,15 @@ CSTR_DEFINE_SLICE(const_uislice, const,  unsigned int)
            unsigned int *                    \
            : cstr_##FUNC##_uislice,          \
            const unsigned int *              \
-           : cstr_##FUNC##_const_uislice)
+           : cstr_##FUNC##_const_uislice,    \
+           uint16_t *                        \
+           : cstr_##FUNC##_u16slice,         \
+           const uint16_t *                  \
+           : cstr_##FUNC##_const_u16slice,   \
+           uint64_t *                        \
+           : cstr_##FUNC##_u64slice,         \
+           const uint64_t *                  \
+           : cstr_##FUNC##_const_u64slice)
 
 
 
@@ -267,7 +299,11 @@ CSTR_DEFINE_SLICE(const_uislice, const,  unsigned int)
            cstr_islice                                                 \
            : CSTR_SLICE((const int *)(void *)(S).buf, (S).len),        \
            cstr_uislice                                                \
-           : CSTR_SLICE((const unsigned int *)(void *)(S).buf, (S).len))
+           : CSTR_SLICE((const unsigned int *)(void *)(S).buf, (S).len), \
+           cstr_u16slice                                               \
+           : CSTR_SLICE((const uint16_t *)(void *)(S).buf, (S).len),   \
+           cstr_u64slice                                               \
+           : CSTR_SLICE((const uint64_t *)(void *)(S).buf, (S).len))
 
 // x[i] handling both positive and negative indices. Usually,
 // x.buf[i] is more natural, if you only need to use positive
@@ -316,6 +352,10 @@ bool cstr_eq_islice(cstr_islice x, cstr_islice y);
 bool cstr_eq_const_islice(cstr_const_islice x, cstr_const_islice y);
 bool cstr_eq_uislice(cstr_uislice x, cstr_uislice y);
 bool cstr_eq_const_uislice(cstr_const_uislice x, cstr_const_uislice y);
+bool cstr_eq_u16slice(cstr_u16slice x, cstr_u16slice y);
+bool cstr_eq_const_u16slice(cstr_const_u16slice x, cstr_const_u16slice y);
+bool cstr_eq_u64slice(cstr_u64slice x, cstr_u64slice y);
+bool cstr_eq_const_u64slice(cstr_const_u64slice x, cstr_const_u64slice y);
 #define CSTR_SLICE_EQ(A, B) CSTR_SLICE_DISPATCH(A, eq)(A, B)
 
 bool cstr_ge_sslice(cstr_sslice x, cstr_sslice y);
@@ -324,6 +364,10 @@ bool cstr_ge_islice(cstr_islice x, cstr_islice y);
 bool cstr_ge_const_islice(cstr_const_islice x, cstr_const_islice y);
 bool cstr_ge_uislice(cstr_uislice x, cstr_uislice y);
 bool cstr_ge_const_uislice(cstr_const_uislice x, cstr_const_uislice y);
+bool cstr_ge_u16slice(cstr_u16slice x, cstr_u16slice y);
+bool cstr_ge_const_u16slice(cstr_const_u16slice x, cstr_const_u16slice y);
+bool cstr_ge_u64slice(cstr_u64slice x, cstr_u64slice y);
+bool cstr_ge_const_u64slice(cstr_const_u64slice x, cstr_const_u64slice y);
 #define CSTR_SLICE_GE(A, B) CSTR_SLICE_DISPATCH(A, ge)(A, B)
 
 bool cstr_le_sslice(cstr_sslice x, cstr_sslice y);
@@ -332,6 +376,10 @@ bool cstr_le_islice(cstr_islice x, cstr_islice y);
 bool cstr_le_const_islice(cstr_const_islice x, cstr_const_islice y);
 bool cstr_le_uislice(cstr_uislice x, cstr_uislice y);
 bool cstr_le_const_uislice(cstr_const_uislice x, cstr_const_uislice y);
+bool cstr_le_u16slice(cstr_u16slice x, cstr_u16slice y);
+bool cstr_le_const_u16slice(cstr_const_u16slice x, cstr_const_u16slice y);
+bool cstr_le_u64slice(cstr_u64slice x, cstr_u64slice y);
+bool cstr_le_const_u64slice(cstr_const_u64slice x, cstr_const_u64slice y);
 #define CSTR_SLICE_LE(A, B) CSTR_SLICE_DISPATCH(A, le)(A, B)
 
 long long cstr_lcp_sslice(cstr_sslice x, cstr_sslice y);
@@ -340,6 +388,10 @@ long long cstr_lcp_islice(cstr_islice x, cstr_islice y);
 long long cstr_lcp_const_islice(cstr_const_islice x, cstr_const_islice y);
 long long cstr_lcp_uislice(cstr_uislice x, cstr_uislice y);
 long long cstr_lcp_const_uislice(cstr_const_uislice x, cstr_const_uislice y);
+long long cstr_lcp_u16slice(cstr_u16slice x, cstr_u16slice y);
+long long cstr_lcp_const_u16slice(cstr_const_u16slice x, cstr_const_u16slice y);
+long long cstr_lcp_u64slice(cstr_u64slice x, cstr_u64slice y);
+long long cstr_lcp_const_u64slice(cstr_const_u64slice x, cstr_const_u64slice y);
 #define CSTR_SLICE_LCP(A, B) CSTR_SLICE_DISPATCH(A, lcp)(A, B)
 
 // Reversing slices
@@ -348,6 +400,8 @@ long long cstr_lcp_const_uislice(cstr_const_uislice x, cstr_const_uislice y);
 CSTR_GEN_REV_SLICE_PROTOTYPE(sslice)
 CSTR_GEN_REV_SLICE_PROTOTYPE(islice)
 CSTR_GEN_REV_SLICE_PROTOTYPE(uislice)
+CSTR_GEN_REV_SLICE_PROTOTYPE(u16slice)
+CSTR_GEN_REV_SLICE_PROTOTYPE(u64slice)
 #define CSTR_REV_SLICE(S) CSTR_SLICE_DISPATCH_MUTABLE(S, rev)(S)
 
 // I/O
@@ -357,6 +411,10 @@ void cstr_fprint_uislice(FILE *f, cstr_uislice x);
 void cstr_fprint_const_sslice(FILE *f, cstr_const_sslice x);
 void cstr_fprint_const_islice(FILE *f, cstr_const_islice x);
 void cstr_fprint_const_uislice(FILE *f, cstr_const_uislice x);
+void cstr_fprint_u16slice(FILE *f, cstr_u16slice x);
+void cstr_fprint_const_u16slice(FILE *f, cstr_const_u16slice x);
+void cstr_fprint_u64slice(FILE *f, cstr_u64slice x);
+void cstr_fprint_const_u64slice(FILE *f, cstr_const_u64slice x);
 #define CSTR_SLICE_FPRINT(F, S) CSTR_SLICE_DISPATCH(S, fprint)(F, S)
 #define CSTR_SLICE_PRINT(S) CSTR_SLICE_DISPATCH(S, fprint)(stdout, S)
 
@@ -381,10 +439,16 @@ CSTR_BUF_SLICE_DEREF_FUNC(islice,             ,  int)
 CSTR_BUF_SLICE_DEREF_FUNC(const_islice,  const,  int)
 CSTR_BUF_SLICE_DEREF_FUNC(uislice,            ,  unsigned int)
 CSTR_BUF_SLICE_DEREF_FUNC(const_uislice, const,  unsigned int)
+CSTR_BUF_SLICE_DEREF_FUNC(u16slice,           ,  uint16_t)
+CSTR_BUF_SLICE_DEREF_FUNC(const_u16slice, const, uint16_t)
+CSTR_BUF_SLICE_DEREF_FUNC(u64slice,           ,  uint64_t)
+CSTR_BUF_SLICE_DEREF_FUNC(const_u64slice, const, uint64_t)
 
 CSTR_BUF_APPEND_PROTOTYPE(sslice,  , uint8_t)
 CSTR_BUF_APPEND_PROTOTYPE(islice,  , int)
 CSTR_BUF_APPEND_PROTOTYPE(uislice, , unsigned int)
+CSTR_BUF_APPEND_PROTOTYPE(u16slice, , uint16_t)
+CSTR_BUF_APPEND_PROTOTYPE(u64slice, , uint64_t)
 
 
 #define CSTR_BUF_DISPATCH_MUTABLE(X, FUNC)   \
@@ -394,7 +458,11 @@ CSTR_BUF_APPEND_PROTOTYPE(uislice, , unsigned int)
            cstr_islice_buf *                 \
            : cstr_##FUNC##_islice_buf,       \
            cstr_uislice_buf *                \
-           : cstr_##FUNC##_uislice_buf)
+           : cstr_##FUNC##_uislice_buf,      \
+           cstr_u16slice_buf *               \
+           : cstr_##FUNC##_u16slice_buf,     \
+           cstr_u64slice_buf *               \
+           : cstr_##FUNC##_u64slice_buf)
 
 #define CSTR_BUF_SLICE_DISPATCH(X, FUNC)       \
   _Generic((X),                                \
@@ -403,7 +471,11 @@ CSTR_BUF_APPEND_PROTOTYPE(uislice, , unsigned int)
            cstr_islice_buf_slice               \
            : cstr_##FUNC##_islice_buf_slice,   \
            cstr_uislice_buf_slice              \
-           : cstr_##FUNC##_uislice_buf_slice)
+           : cstr_##FUNC##_uislice_buf_slice,  \
+           cstr_u16slice_buf_slice             \
+           : cstr_##FUNC##_u16slice_buf_slice, \
+           cstr_u64slice_buf_slice             \
+           : cstr_##FUNC##_u64slice_buf_slice)
 
 #define CSTR_BUF_APPEND(B, V) CSTR_BUF_DISPATCH_MUTABLE(B, append)(&(B), V)
 #define CSTR_BUF_SLICE_APPEND(BS, V) CSTR_BUF_SLICE_DISPATCH(BS, append)(BS, V)
@@ -500,6 +572,40 @@ cstr_exact_matcher *cstr_naive_matcher(cstr_const_sslice x, cstr_const_sslice p)
 cstr_exact_matcher *cstr_ba_matcher(cstr_const_sslice x, cstr_const_sslice p);
 cstr_exact_matcher *cstr_kmp_matcher(cstr_const_sslice x, cstr_const_sslice p);
 
+// Naive matching over 2-bit packed DNA, comparing 32 bases per word.
+// Only A, C, G and T (either case) are packed. Other symbols in x are
+// handled by verifying candidates byte-by-byte, and if p has other symbols
+// you get the naive matcher instead.
+cstr_exact_matcher *cstr_packed_dna_matcher(cstr_const_sslice x, cstr_const_sslice p);
+
+// The same, but with the text packed once, so you can search it for as many
+// patterns as you like without packing it again. The preprocessed text only
+// holds a slice to x, so x must outlive it, and it must outlive its matchers.
+typedef struct cstr_packed_dna_preproc cstr_packed_dna_preproc;
+cstr_packed_dna_preproc *cstr_packed_dna_preprocess(cstr_const_sslice x);
+void cstr_free_packed_dna_preproc(cstr_packed_dna_preproc *preproc);
+cstr_exact_matcher *cstr_packed_dna_search(cstr_packed_dna_preproc const *preproc, cstr_const_sslice p);
+
+// == MULTI-PATTERN EXACT MATCHERS ==============
+// Searching for a whole batch of patterns in one pass over x.
+typedef struct cstr_multi_match
+{
+  long long pattern; // index of the pattern in the batch
+  long long pos;     // -1 if no more matches
+} cstr_multi_match;
+
+typedef struct cstr_multi_matcher cstr_multi_matcher;
+cstr_multi_match cstr_multi_next_match(cstr_multi_matcher *matcher);
+void cstr_free_multi_matcher(cstr_multi_matcher *matcher);
+
+// Rabin-Karp for k patterns that must all have the same length. The
+// preprocessed table only holds slices to the patterns, so their buffers
+// must outlive it. You can search as many texts as you want with the table.
+typedef struct cstr_rk_preproc cstr_rk_preproc;
+cstr_rk_preproc *cstr_rk_preprocess(long long k, cstr_const_sslice const p[k]);
+void cstr_free_rk_preproc(cstr_rk_preproc *preproc);
+cstr_multi_matcher *cstr_rk_search(cstr_rk_preproc *preproc, cstr_const_sslice x);
+
 // == SUFFIX ARRAYS =====================================================
 // Suffix arrays stored in uislice objects can only handle lenghts
 // up to x.len <= UINT_MAX, and the caller must ensure that. We limit
@@ -516,10 +622,183 @@ typedef cstr_uislice cstr_suffix_array;
 // into sa.
 void cstr_skew(cstr_suffix_array sa, cstr_const_uislice x, cstr_alphabet *alpha);
 void cstr_sais(cstr_suffix_array sa, cstr_const_uislice x, cstr_alphabet *alpha);
+// The same, but with x mapped to alpha as bytes (as cstr_alphabet_map gives
+// you), so you don't need an unsigned int copy of the string.
+void cstr_sais_sslice(cstr_suffix_array sa, cstr_const_sslice x, cstr_alphabet *alpha);
+// clang-format off
+#define CSTR_SAIS(SA, X, ALPHA)          \
+  _Generic((X),                          \
+           cstr_const_sslice             \
+           : cstr_sais_sslice,           \
+           cstr_const_uislice            \
+           : cstr_sais)(SA, X, ALPHA)
+// clang-format on
+// Gives the same suffix array as cstr_sais, but spreads the work over
+// no_threads threads (the calling thread included). The second works on
+// x mapped to alpha as bytes, as cstr_sais_sslice does.
+void cstr_sais_parallel(cstr_suffix_array sa, cstr_const_uislice x,
+                        cstr_alphabet *alpha, int no_threads);
+void cstr_sais_parallel_sslice(cstr_suffix_array sa, cstr_const_sslice x,
+                               cstr_alphabet *alpha, int no_threads);
+// The same for skew, so it stays usable as an independent check on big input
+void cstr_skew_parallel(cstr_suffix_array sa, cstr_const_uislice x,
+                        cstr_alphabet *alpha, int no_threads);
+// SA-IS with constant extra space: x is the string mapped to alpha as
+// bytes (as cstr_alphabet_map gives you), and we need no memory beyond sa.
+void cstr_sacak(cstr_suffix_array sa, cstr_const_sslice x, cstr_alphabet const *alpha);
+
+// Checks that sa is the suffix array of x, for arrays you loaded or got
+// from a construction you don't trust. x can be mapped or not. The full
+// check is linear and needs an inverse suffix array, 4n bytes. The sampled
+// check compares the suffixes at the given number of evenly spaced pairs
+// of neighbours in sa directly, so it costs the LCP of those pairs and no
+// memory, but it only catches errors at the pairs it looks at.
+bool cstr_sa_verify(cstr_suffix_array sa, cstr_const_sslice x);
+bool cstr_sa_verify_sampled(cstr_suffix_array sa, cstr_const_sslice x, long long samples);
 
 cstr_exact_matcher *cstr_sa_bsearch(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_sslice p);
 
+// Enhanced suffix array: the suffix array plus LCP-LR tables, so a search
+// takes O(m + log n) time instead of O(m log n). It costs 8n bytes. It keeps
+// the sa and x slices, so they must outlive it, and sa must be built from x
+// (x as in cstr_sa_bsearch).
+typedef struct cstr_esa cstr_esa;
+cstr_esa *cstr_esa_preprocess(cstr_suffix_array sa, cstr_const_sslice x);
+void cstr_free_esa(cstr_esa *esa);
+cstr_exact_matcher *cstr_esa_search(cstr_esa const *esa, cstr_const_sslice p);
+
+// Sampled index for cstr_sa_bsearch: the first characters of every k'th
+// suffix in sa, in a cache-friendly order, so the first log(n/k) steps of
+// a search don't touch sa or x. It costs about 12n/k bytes. It keeps the sa and x
+// slices, so they must outlive it, and sa must be built from x (x as in
+// cstr_sa_bsearch). Returns NULL if k < 1.
+typedef struct cstr_sa_sample_index cstr_sa_sample_index;
+cstr_sa_sample_index *cstr_sa_sample_index_build(cstr_suffix_array sa, cstr_const_sslice x, long long k);
+void cstr_free_sa_sample_index(cstr_sa_sample_index *idx);
+cstr_exact_matcher *cstr_sa_sample_index_search(cstr_sa_sample_index const *idx, cstr_const_sslice p);
+
+// Prefix tables: the suffix array interval for every string of length k
+// over the alphabet (sentinel included), so searches can skip the first
+// k steps. x is the string as in cstr_sa_bsearch and alpha its alphabet,
+// and we pick the largest k where the table fits in max_bytes, at most
+// sigma^k <= |x|. You don't need the suffix array to build the table.
+typedef struct cstr_kmer_table cstr_kmer_table;
+cstr_kmer_table *cstr_build_kmer_table(cstr_const_sslice x, cstr_alphabet const *alpha, size_t max_bytes);
+void cstr_free_kmer_table(cstr_kmer_table *tab);
+long long cstr_kmer_table_k(cstr_kmer_table const *tab);
+// Sets [*lo, *hi) to the interval of suffixes that start with the first
+// min(k, |p|) characters of p, and returns how many characters that is.
+// p is not mapped.
+long long cstr_kmer_table_lookup(cstr_kmer_table const *tab, cstr_const_sslice p,
+                                 long long *lo, long long *hi);
+// cstr_sa_bsearch starting from the table's interval
+cstr_exact_matcher *cstr_sa_kmer_search(cstr_suffix_array sa, cstr_const_sslice x,
+                                        cstr_kmer_table const *tab, cstr_const_sslice p);
+
+// Searches for k patterns at once. We sort them, so patterns that share a
+// prefix are next to each other, and we only search for the shared prefix
+// once. The suffixes that start with p[i] are sa[iv[i].lo], ..., sa[iv[i].hi - 1].
+typedef struct cstr_sa_interval
+{
+  long long lo, hi;
+} cstr_sa_interval;
+void cstr_sa_batch_search(cstr_suffix_array sa, cstr_const_sslice x,
+                          long long k, cstr_const_sslice const p[k],
+                          cstr_sa_interval iv[k]);
+
+// Sparse suffix arrays: only the suffixes that start at a sample of the
+// positions, sorted, with memory proportional to the sample. x must end
+// with the sentinel, and it doesn't need to be mapped. cstr_sa_bsearch
+// works on them, and reports the sampled positions where p occurs.
+//
+// For any positions, ssa and pos must have the same length but can be the
+// same slice. This sorts with string comparisons, so it is slow when the
+// sampled suffixes share long prefixes.
+void cstr_sparse_sa(cstr_suffix_array ssa, cstr_const_sslice x, cstr_const_uislice pos);
+// For positions 0, k, 2k, ..., in linear time; ssa.len must be ceil(|x| / k).
+void cstr_sparse_sa_every(cstr_suffix_array ssa, cstr_const_sslice x, long long k);
+
+// Semi-external construction, for when the suffix array doesn't fit in
+// memory next to x: writes the suffix array of x to the file fname, in
+// the format cstr_write_sa writes, so you can load it with cstr_load_sa.
+// x is mapped to alpha as bytes, as for cstr_sais_sslice. Apart from x,
+// we use no more than ram_bytes of memory, and we scan x about
+// 10|x| / ram_bytes times, up to twice that if x is repetitive. We compare
+// suffixes through a sample of ranked suffixes, and to build that,
+// ram_bytes must be at least about |x| / 4 (relatively more for short x).
+// Returns false if it isn't, or if we can't write the file.
+bool cstr_sa_external(const char *fname, cstr_const_sslice x,
+                      cstr_alphabet const *alpha, size_t ram_bytes);
+
+// Suffix array files, so you don't have to rebuild the array every time.
+// The file has a versioned header with the alphabet (if you give one) and
+// a checksum, and then the suffix array, page aligned. Loading maps the
+// file into memory and gives you the suffix array where it lies, so it
+// costs no more than the pages you touch. The array is only valid
+// until you free the file, and writing to it doesn't change the file.
+// Files written on a machine with another byte order or int size are
+// rejected. With verify, we check the checksum, which reads all of it.
+// Writing returns false if the file can't be written; loading returns
+// NULL if it can't be read or isn't a valid suffix array file.
+typedef struct cstr_sa_file cstr_sa_file;
+bool cstr_write_sa(const char *fname, cstr_suffix_array sa, cstr_alphabet const *alpha);
+cstr_sa_file *cstr_load_sa(const char *fname, bool verify);
+cstr_suffix_array cstr_sa_file_sa(cstr_sa_file const *file);
+// NULL if the file was written without an alphabet
+cstr_alphabet const *cstr_sa_file_alphabet(cstr_sa_file const *file);
+void cstr_free_sa_file(cstr_sa_file *file);
+
+// LCP arrays: lcp[r] is the length of the longest common prefix of the
+// suffixes at sa[r-1] and sa[r], and lcp[0] is zero. Slice lcp must be
+// the same length as sa and x, and x must be the string sa was built from
+// (mapped or not, as long as it ends with the sentinel). Both run in linear
+// time. Kasai's algorithm needs a temporary inverse suffix array, 4n bytes;
+// the Phi algorithm works in the lcp slice and only needs n bits extra.
+void cstr_lcp_kasai(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x);
+void cstr_lcp_phi(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x);
+// Phi with no_threads threads (the calling thread included). It needs
+// 4n bytes extra for the permuted LCP array.
+void cstr_lcp_phi_parallel(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x,
+                           int no_threads);
+// Builds the suffix array with cstr_sais_sslice and then the LCP array from it
+// with cstr_lcp_phi.
+void cstr_sais_lcp(cstr_suffix_array sa, cstr_uislice lcp,
+                   cstr_const_sslice x, cstr_alphabet *alpha);
+
+// ==== Generalized suffix arrays ================================
+// One suffix array over k strings (records), for searching all of them
+// at once and getting the matches as (record, position in record). It
+// keeps its own copy of the records, mapped, so you can free x after.
+// The records must use at most 254 different bytes; if not, you get NULL.
+typedef struct cstr_gsa cstr_gsa;
+cstr_gsa *cstr_gsa_build(long long k, cstr_const_sslice const x[k]);
+void cstr_free_gsa(cstr_gsa *gsa);
+long long cstr_gsa_records(cstr_gsa const *gsa);
+
+typedef struct cstr_gsa_match
+{
+  long long record; // -1 if no more matches
+  long long pos;    // position in the record
+} cstr_gsa_match;
+
+// The search doesn't assume that p is mapped. The empty pattern matches
+// at every position in every record, but not at their ends.
+typedef struct cstr_gsa_matcher cstr_gsa_matcher;
+cstr_gsa_matcher *cstr_gsa_search(cstr_gsa const *gsa, cstr_const_sslice p);
+cstr_gsa_match cstr_gsa_next_match(cstr_gsa_matcher *matcher);
+void cstr_free_gsa_matcher(cstr_gsa_matcher *matcher);
+
+// Translate a position in the concatenated records (each followed by a
+// separator) to the record and the position in it.
+cstr_gsa_match cstr_gsa_locate(cstr_gsa const *gsa, long long pos);
+
 // ==== Suffix trees ==============================================
+// The trees use 32-bit node references and edge offsets to save space,
+// with one bit reserved for telling leaves from inner nodes, so they only
+// hold strings up to CSTR_ST_MAX_LEN long (a little under 2^31). The
+// constructions return NULL for longer x, without looking at it, and
+// cstr_st_append refuses to grow a tree beyond it.
+#define CSTR_ST_MAX_LEN ((1LL << 31) - (1LL << 20))
 
 typedef struct cstr_suffix_tree cstr_suffix_tree;
 
@@ -527,6 +806,31 @@ cstr_suffix_tree *cstr_naive_suffix_tree(cstr_alphabet const *alpha,
                                          cstr_const_sslice x);
 cstr_suffix_tree *cstr_mccreight_suffix_tree(cstr_alphabet const *alpha,
                                              cstr_const_sslice x);
+cstr_suffix_tree *cstr_ukkonen_suffix_tree(cstr_alphabet const *alpha,
+                                           cstr_const_sslice x);
+
+// Builds the tree from the suffix array and LCP array of x (see
+// cstr_sais_lcp) in a single left-to-right pass. It is the fastest way to
+// the tree if you have, or need, the arrays anyway.
+cstr_suffix_tree *cstr_lcp_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x,
+                                       cstr_suffix_array sa, cstr_uislice lcp);
+// Builds the suffix and LCP arrays and then the tree, with no_threads
+// threads (the calling thread included). The threads build the subtrees
+// for suffixes with different first letters, so a string where most
+// suffixes start the same way gives them uneven work.
+cstr_suffix_tree *cstr_parallel_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x,
+                                            int no_threads);
+
+// Online construction: start with an empty tree and append to it. The
+// appended strings must be mapped to alpha, and the tree keeps its own copy.
+// You can search the tree between appends, but a matcher is only valid
+// until the next append, and until the tree is complete it reports the
+// matches in no particular order. Appending the sentinel completes the
+// tree, and then it is the same as the other constructions give you and
+// you can't append any more. Appending returns false, and leaves the tree
+// as it was, if the tree would get longer than CSTR_ST_MAX_LEN.
+cstr_suffix_tree *cstr_new_online_suffix_tree(cstr_alphabet const *alpha);
+bool cstr_st_append(cstr_suffix_tree *st, cstr_const_sslice s);
 
 void cstr_free_suffix_tree(cstr_suffix_tree *st);
 
@@ -539,6 +843,22 @@ void cstr_free_st_leaf_iter(cstr_st_leaf_iter *iter);
 cstr_exact_matcher *cstr_st_exact_search(cstr_suffix_tree *st, cstr_const_sslice p);
 cstr_exact_matcher *cstr_st_exact_search_map(cstr_suffix_tree *st, cstr_const_sslice p);
 
+// Suffix tree files hold the tree flattened, in depth-first order and with
+// offsets instead of pointers, together with x and the alphabet, so we
+// search the file where it is mapped and build nothing when we load it.
+// The tree must be complete. Loading checks the header, and if you ask
+// for it, a checksum of the rest, which costs a pass over the file. The
+// searches find the same matches, in the same order, as cstr_st_exact_search
+// and cstr_st_exact_search_map on the tree.
+typedef struct cstr_st_file cstr_st_file;
+bool cstr_write_suffix_tree(const char *fname, cstr_suffix_tree *st);
+cstr_st_file *cstr_load_suffix_tree(const char *fname, bool verify);
+void cstr_free_st_file(cstr_st_file *file);
+cstr_alphabet const *cstr_st_file_alphabet(cstr_st_file const *file);
+cstr_const_sslice cstr_st_file_string(cstr_st_file const *file); // x, mapped
+cstr_exact_matcher *cstr_st_file_search(cstr_st_file const *file, cstr_const_sslice p);
+cstr_exact_matcher *cstr_st_file_search_map(cstr_st_file const *file, cstr_const_sslice p);
+
 // ==== Burrows-Wheeler transform =================================
 
 void cstr_bwt(cstr_sslice bwt, cstr_const_sslice x, cstr_suffix_array sa);
@@ -549,6 +869,9 @@ typedef struct cstr_bwt_preproc cstr_bwt_preproc; // Preprocessed tables for sea
 // and building the tables for searching. You could save some time, if you already did
 // some of the preprocessing elsewhere, by writing a function that does somewhat less.
 cstr_bwt_preproc *cstr_bwt_preprocess(cstr_const_sslice x);
+// The same, plus a k-mer table of at most max_bytes that
+// cstr_fmindex_search uses to skip the last k steps of the search.
+cstr_bwt_preproc *cstr_bwt_preprocess_kmer(cstr_const_sslice x, size_t max_bytes);
 
 // This matcher does not assume that p is already mapped. It does assume that you have built
 // the preproc tables.
@@ -556,6 +879,51 @@ cstr_exact_matcher *cstr_fmindex_search(cstr_bwt_preproc *preproc, cstr_const_ss
 
 void cstr_free_bwt_preproc(struct cstr_bwt_preproc *preproc);
 
+// == AUTOMATIC MATCHER SELECTION ==================================
+// Picks the exact matcher with the smallest predicted running time
+// from n = |x|, m = |p|, the alphabet size and the indices you have.
+
+typedef enum cstr_auto_engine
+{
+  CSTR_AUTO_NAIVE,
+  CSTR_AUTO_PACKED,
+  CSTR_AUTO_BA,
+  CSTR_AUTO_KMP,
+  CSTR_AUTO_SA,
+  CSTR_AUTO_FMINDEX,
+} cstr_auto_engine;
+
+// Cost per unit of work for each engine, in nanoseconds.
+typedef struct cstr_auto_costs
+{
+  double naive;    // per character comparison
+  double packed;   // per text position
+  double ba;       // per text character
+  double kmp;      // per text character
+  double sa_probe; // per binary search step
+  double fm_step;  // per pattern character
+} cstr_auto_costs;
+
+extern const cstr_auto_costs cstr_auto_default_costs;
+
+// Measures the costs on this machine with a small benchmark (it takes
+// a fraction of a second). Uses rand(), so seed it if you care.
+cstr_auto_costs cstr_auto_calibrate(void);
+
+// If costs is NULL, the default costs are used. Set dna if both text
+// and pattern consist of A, C, G and T only.
+cstr_auto_engine cstr_auto_choose(cstr_auto_costs const *costs,
+                                  long long n, long long m, long long sigma,
+                                  bool dna, bool has_sa, bool has_fmindex);
+
+// sa and fmindex are optional (NULL if you don't have them), but if
+// you provide them they must be built from x. The alphabet is estimated
+// from a prefix of x.
+cstr_exact_matcher *cstr_auto_matcher(cstr_auto_costs const *costs,
+                                      cstr_const_sslice x, cstr_const_sslice p,
+                                      cstr_suffix_array const *sa,
+                                      cstr_bwt_preproc *fmindex);
+
 // ==== Li-Durbin approximative matching ==========================
 typedef struct cstr_li_durbin_preproc cstr_li_durbin_preproc;
 cstr_li_durbin_preproc *cstr_li_durbin_preprocess(cstr_const_sslice x);
@@ -38,7 +38,7 @@ struct naive_matcher_state
 
 static long long naive_next(struct naive_matcher_state *s)
 {
-    for (; s->i < n(s); s->i++)
+    for (; s->i + m(s) <= n(s); s->i++)
     {
         for (long long j = 0; j < m(s); j++)
         {
@@ -188,6 +188,289 @@ cstr_exact_matcher *cstr_kmp_matcher(cstr_const_sslice x, cstr_const_sslice p)
     return (cstr_exact_matcher *)state;
 }
 
+// Word-packed naive algorithm for DNA, O(nm/32)
+//
+// We pack A, C, G and T into two bits each, so a 64-bit word holds 32
+// bases and we can compare 32 bases at a time with a shift and an XOR.
+// Lower and upper case letters get the same code, and every other symbol
+// gets code zero, so the packed comparison is only a filter. We keep a bit
+// per text position that tells us if it holds anything but an upper case
+// base, and verify byte-by-byte only the hits that overlap one of those,
+// or all hits if the pattern has lower case bases. If the pattern itself
+// contains anything but ACGT, the filter can't help us, so we use the
+// plain naive matcher instead.
+//
+// Packing the text costs as much as a scan, so if you search the same
+// text for many patterns, preprocess it once and search the packed text.
+
+#define BASES_PER_WORD 32
+
+// Codes are stored plus one, so the (implicit) zero entries are
+// the symbols that are not bases.
+static const uint8_t base_codes[256] = {
+    ['A'] = 1, ['C'] = 2, ['G'] = 3, ['T'] = 4,
+    ['a'] = 1, ['c'] = 2, ['g'] = 3, ['t'] = 4,
+};
+static inline bool is_base(uint8_t a) { return base_codes[a] != 0; }
+static inline uint64_t base_code(uint8_t a)
+{
+    // Non-bases get code 0, the same as A, which is fine since
+    // we verify all hits.
+    return base_codes[a] ? (uint64_t)(base_codes[a] - 1) : 0;
+}
+
+static inline long long no_packed_words(long long n)
+{
+    return (n + BASES_PER_WORD - 1) / BASES_PER_WORD;
+}
+
+// Base i sits at bit 2 * (i % 32) in word i / 32.
+static void pack_bases(uint64_t *words, cstr_const_sslice x)
+{
+    for (long long w = 0, i = 0; w < no_packed_words(x.len); w++)
+    {
+        uint64_t word = 0;
+        for (unsigned int shift = 0; shift < 64 && i < x.len; shift += 2, i++)
+        {
+            word |= base_code(x.buf[i]) << shift;
+        }
+        words[w] = word;
+    }
+}
+
+// The 32 bases starting at base i. The text words have a zero word
+// as padding, so we can always read the word after i's word.
+static inline uint64_t packed_window(const uint64_t *words, long long i)
+{
+    long long w = i / BASES_PER_WORD;
+    unsigned int shift = 2 * (unsigned int)(i % BASES_PER_WORD);
+    return shift ? (words[w] >> shift) | (words[w + 1] << (64 - shift))
+                 : words[w];
+}
+
+static inline uint64_t packed_base(const uint64_t *words, long long i)
+{
+    return (words[i / BASES_PER_WORD] >> (2 * (i % BASES_PER_WORD))) & 3;
+}
+
+// A, C, G and T in upper case. Where x and p both hold only these,
+// equal codes mean equal bytes, so we need not verify.
+static inline bool is_upper_base(uint8_t a)
+{
+    return a == 'A' || a == 'C' || a == 'G' || a == 'T';
+}
+
+struct cstr_packed_dna_preproc
+{
+    cstr_const_sslice x;
+    bool all_upper;  // x holds only upper case bases
+    uint64_t *other; // bit i is set if x[i] isn't an upper case base
+    uint64_t words[]; // packed text, two padding words, then the other bits
+};
+
+static inline long long no_bit_words(long long n) { return (n + 63) / 64; }
+
+cstr_packed_dna_preproc *cstr_packed_dna_preprocess(cstr_const_sslice x)
+{
+    long long no_x_words = no_packed_words(x.len) + 2; // +2 for padding
+    cstr_packed_dna_preproc *preproc =
+        CSTR_MALLOC_FLEX_ARRAY(preproc, words, (size_t)(no_x_words + no_bit_words(x.len)));
+    *preproc = (cstr_packed_dna_preproc){
+        .x = x, .all_upper = true, .other = preproc->words + no_x_words};
+
+    pack_bases(preproc->words, x);
+    preproc->words[no_x_words - 2] = preproc->words[no_x_words - 1] = 0;
+    memset(preproc->other, 0, (size_t)no_bit_words(x.len) * sizeof *preproc->other);
+    for (long long i = 0; i < x.len; i++)
+    {
+        if (!is_upper_base(x.buf[i]))
+        {
+            preproc->other[i / 64] |= 1ull << (i % 64);
+            preproc->all_upper = false;
+        }
+    }
+
+    return preproc;
+}
+
+void cstr_free_packed_dna_preproc(cstr_packed_dna_preproc *preproc)
+{
+    free(preproc);
+}
+
+// Is any of x[i, i + m) something other than an upper case base?
+static bool has_other(cstr_packed_dna_preproc const *preproc, long long i, long long m)
+{
+    if (preproc->all_upper)
+    {
+        return false;
+    }
+    long long end = i + m;
+    for (long long w = i / 64; w * 64 < end; w++)
+    {
+        uint64_t bits = preproc->other[w];
+        if (w == i / 64)
+        {
+            bits &= ~0ull << (i % 64);
+        }
+        if ((w + 1) * 64 > end)
+        {
+            bits &= (1ull << (end % 64)) - 1;
+        }
+        if (bits)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct packed_matcher_state
+{
+    SHARED
+    cstr_packed_dna_preproc const *text;
+    cstr_packed_dna_preproc *own; // the text, if we packed it for this matcher only
+    bool verify_all;    // p has lower case bases, so we must verify every hit
+    long long i;
+    uint64_t window;    // the 32 bases starting at i
+    long long no_p_words;
+    uint64_t first_mask; // bits in the first pattern word that are in p
+    uint64_t last_mask;  // bits in the last pattern word that are in p
+    uint64_t p_words[];  // packed pattern
+};
+
+// Checks the words after the first. We only get here when
+// the first word already matched.
+static inline bool packed_rest_eq(struct packed_matcher_state *s)
+{
+    for (long long w = 1; w < s->no_p_words - 1; w++)
+    {
+        if (packed_window(s->text->words, s->i + w * BASES_PER_WORD) != s->p_words[w])
+        {
+            return false;
+        }
+    }
+    if (s->no_p_words == 1)
+    {
+        return true;
+    }
+    uint64_t last = packed_window(s->text->words, s->i + (s->no_p_words - 1) * BASES_PER_WORD);
+    return ((last ^ s->p_words[s->no_p_words - 1]) & s->last_mask) == 0;
+}
+
+// The packed words matched; the bytes only need checking if
+// p or the window holds anything but upper case bases.
+static inline bool packed_verify(struct packed_matcher_state *s)
+{
+    if (!s->verify_all && !has_other(s->text, s->i, m(s)))
+    {
+        return true;
+    }
+    return memcmp(x(s) + s->i, p(s), (size_t)m(s)) == 0;
+}
+
+// We slide the window one base at a time, shifting in the bases from the
+// next text word; past the end of x they are zero, because of the padding.
+// We keep it all in locals, since the compiler can't tell that the state
+// doesn't alias the text and would store it back in every step.
+static long long packed_next(struct packed_matcher_state *s)
+{
+    const uint64_t *words = s->text->words;
+    uint64_t p0 = s->p_words[0], first_mask = s->first_mask;
+    uint64_t window = s->window;
+    long long i = s->i, end = n(s) - m(s);
+    uint64_t in = words[i / BASES_PER_WORD + 1] >> (2 * (i % BASES_PER_WORD));
+    for (; i <= end; i++)
+    {
+        if (((window ^ p0) & first_mask) == 0)
+        {
+            s->i = i;
+            if (packed_rest_eq(s) && packed_verify(s))
+            {
+                // next time, start from the next position
+                s->i = i + 1;
+                s->window = (window >> 2) | (in << 62);
+                return i;
+            }
+        }
+        window = (window >> 2) | (in << 62);
+        in = ((i + 1) % BASES_PER_WORD) ? in >> 2 : words[(i + 1) / BASES_PER_WORD + 1];
+    }
+    s->i = i;
+    return -1;
+}
+
+static void packed_free(struct packed_matcher_state *s)
+{
+    cstr_free_packed_dna_preproc(s->own);
+    free(s);
+}
+
+static bool is_packable(cstr_const_sslice p)
+{
+    bool packable = p.len > 0;
+    for (long long j = 0; packable && j < p.len; j++)
+    {
+        packable = is_base(p.buf[j]);
+    }
+    return packable;
+}
+
+static cstr_exact_matcher_vtab packed_vtab = {MATCHER_VTAB(packed_next, packed_free)};
+static struct packed_matcher_state *new_packed_matcher(cstr_packed_dna_preproc const *text,
+                                                       cstr_const_sslice p)
+{
+    long long no_p_words = no_packed_words(p.len);
+    struct packed_matcher_state *state =
+        CSTR_MALLOC_FLEX_ARRAY(state, p_words, (size_t)no_p_words);
+
+    bool verify_all = false;
+    for (long long j = 0; j < p.len; j++)
+    {
+        verify_all |= !is_upper_base(p.buf[j]);
+    }
+
+    long long last_bases = p.len - (no_p_words - 1) * BASES_PER_WORD;
+    uint64_t last_mask = (last_bases == BASES_PER_WORD) ? ~0ull : (1ull << (2 * last_bases)) - 1;
+    *state = (struct packed_matcher_state){
+        MATCHER(packed_vtab, text->x, p),
+        .text = text,
+        .own = NULL,
+        .verify_all = verify_all,
+        .i = 0,
+        .no_p_words = no_p_words,
+        .first_mask = (no_p_words == 1) ? last_mask : ~0ull,
+        .last_mask = last_mask};
+
+    pack_bases(state->p_words, p);
+    state->window = packed_window(text->words, 0);
+
+    return state;
+}
+
+cstr_exact_matcher *cstr_packed_dna_search(cstr_packed_dna_preproc const *preproc, cstr_const_sslice p)
+{
+    if (!is_packable(p))
+    {
+        return cstr_naive_matcher(preproc->x, p);
+    }
+    return (cstr_exact_matcher *)new_packed_matcher(preproc, p);
+}
+
+cstr_exact_matcher *cstr_packed_dna_matcher(cstr_const_sslice x, cstr_const_sslice p)
+{
+    if (!is_packable(p))
+    {
+        return cstr_naive_matcher(x, p);
+    }
+    cstr_packed_dna_preproc *text = cstr_packed_dna_preprocess(x);
+    struct packed_matcher_state *state = new_packed_matcher(text, p);
+    state->own = text;
+    return (cstr_exact_matcher *)state;
+}
+
+#undef BASES_PER_WORD
+
 // while these are only defined in this compilation unit, and will
 // go out of scope now anyway, I just get rid of them to clean up.
 // You never know what I might add below here later...
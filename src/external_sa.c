@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cstr.h"
+#include "sa_file_internal.h"
+#include "sais_internal.h"
+
+// Semi-external suffix array construction: the text stays in memory, but
+// the suffix array only goes to disk. The suffixes that start with the
+// same k-mer are contiguous in the suffix array, so we count the k-mers,
+// and then, for consecutive runs of k-mers that fit in the memory budget,
+// collect the suffixes that start with them, sort them, and append them
+// to the file. Each run costs a scan of the text, so there are about
+// 10n / ram_bytes scans, and all writes are sequential.
+//
+// Sorting the runs by comparing characters is quadratic on repeats, so we
+// compare suffixes with a difference cover sample (Kärkkäinen, Fast BWT in
+// small space by blockwise suffix sorting, 2007). We pick a set D of
+// residues modulo v such that for any i and j there is a delta < v that
+// puts both i + delta and j + delta in D. We rank the suffixes that start
+// at positions in D once, and then a comparison looks at no more than
+// delta characters before it can decide on the ranks at i + delta and
+// j + delta. A k-mer with more suffixes than fit in the budget, we split
+// into blocks of the smallest suffixes that are larger than the last one
+// we wrote.
+
+// The code of the k-mer that starts at i - k + 1 after we have added the
+// character at i. We pad x with sentinels.
+static inline long long roll(long long code, cstr_const_sslice x, long long sigma,
+                             long long i, long long kmers)
+{
+    long long a = i < x.len ? x.buf[i] : 0;
+    return (code * sigma) % kmers + a;
+}
+
+// As many k-mers as we can count within a quarter of the budget, but
+// no more than there are suffixes.
+static long long pick_k(long long n, long long sigma, size_t ram_bytes)
+{
+    long long max_kmers = (long long)(ram_bytes / 4 / sizeof(long long)) - 1;
+    max_kmers = max_kmers < n ? max_kmers : n;
+    long long k = 1;
+    if (sigma < 2)
+    {
+        return k;
+    }
+    for (long long kmers = sigma * sigma; kmers <= max_kmers; kmers *= sigma)
+    {
+        k++;
+    }
+    return k;
+}
+
+// MARK: Difference cover sample
+
+#define DCS_MIN_V 16
+#define DCS_MAX_V (1 << 16)
+#define NOT_IN_D UINT16_MAX
+
+struct dcs
+{
+    long long v, no_d;
+    uint16_t *d;     // the no_d residues in D, sorted
+    uint16_t *slot;  // slot[e] is e's index in d, or NOT_IN_D
+    uint16_t *cover; // cover[e] is an a in D with a + e in D (mod v)
+    unsigned int *rank;
+};
+
+// With r * r >= v, every difference e is (q * r) - s for some 0 <= s < r
+// and 0 <= q <= r, so the residues below r and the multiples of r (mod v)
+// cover them all, with about 2 sqrt(v) residues. Marks them in in_d and
+// returns how many there are.
+static long long mark_cover(bool *in_d, long long v)
+{
+    long long r = 1;
+    while (r * r < v)
+    {
+        r++;
+    }
+    for (long long e = 0; e < v; e++)
+    {
+        in_d[e] = e < r;
+    }
+    for (long long q = 1; q <= r; q++)
+    {
+        in_d[(q * r) % v] = true;
+    }
+    long long no_d = 0;
+    for (long long e = 0; e < v; e++)
+    {
+        no_d += in_d[e];
+    }
+    return no_d;
+}
+
+static long long dcs_size(long long v)
+{
+    bool *in_d = cstr_malloc_buffer(sizeof *in_d, (size_t)v);
+    long long no_d = mark_cover(in_d, v);
+    free(in_d);
+    return no_d;
+}
+
+// The slots we rank: every period of v has no_d of them.
+static long long dcs_slots(long long n, long long v, long long no_d)
+{
+    return (n + v - 1) / v * no_d;
+}
+
+static inline long long dcs_index(struct dcs const *dcs, long long p)
+{
+    return p / dcs->v * dcs->no_d + dcs->slot[p % dcs->v];
+}
+
+// Memory we need while we rank the sample, and what we keep afterwards:
+// the tables, the ranks, and, while we build them, the reduced string, its
+// suffix array, and the buckets SA-IS allocates for it.
+static long long dcs_build_bytes(long long n, long long v, long long no_d)
+{
+    long long m = dcs_slots(n, v, no_d) + 1;
+    return 2 * v * (long long)sizeof(uint16_t) + 7 * m * (long long)sizeof(unsigned int);
+}
+
+static long long dcs_kept_bytes(long long n, long long v, long long no_d)
+{
+    long long m = dcs_slots(n, v, no_d);
+    return (2 * v + no_d) * (long long)sizeof(uint16_t) + m * (long long)sizeof(unsigned int);
+}
+
+// The smallest period we can afford, where the ranks leave at least half
+// the budget for the blocks. Returns zero if there is none.
+static long long pick_v(long long n, size_t ram_bytes)
+{
+    for (long long v = DCS_MIN_V; v <= DCS_MAX_V; v *= 2)
+    {
+        long long no_d = dcs_size(v);
+        if (dcs_build_bytes(n, v, no_d) <= (long long)ram_bytes &&
+            dcs_kept_bytes(n, v, no_d) <= (long long)ram_bytes / 2)
+        {
+            return v;
+        }
+    }
+    return 0;
+}
+
+static bool equal_prefixes(cstr_const_sslice x, long long i, long long j, long long len)
+{
+    for (long long d = 0; d < len; d++)
+    {
+        uint8_t a = i + d < x.len ? x.buf[i + d] : 0;
+        uint8_t b = j + d < x.len ? x.buf[j + d] : 0;
+        if (a != b)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Ranks the suffixes at the sampled positions. The suffix at p is the
+// v-prefix at p followed by the suffix at p + v, which is sampled as well,
+// so we name the v-prefixes and sort the string we get by laying out the
+// names of each residue class in order. The last name in a class covers
+// the sentinel, and it is the only prefix with the sentinel at that offset,
+// so comparisons never run from one class into the next.
+static void init_dcs(struct dcs *dcs, cstr_const_sslice x, long long v)
+{
+    long long n = x.len;
+    bool *in_d = cstr_malloc_buffer(sizeof *in_d, (size_t)v);
+    dcs->v = v;
+    dcs->no_d = mark_cover(in_d, v);
+    dcs->d = cstr_malloc_buffer(sizeof *dcs->d, (size_t)dcs->no_d);
+    dcs->slot = cstr_malloc_buffer(sizeof *dcs->slot, (size_t)v);
+    dcs->cover = cstr_malloc_buffer(sizeof *dcs->cover, (size_t)v);
+    for (long long e = 0, a = 0; e < v; e++)
+    {
+        dcs->slot[e] = in_d[e] ? (uint16_t)a : NOT_IN_D;
+        if (in_d[e])
+        {
+            dcs->d[a++] = (uint16_t)e;
+        }
+        dcs->cover[e] = NOT_IN_D;
+    }
+    free(in_d);
+    for (long long a = 0; a < dcs->no_d; a++)
+    {
+        for (long long b = 0; b < dcs->no_d; b++)
+        {
+            dcs->cover[(dcs->d[b] - dcs->d[a] + v) % v] = dcs->d[a];
+        }
+    }
+    for (long long e = 0; e < v; e++)
+    {
+        assert(dcs->cover[e] != NOT_IN_D);
+    }
+
+    // The sampled positions, class by class, and where each class starts
+    long long no_d = dcs->no_d, m = 0;
+    long long *class_start = cstr_malloc_buffer(sizeof *class_start, (size_t)no_d + 1);
+    for (long long a = 0; a < no_d; a++)
+    {
+        class_start[a] = m;
+        m += dcs->d[a] < n ? (n - dcs->d[a] + v - 1) / v : 0;
+    }
+    class_start[no_d] = m;
+
+    cstr_uislice *pos = cstr_alloc_uislice(m);
+    for (long long a = 0; a < no_d; a++)
+    {
+        for (long long i = class_start[a]; i < class_start[a + 1]; i++)
+        {
+            pos->buf[i] = (unsigned int)((i - class_start[a]) * v + dcs->d[a]);
+        }
+    }
+    cstr_sort_prefixes(*pos, x, v);
+
+    cstr_uislice *u = cstr_alloc_uislice(m + 1);
+    unsigned int name = 0;
+    for (long long i = 0; i < m; i++)
+    {
+        long long p = pos->buf[i];
+        if (i == 0 || !equal_prefixes(x, pos->buf[i - 1], p, v))
+        {
+            name++;
+        }
+        u->buf[class_start[dcs->slot[p % v]] + p / v] = name;
+    }
+    u->buf[m] = 0;
+    free(pos);
+
+    cstr_suffix_array *sa_u = cstr_alloc_uislice(m + 1);
+    cstr_sais_reduced(*sa_u, *u, name + 1);
+    for (long long i = 1; i <= m; i++)
+    {
+        u->buf[sa_u->buf[i]] = (unsigned int)i;
+    }
+    free(sa_u);
+
+    dcs->rank = cstr_malloc_buffer(sizeof *dcs->rank, (size_t)dcs_slots(n, v, no_d));
+    for (long long a = 0; a < no_d; a++)
+    {
+        for (long long i = class_start[a]; i < class_start[a + 1]; i++)
+        {
+            long long p = (i - class_start[a]) * v + dcs->d[a];
+            dcs->rank[dcs_index(dcs, p)] = u->buf[i];
+        }
+    }
+    free(u);
+    free(class_start);
+}
+
+static void free_dcs(struct dcs *dcs)
+{
+    free(dcs->d);
+    free(dcs->slot);
+    free(dcs->cover);
+    free(dcs->rank);
+}
+
+// Is the suffix at i smaller than the one at j? The sentinel is unique, so
+// the suffixes differ before the shorter one ends, and if the first delta
+// characters match, i + delta and j + delta are in x.
+static bool dcs_less(struct dcs const *dcs, cstr_const_sslice x, long long i, long long j)
+{
+    long long v = dcs->v;
+    long long delta = (dcs->cover[(j % v - i % v + v) % v] - i % v + v) % v;
+    long long shorter = x.len - (i > j ? i : j);
+    int cmp = memcmp(x.buf + i, x.buf + j, (size_t)(delta < shorter ? delta : shorter));
+    if (cmp != 0)
+    {
+        return cmp < 0;
+    }
+    return dcs->rank[dcs_index(dcs, i + delta)] < dcs->rank[dcs_index(dcs, j + delta)];
+}
+
+// MARK: Blocks
+
+static inline void swap(unsigned int *a, long long i, long long j)
+{
+    unsigned int tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
+}
+
+// Partitions a[0, n) around the median of the first, middle and last
+// suffix, and returns where the pivot ends up. The suffixes are distinct,
+// so there are no ties.
+static long long partition(struct dcs const *dcs, cstr_const_sslice x,
+                           unsigned int *a, long long n)
+{
+    long long mid = n / 2;
+    if (dcs_less(dcs, x, a[mid], a[0]))
+    {
+        swap(a, mid, 0);
+    }
+    if (dcs_less(dcs, x, a[n - 1], a[mid]))
+    {
+        swap(a, n - 1, mid);
+        if (dcs_less(dcs, x, a[mid], a[0]))
+        {
+            swap(a, mid, 0);
+        }
+    }
+    swap(a, mid, n - 1);
+    long long lt = 0;
+    for (long long i = 0; i < n - 1; i++)
+    {
+        if (dcs_less(dcs, x, a[i], a[n - 1]))
+        {
+            swap(a, lt++, i);
+        }
+    }
+    swap(a, lt, n - 1);
+    return lt;
+}
+
+static void sort_suffixes(struct dcs const *dcs, cstr_const_sslice x,
+                          unsigned int *a, long long n)
+{
+    while (n > 2)
+    {
+        long long q = partition(dcs, x, a, n);
+        if (q < n - q - 1)
+        {
+            sort_suffixes(dcs, x, a, q);
+            a += q + 1;
+            n -= q + 1;
+        }
+        else
+        {
+            sort_suffixes(dcs, x, a + q + 1, n - q - 1);
+            n = q;
+        }
+    }
+    if (n == 2 && dcs_less(dcs, x, a[1], a[0]))
+    {
+        swap(a, 0, 1);
+    }
+}
+
+// Moves the k smallest suffixes in a[0, n) to a[0, k)
+static void select_smallest(struct dcs const *dcs, cstr_const_sslice x,
+                            unsigned int *a, long long n, long long k)
+{
+    while (n > 1 && 0 < k && k < n)
+    {
+        long long q = partition(dcs, x, a, n);
+        if (k <= q)
+        {
+            n = q;
+        }
+        else
+        {
+            a += q + 1;
+            n -= q + 1;
+            k -= q + 1;
+        }
+    }
+}
+
+static bool write_block(FILE *f, uint64_t *checksum, unsigned int const *buf, long long size)
+{
+    *checksum = cstr_file_checksum(*checksum, buf, (size_t)size * sizeof *buf);
+    return fwrite(buf, sizeof *buf, (size_t)size, f) == (size_t)size;
+}
+
+// Writes the suffixes that start with the k-mer code in blocks of at most
+// cap, each the smallest suffixes above the last we wrote. In a scan, we
+// collect the suffixes in buf, and whenever it fills up, we keep the
+// smaller half and, from then on, only suffixes below the smallest one we
+// dropped. That costs a few comparisons per suffix where a heap would
+// cost a logarithm of them, and we still write at least half of buf.
+static bool write_heavy_kmer(FILE *f, uint64_t *checksum, struct dcs const *dcs,
+                             cstr_const_sslice x, long long k, long long sigma, long long kmers,
+                             long long code, long long count, unsigned int *buf, long long cap)
+{
+    assert(cap >= 2);
+    long long n = x.len, last = -1;
+    for (long long left = count; left > 0;)
+    {
+        long long size = 0, bound = -1;
+        for (long long i = 0, c = 0; i < n + k - 1; i++)
+        {
+            c = roll(c, x, sigma, i, kmers);
+            long long p = i - k + 1;
+            if (i < k - 1 || c != code ||
+                (last >= 0 && !dcs_less(dcs, x, last, p)) ||
+                (bound >= 0 && !dcs_less(dcs, x, p, bound)))
+            {
+                continue;
+            }
+            buf[size++] = (unsigned int)p;
+            if (size == cap)
+            {
+                size = cap / 2;
+                select_smallest(dcs, x, buf, cap, size + 1);
+                select_smallest(dcs, x, buf, size + 1, size);
+                bound = buf[size];
+            }
+        }
+        assert(size > 0);
+        sort_suffixes(dcs, x, buf, size);
+        if (!write_block(f, checksum, buf, size))
+        {
+            return false;
+        }
+        last = buf[size - 1];
+        left -= size;
+    }
+    return true;
+}
+
+bool cstr_sa_external(const char *fname, cstr_const_sslice x,
+                      cstr_alphabet const *alpha, size_t ram_bytes)
+{
+    long long n = x.len, sigma = alpha->size;
+
+    // If the whole array fits, there is nothing to split
+    bool in_memory = n * (long long)sizeof(unsigned int) <= (long long)ram_bytes;
+    long long v = in_memory ? 0 : pick_v(n, ram_bytes);
+    if (!in_memory && v == 0)
+    {
+        return false;
+    }
+
+    FILE *f = fopen(fname, "wb");
+    if (!f)
+    {
+        return false;
+    }
+    bool ok = cstr_sa_file_begin(f, n, alpha);
+    uint64_t checksum = CSTR_FILE_CHECKSUM_INIT;
+
+    if (in_memory)
+    {
+        cstr_suffix_array *sa = cstr_alloc_uislice(n);
+        cstr_sacak(*sa, x, alpha);
+        ok = ok && write_block(f, &checksum, sa->buf, n);
+        ok = ok && cstr_sa_file_finish(f, n, alpha, checksum);
+        free(sa);
+        return (fclose(f) == 0) && ok;
+    }
+
+    struct dcs dcs;
+    init_dcs(&dcs, x, v);
+    long long left_bytes = (long long)ram_bytes - dcs_kept_bytes(n, v, dcs.no_d);
+
+    long long k = pick_k(n, sigma, (size_t)left_bytes);
+    long long kmers = 1;
+    for (long long i = 0; i < k; i++)
+    {
+        kmers *= sigma;
+    }
+    long long *count = cstr_malloc_buffer(sizeof *count, (size_t)kmers);
+    for (long long w = 0; w < kmers; w++)
+    {
+        count[w] = 0;
+    }
+    for (long long i = 0, code = 0; i < n + k - 1; i++)
+    {
+        code = roll(code, x, sigma, i, kmers);
+        if (i >= k - 1)
+        {
+            count[code]++;
+        }
+    }
+
+    // The rest of the budget goes to the positions we sort
+    long long table_bytes = kmers * (long long)sizeof *count;
+    long long cap = (left_bytes - table_bytes) / (long long)sizeof(unsigned int);
+    cap = cap < n ? cap : n;
+    unsigned int *buf = cstr_malloc_buffer(sizeof *buf, (size_t)cap);
+
+    for (long long lo = 0, hi = 0; ok && lo < kmers; lo = hi)
+    {
+        long long size = 0;
+        while (hi < kmers && size + count[hi] <= cap)
+        {
+            size += count[hi++];
+        }
+        if (size == 0 && hi < kmers)
+        {
+            ok = write_heavy_kmer(f, &checksum, &dcs, x, k, sigma, kmers,
+                                  hi, count[hi], buf, cap);
+            hi++;
+            continue;
+        }
+        if (size == 0)
+        {
+            continue;
+        }
+
+        long long j = 0;
+        for (long long i = 0, code = 0; i < n + k - 1; i++)
+        {
+            code = roll(code, x, sigma, i, kmers);
+            if (i >= k - 1 && lo <= code && code < hi)
+            {
+                buf[j++] = (unsigned int)(i - k + 1);
+            }
+        }
+        sort_suffixes(&dcs, x, buf, size);
+        ok = write_block(f, &checksum, buf, size);
+    }
+    ok = ok && cstr_sa_file_finish(f, n, alpha, checksum);
+
+    free(buf);
+    free(count);
+    free_dcs(&dcs);
+    return (fclose(f) == 0) && ok;
+}
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cstr.h"
+
+// We map the records' letters to 2, 3, ..., put a 1 after each record
+// and the sentinel, 0, at the very end, and build the suffix array of
+// that. The separators are all the same letter. SA-IS only needs the
+// sentinel to be unique, and since patterns never contain a separator,
+// no match can run from one record into the next, so we don't need a
+// different separator per record.
+#define SEPARATOR 1
+#define FIRST_LETTER 2
+
+struct cstr_gsa
+{
+    cstr_alphabet alpha; // the records' letters, before we add FIRST_LETTER
+    cstr_sslice *t;      // the mapped concatenation
+    cstr_suffix_array *sa;
+    long long k;
+    long long start[]; // where record r starts in t, with start[k] = |t| - 1
+};
+
+cstr_gsa *cstr_gsa_build(long long k, cstr_const_sslice const x[k])
+{
+    bool seen[CSTR_MAX_ALPHABET_SIZE] = {false};
+    long long n = 1; // the sentinel
+    for (long long r = 0; r < k; r++)
+    {
+        for (long long i = 0; i < x[r].len; i++)
+        {
+            seen[x[r].buf[i]] = true;
+        }
+        n += x[r].len + 1;
+    }
+
+    // The alphabet of all the records, from one of each letter
+    uint8_t letters[CSTR_MAX_ALPHABET_SIZE];
+    long long sigma = 0;
+    for (int a = 0; a < CSTR_MAX_ALPHABET_SIZE; a++)
+    {
+        if (seen[a])
+        {
+            letters[sigma++] = (uint8_t)a;
+        }
+    }
+    if (sigma + FIRST_LETTER > CSTR_MAX_ALPHABET_SIZE)
+    {
+        return 0;
+    }
+
+    cstr_gsa *gsa = CSTR_MALLOC_FLEX_ARRAY(gsa, start, (size_t)k + 1);
+    cstr_init_alphabet(&gsa->alpha, CSTR_SLICE((const uint8_t *)letters, sigma));
+    gsa->k = k;
+
+    gsa->t = cstr_alloc_sslice(n);
+    uint8_t *t = gsa->t->buf;
+    long long j = 0;
+    for (long long r = 0; r < k; r++)
+    {
+        gsa->start[r] = j;
+        for (long long i = 0; i < x[r].len; i++)
+        {
+            t[j++] = (uint8_t)(gsa->alpha.map[x[r].buf[i]] + FIRST_LETTER);
+        }
+        t[j++] = SEPARATOR;
+    }
+    gsa->start[k] = j;
+    t[j] = 0;
+
+    // t is already mapped to 0, 1, ..., sigma + 1, so its alphabet is
+    // the identity on those.
+    for (long long a = 0; a < sigma + FIRST_LETTER; a++)
+    {
+        letters[a] = (uint8_t)a;
+    }
+    cstr_alphabet t_alpha;
+    cstr_init_alphabet(&t_alpha, CSTR_SLICE((const uint8_t *)letters, sigma + FIRST_LETTER));
+    gsa->sa = cstr_alloc_uislice(n);
+    cstr_sais_sslice(*gsa->sa, CSTR_SLICE_CONST_CAST(*gsa->t), &t_alpha);
+
+    return gsa;
+}
+
+void cstr_free_gsa(cstr_gsa *gsa)
+{
+    free(gsa->t);
+    free(gsa->sa);
+    free(gsa);
+}
+
+long long cstr_gsa_records(cstr_gsa const *gsa)
+{
+    return gsa->k;
+}
+
+cstr_gsa_match cstr_gsa_locate(cstr_gsa const *gsa, long long pos)
+{
+    // The last record that starts at or before pos
+    long long lo = 0, hi = gsa->k;
+    while (hi - lo > 1)
+    {
+        long long m = lo + (hi - lo) / 2;
+        if (gsa->start[m] <= pos)
+        {
+            lo = m;
+        }
+        else
+        {
+            hi = m;
+        }
+    }
+    return (cstr_gsa_match){.record = lo, .pos = pos - gsa->start[lo]};
+}
+
+struct cstr_gsa_matcher
+{
+    cstr_gsa const *gsa;
+    long long next;
+    long long end;
+};
+
+cstr_gsa_matcher *cstr_gsa_search(cstr_gsa const *gsa, cstr_const_sslice p)
+{
+    cstr_gsa_matcher *m = cstr_malloc(sizeof *m);
+    m->gsa = gsa;
+    m->next = m->end = 0;
+
+    // The empty pattern is a prefix of every suffix, but the first k + 1
+    // in sa are the sentinel and the separators, which aren't positions
+    // in any record.
+    if (p.len == 0)
+    {
+        m->next = gsa->k + 1;
+        m->end = gsa->sa->len;
+        return m;
+    }
+
+    // If p has a letter that isn't in any record, it doesn't occur
+    cstr_sslice *p_buf = cstr_alloc_sslice(p.len);
+    if (cstr_alphabet_map(*p_buf, p, &gsa->alpha))
+    {
+        for (long long i = 0; i < p.len; i++)
+        {
+            p_buf->buf[i] = (uint8_t)(p_buf->buf[i] + FIRST_LETTER);
+        }
+        cstr_const_sslice q = CSTR_SLICE_CONST_CAST(*p_buf);
+        cstr_sa_interval iv;
+        cstr_sa_batch_search(*gsa->sa, CSTR_SLICE_CONST_CAST(*gsa->t), 1, &q, &iv);
+        m->next = iv.lo;
+        m->end = iv.hi;
+    }
+    free(p_buf);
+
+    return m;
+}
+
+cstr_gsa_match cstr_gsa_next_match(cstr_gsa_matcher *m)
+{
+    if (m->next == m->end)
+    {
+        return (cstr_gsa_match){.record = -1, .pos = -1};
+    }
+    return cstr_gsa_locate(m->gsa, m->gsa->sa->buf[m->next++]);
+}
+
+void cstr_free_gsa_matcher(cstr_gsa_matcher *m)
+{
+    free(m);
+}
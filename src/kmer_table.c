@@ -0,0 +1,129 @@
+#include <stdlib.h>
+
+#include "cstr.h"
+
+// The suffixes that start with the same k characters sit together in the
+// suffix array, so if we give each k-mer w a code, its rank among all the
+// k-mers, the interval for w is [start[w], start[w + 1]), where start[w]
+// counts the suffixes whose first k characters are smaller than w. We
+// don't need the suffix array for that, only the k-mer counts.
+//
+// The last k-1 suffixes are shorter than k, so we pad them with the
+// sentinel. That doesn't change their order, since the sentinel is
+// already in them and is unique, and patterns never contain it, so their
+// codes are never looked up.
+
+struct cstr_kmer_table
+{
+    cstr_alphabet alpha;
+    long long k;
+    long long sigma;
+    long long no_kmers; // sigma^k
+    unsigned int start[];
+};
+
+// The largest k such that the table fits in max_bytes. We don't go
+// beyond the number of suffixes either, since most k-mers would be
+// missing from x and the intervals would be empty.
+static long long pick_k(long long n, long long sigma, size_t max_bytes)
+{
+    long long max_kmers = (long long)(max_bytes / sizeof(unsigned int)) - 1;
+    max_kmers = max_kmers < n ? max_kmers : n;
+    long long k = 0;
+    if (sigma < 2)
+    {
+        return k;
+    }
+    for (long long kmers = sigma; kmers <= max_kmers; kmers *= sigma)
+    {
+        k++;
+    }
+    return k;
+}
+
+cstr_kmer_table *cstr_build_kmer_table(cstr_const_sslice x, cstr_alphabet const *alpha, size_t max_bytes)
+{
+    long long sigma = alpha->size;
+    long long k = pick_k(x.len, sigma, max_bytes);
+    long long no_kmers = 1;
+    for (long long i = 0; i < k; i++)
+    {
+        no_kmers *= sigma;
+    }
+
+    cstr_kmer_table *tab = CSTR_MALLOC_FLEX_ARRAY(tab, start, (size_t)no_kmers + 1);
+    tab->alpha = *alpha;
+    tab->k = k;
+    tab->sigma = sigma;
+    tab->no_kmers = no_kmers;
+
+    // Count the k-mers in start[w + 1], with a rolling code over a
+    // window that runs k-1 positions past the end of x (into the padding).
+    unsigned int *start = tab->start;
+    for (long long w = 0; w <= no_kmers; w++)
+    {
+        start[w] = 0;
+    }
+    if (k == 0)
+    {
+        start[1] = (unsigned int)x.len;
+    }
+    else
+    {
+        long long code = 0;
+        for (long long i = 0; i < x.len + k - 1; i++)
+        {
+            long long a = i < x.len ? alpha->map[x.buf[i]] : 0;
+            code = (code * sigma) % no_kmers + a;
+            if (i >= k - 1)
+            {
+                start[code + 1]++;
+            }
+        }
+    }
+    for (long long w = 1; w <= no_kmers; w++)
+    {
+        start[w] += start[w - 1];
+    }
+
+    return tab;
+}
+
+void cstr_free_kmer_table(cstr_kmer_table *tab)
+{
+    free(tab);
+}
+
+long long cstr_kmer_table_k(cstr_kmer_table const *tab)
+{
+    return tab->k;
+}
+
+long long cstr_kmer_table_lookup(cstr_kmer_table const *tab, cstr_const_sslice p,
+                                 long long *lo, long long *hi)
+{
+    long long depth = p.len < tab->k ? p.len : tab->k;
+    long long code = 0;
+    for (long long i = 0; i < depth; i++)
+    {
+        uint16_t a = tab->alpha.map[p.buf[i]];
+        if (a >= tab->sigma)
+        {
+            // Not in the alphabet, so p doesn't occur
+            *lo = *hi = 0;
+            return depth;
+        }
+        code = code * tab->sigma + a;
+    }
+
+    // With fewer than k characters, p covers all the k-mers that
+    // start with it, and they have consecutive codes.
+    long long span = 1;
+    for (long long i = depth; i < tab->k; i++)
+    {
+        span *= tab->sigma;
+    }
+    *lo = tab->start[code * span];
+    *hi = tab->start[(code + 1) * span];
+    return depth;
+}
@@ -0,0 +1,214 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "cstr.h"
+#include "parallel_internal.h"
+
+// LCP arrays from a suffix array. Both constructions compare the suffix at
+// position i in x with the suffix that precedes it in sa, and use that the
+// LCP for i+1 is at least the LCP for i minus one (Kasai et al. 2001), so
+// we never do more than 2n character comparisons in total.
+//
+// Kasai et al. go through x in text order using the inverse suffix array
+// to find where each suffix sits in sa, which costs 4n bytes on top of
+// the output. The PLCP/Phi construction (Kärkkäinen, Manzini and Puglisi
+// 2009) instead computes the LCP values in text order, the permuted LCP
+// array, in the lcp buffer itself and then moves them into sa order.
+// That costs a bit per suffix for keeping track of the permutation.
+
+static const unsigned int NO_PREV = UINT_MAX;
+
+// Length of the shared prefix of x[i:] and x[j:], knowing that it is at least h
+static inline unsigned int extend(cstr_const_sslice x, long long i, long long j, unsigned int h)
+{
+    while (i + h < x.len && j + h < x.len && x.buf[i + h] == x.buf[j + h])
+    {
+        h++;
+    }
+    return h;
+}
+
+void cstr_lcp_kasai(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x)
+{
+    long long n = x.len;
+    if (n == 0)
+    {
+        return;
+    }
+
+    unsigned int *isa = cstr_malloc_buffer(sizeof *isa, (size_t)n);
+    for (long long r = 0; r < n; r++)
+    {
+        isa[sa.buf[r]] = (unsigned int)r;
+    }
+
+    lcp.buf[0] = 0;
+    unsigned int h = 0;
+    for (long long i = 0; i < n; i++)
+    {
+        unsigned int r = isa[i];
+        if (r == 0)
+        {
+            h = 0;
+            continue;
+        }
+        h = extend(x, i, sa.buf[r - 1], h);
+        lcp.buf[r] = h;
+        if (h > 0)
+        {
+            h--;
+        }
+    }
+
+    free(isa);
+}
+
+// Rearrange plcp, in place, so plcp[r] becomes plcp[sa[r]]. The
+// permutation splits into cycles r -> sa[r] -> sa[sa[r]] -> ..., and
+// we follow each cycle once, using visited to recognise the ones
+// we have already handled.
+static void permute_to_sa_order(cstr_uislice plcp, cstr_suffix_array sa)
+{
+    cstr_bit_vector *visited = cstr_new_bv_init(sa.len);
+    for (long long start = 0; start < sa.len; start++)
+    {
+        if (cstr_bv_get(visited, start))
+        {
+            continue;
+        }
+        unsigned int first = plcp.buf[start];
+        long long r = start;
+        for (;;)
+        {
+            cstr_bv_set(visited, r, true);
+            long long next = sa.buf[r];
+            if (next == start)
+            {
+                plcp.buf[r] = first;
+                break;
+            }
+            plcp.buf[r] = plcp.buf[next];
+            r = next;
+        }
+    }
+    free(visited);
+}
+
+void cstr_lcp_phi(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x)
+{
+    long long n = x.len;
+    if (n == 0)
+    {
+        return;
+    }
+
+    // phi[i] is the suffix that precedes i in sa. We put it in lcp and
+    // replace it with plcp[i] = lcp(x[i:], x[phi[i]:]) as we go.
+    unsigned int *phi = lcp.buf;
+    phi[sa.buf[0]] = NO_PREV;
+    for (long long r = 1; r < n; r++)
+    {
+        phi[sa.buf[r]] = sa.buf[r - 1];
+    }
+
+    unsigned int h = 0;
+    for (long long i = 0; i < n; i++)
+    {
+        if (phi[i] == NO_PREV)
+        {
+            phi[i] = h = 0;
+            continue;
+        }
+        h = extend(x, i, phi[i], h);
+        phi[i] = h;
+        if (h > 0)
+        {
+            h--;
+        }
+    }
+
+    permute_to_sa_order(lcp, sa);
+}
+
+// The parallel Phi algorithm computes phi and then plcp in a separate
+// array, so the threads can fill in phi in sa order and gather the LCP
+// values in sa order at the end, where the sequential version permutes
+// in place. Each thread computes plcp for a range of x. It starts from
+// h = 0, which costs it at most the LCP at the start of the range in
+// extra comparisons.
+struct par_phi_ctx
+{
+    cstr_uislice lcp;
+    cstr_suffix_array sa;
+    cstr_const_sslice x;
+    unsigned int *plcp;
+};
+
+static void phi_range(struct par_phi_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->sa.len, t, no_threads, 1, &from, &to);
+    for (long long r = from; r < to; r++)
+    {
+        ctx->plcp[ctx->sa.buf[r]] = r > 0 ? ctx->sa.buf[r - 1] : NO_PREV;
+    }
+}
+
+static void plcp_range(struct par_phi_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->x.len, t, no_threads, 1, &from, &to);
+    unsigned int *phi = ctx->plcp;
+    unsigned int h = 0;
+    for (long long i = from; i < to; i++)
+    {
+        if (phi[i] == NO_PREV)
+        {
+            phi[i] = h = 0;
+            continue;
+        }
+        h = extend(ctx->x, i, phi[i], h);
+        phi[i] = h;
+        if (h > 0)
+        {
+            h--;
+        }
+    }
+}
+
+static void gather_range(struct par_phi_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->sa.len, t, no_threads, 1, &from, &to);
+    for (long long r = from; r < to; r++)
+    {
+        ctx->lcp.buf[r] = ctx->plcp[ctx->sa.buf[r]];
+    }
+}
+
+void cstr_lcp_phi_parallel(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x,
+                           int no_threads)
+{
+    if (no_threads <= 1 || x.len == 0)
+    {
+        cstr_lcp_phi(lcp, sa, x);
+        return;
+    }
+
+    struct par_phi_ctx ctx = {
+        .lcp = lcp, .sa = sa, .x = x,
+        .plcp = cstr_malloc_buffer(sizeof *ctx.plcp, (size_t)x.len)};
+    cstr_par_pool *pool = cstr_new_par_pool(no_threads);
+    cstr_par_run(pool, (cstr_par_fn)phi_range, &ctx);
+    cstr_par_run(pool, (cstr_par_fn)plcp_range, &ctx);
+    cstr_par_run(pool, (cstr_par_fn)gather_range, &ctx);
+    cstr_free_par_pool(pool);
+    free(ctx.plcp);
+}
+
+void cstr_sais_lcp(cstr_suffix_array sa, cstr_uislice lcp,
+                   cstr_const_sslice x, cstr_alphabet *alpha)
+{
+    cstr_sais_sslice(sa, x, alpha);
+    cstr_lcp_phi(lcp, sa, x);
+}
@@ -31,11 +31,7 @@ cstr_li_durbin_preprocess(cstr_const_sslice x)
 
     cstr_init_alphabet(&preproc->alpha, x);
 
-    // Map the string into an integer slice so we can build the suffix array.
-    cstr_uislice *u_buf = cstr_alloc_uislice(x.len);
-    cstr_alphabet_map_to_uint(*u_buf, x, &preproc->alpha);
-    cstr_const_uislice u = CSTR_SLICE_CONST_CAST(*u_buf);
-
+    // We build the suffix arrays straight from the mapped bytes in w
     cstr_sslice *w_buf = cstr_alloc_sslice(x.len); // Mapping x into w
     cstr_alphabet_map(*w_buf, x, &preproc->alpha);
     cstr_const_sslice w = CSTR_SLICE_CONST_CAST(*w_buf);
@@ -50,20 +46,19 @@ cstr_li_durbin_preprocess(cstr_const_sslice x)
     // the forward one, but not the backward one.
     // The PREFIX stuff is so we only reverse the prefix up to the sentinel,
     // but we do not include the sentinel in the reversal.
-    CSTR_REV_SLICE(CSTR_PREFIX(*u_buf, -1)); // Both of these are representations of the input string.
-    CSTR_REV_SLICE(CSTR_PREFIX(*w_buf, -1)); // Just with different types. We reverse to build RO
+    CSTR_REV_SLICE(CSTR_PREFIX(*w_buf, -1)); // We reverse to build RO
 
-    cstr_sais(*preproc->sa, u, &preproc->alpha);
+    cstr_sais_sslice(*preproc->sa, w, &preproc->alpha);
     cstr_bwt(*bwt_buf, w, *preproc->sa);
     preproc->ctab = cstr_build_c_table(bwt, preproc->alpha.size);
     preproc->rotab = cstr_build_o_table(bwt, preproc->ctab);
 
     // The C table is the same in either direction, but we need
     // to rebuild the suffix array and BWT to get the O table
-    CSTR_REV_SLICE(CSTR_PREFIX(*u_buf, -1)); // Reverse the input back to the forward direction
-    CSTR_REV_SLICE(CSTR_PREFIX(*w_buf, -1)); // so we can build the forward BWT and O table
+    CSTR_REV_SLICE(CSTR_PREFIX(*w_buf, -1)); // Reverse the input back to the forward direction
+                                             // so we can build the forward BWT and O table
 
-    cstr_sais(*preproc->sa, u, &preproc->alpha);
+    cstr_sais_sslice(*preproc->sa, w, &preproc->alpha);
     cstr_bwt(*bwt_buf, w, *preproc->sa);
     preproc->otab = cstr_build_o_table(bwt, preproc->ctab);
 
@@ -71,7 +66,6 @@ cstr_li_durbin_preprocess(cstr_const_sslice x)
     // The information we need is all in the tables in preproc.
     free(bwt_buf);
     free(w_buf);
-    free(u_buf);
 
     return preproc;
 }
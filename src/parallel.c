@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "parallel_internal.h"
+
+struct worker
+{
+    cstr_par_pool *pool;
+    int id;
+    thrd_t thread;
+};
+
+struct cstr_par_pool
+{
+    int no_threads;
+    mtx_t lock;
+    cnd_t start; // signalled when there is a new job
+    cnd_t done;  // signalled when the last worker finishes a job
+
+    // The current job. Workers know there is a new one when the
+    // generation changes.
+    cstr_par_fn fn;
+    void *ctx;
+    unsigned long long generation;
+    int running; // workers still on the current job
+    bool quit;
+
+    struct worker workers[]; // no_threads - 1 of them
+};
+
+// Thread errors are as fatal as allocation errors to us
+static void check_thrd(int res)
+{
+    if (res != thrd_success)
+    {
+        fprintf(stderr, "Thread error, terminating\n");
+        exit(2);
+    }
+}
+
+static int worker_main(void *arg)
+{
+    struct worker *w = arg;
+    cstr_par_pool *pool = w->pool;
+    unsigned long long seen = 0;
+
+    for (;;)
+    {
+        check_thrd(mtx_lock(&pool->lock));
+        while (pool->generation == seen && !pool->quit)
+        {
+            check_thrd(cnd_wait(&pool->start, &pool->lock));
+        }
+        if (pool->quit)
+        {
+            check_thrd(mtx_unlock(&pool->lock));
+            return 0;
+        }
+        seen = pool->generation;
+        cstr_par_fn fn = pool->fn;
+        void *ctx = pool->ctx;
+        check_thrd(mtx_unlock(&pool->lock));
+
+        fn(ctx, w->id, pool->no_threads);
+
+        check_thrd(mtx_lock(&pool->lock));
+        if (--pool->running == 0)
+        {
+            check_thrd(cnd_signal(&pool->done));
+        }
+        check_thrd(mtx_unlock(&pool->lock));
+    }
+}
+
+cstr_par_pool *cstr_new_par_pool(int no_threads)
+{
+    no_threads = no_threads > 0 ? no_threads : 1;
+    cstr_par_pool *pool = CSTR_MALLOC_FLEX_ARRAY(pool, workers, (size_t)(no_threads - 1));
+    pool->no_threads = no_threads;
+    pool->fn = 0;
+    pool->ctx = 0;
+    pool->generation = 0;
+    pool->running = 0;
+    pool->quit = false;
+    check_thrd(mtx_init(&pool->lock, mtx_plain));
+    check_thrd(cnd_init(&pool->start));
+    check_thrd(cnd_init(&pool->done));
+
+    for (int t = 1; t < no_threads; t++)
+    {
+        struct worker *w = &pool->workers[t - 1];
+        w->pool = pool;
+        w->id = t;
+        check_thrd(thrd_create(&w->thread, worker_main, w));
+    }
+
+    return pool;
+}
+
+void cstr_free_par_pool(cstr_par_pool *pool)
+{
+    check_thrd(mtx_lock(&pool->lock));
+    pool->quit = true;
+    check_thrd(cnd_broadcast(&pool->start));
+    check_thrd(mtx_unlock(&pool->lock));
+
+    for (int t = 1; t < pool->no_threads; t++)
+    {
+        check_thrd(thrd_join(pool->workers[t - 1].thread, 0));
+    }
+
+    cnd_destroy(&pool->start);
+    cnd_destroy(&pool->done);
+    mtx_destroy(&pool->lock);
+    free(pool);
+}
+
+int cstr_par_no_threads(cstr_par_pool const *pool)
+{
+    return pool->no_threads;
+}
+
+void cstr_par_run(cstr_par_pool *pool, cstr_par_fn fn, void *ctx)
+{
+    if (pool->no_threads == 1)
+    {
+        fn(ctx, 0, 1);
+        return;
+    }
+
+    check_thrd(mtx_lock(&pool->lock));
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->running = pool->no_threads - 1;
+    pool->generation++;
+    check_thrd(cnd_broadcast(&pool->start));
+    check_thrd(mtx_unlock(&pool->lock));
+
+    fn(ctx, 0, pool->no_threads);
+
+    check_thrd(mtx_lock(&pool->lock));
+    while (pool->running > 0)
+    {
+        check_thrd(cnd_wait(&pool->done, &pool->lock));
+    }
+    check_thrd(mtx_unlock(&pool->lock));
+}
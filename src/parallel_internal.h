@@ -0,0 +1,33 @@
+#ifndef PARALLEL_INTERNAL_H
+#define PARALLEL_INTERNAL_H
+
+#include "cstr.h"
+
+// A fixed set of worker threads that we can hand the same function
+// to over and over, without paying for creating threads each time.
+// The calling thread works as thread zero, so a pool of one thread
+// has no workers and just calls the function.
+typedef void (*cstr_par_fn)(void *ctx, int thread, int no_threads);
+typedef struct cstr_par_pool cstr_par_pool;
+
+cstr_par_pool *cstr_new_par_pool(int no_threads);
+void cstr_free_par_pool(cstr_par_pool *pool);
+int cstr_par_no_threads(cstr_par_pool const *pool);
+
+// Runs fn(ctx, t, no_threads) for t = 0, ..., no_threads - 1, and returns
+// when all of them are done. It works as a barrier between calls.
+void cstr_par_run(cstr_par_pool *pool, cstr_par_fn fn, void *ctx);
+
+// The part [*from, *to) of [0, n) that thread t should handle. The
+// boundaries are multiples of align, so threads don't share words
+// when align is the number of bits in a bit-vector word.
+static inline void cstr_par_range(long long n, int t, int no_threads, long long align,
+                                  long long *from, long long *to)
+{
+    long long chunk = (n + no_threads - 1) / no_threads;
+    chunk = (chunk + align - 1) / align * align;
+    *from = t * chunk < n ? t * chunk : n;
+    *to = *from + chunk < n ? *from + chunk : n;
+}
+
+#endif // PARALLEL_INTERNAL_H
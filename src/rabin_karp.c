@@ -0,0 +1,177 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cstr.h"
+
+// Rabin-Karp for a batch of patterns that all have the same length m.
+// We put the hashes of all the patterns in an open-addressing hash table
+// and then slide a single window of length m over the text. Whenever the
+// window's hash hits a slot with the same hash we verify the candidate
+// with a direct comparison, so hash collisions can never give us false
+// matches.
+
+// Polynomial rolling hash. We do all arithmetic modulo 2^64 (i.e., we just
+// let the unsigned integers overflow), and with an odd base the hash is
+// good enough for a filter, since we verify all candidates anyway.
+static const uint64_t HASH_BASE = 0x100000001b3ull;
+
+// Multiplier for Fibonacci hashing; we use it to get a slot from the
+// high bits of the polynomial hash, which are better mixed than the low bits.
+static const uint64_t SLOT_MULT = 0x9e3779b97f4a7c15ull;
+
+static inline uint64_t hash_slice(cstr_const_sslice x)
+{
+    uint64_t h = 0;
+    for (long long i = 0; i < x.len; i++)
+    {
+        h = h * HASH_BASE + x.buf[i];
+    }
+    return h;
+}
+
+// The table is a flat array of slots. We keep the hash in the slot, so
+// we only touch the pattern when the full hash matches. An empty slot
+// has pattern == -1.
+struct slot
+{
+    uint64_t hash;
+    long long pattern;
+};
+
+struct cstr_rk_preproc
+{
+    long long m;          // length of all the patterns
+    uint64_t top;         // HASH_BASE^(m-1), for removing the first char in a window
+    int bits;             // the table has 2^bits slots
+    uint64_t mask;        // 2^bits - 1
+    struct slot *table;   // the hash table
+    long long k;          // number of patterns
+    cstr_const_sslice p[]; // the patterns themselves
+};
+
+static inline uint64_t home_slot(cstr_rk_preproc const *preproc, uint64_t h)
+{
+    return (h * SLOT_MULT) >> (64 - preproc->bits);
+}
+
+cstr_rk_preproc *cstr_rk_preprocess(long long k, cstr_const_sslice const p[k])
+{
+    cstr_rk_preproc *preproc = CSTR_MALLOC_FLEX_ARRAY(preproc, p, (size_t)k);
+    preproc->k = k;
+    preproc->m = (k > 0) ? p[0].len : 0;
+
+    // Keep the load factor at or below 1/2 so probe sequences stay short.
+    // We need at least two bits for the shift in home_slot to be well-defined.
+    preproc->bits = 2;
+    while ((1ll << preproc->bits) < 2 * k)
+    {
+        preproc->bits++;
+    }
+    preproc->mask = (1ull << preproc->bits) - 1;
+    preproc->table = cstr_malloc_buffer(sizeof *preproc->table, (size_t)preproc->mask + 1);
+    for (uint64_t s = 0; s <= preproc->mask; s++)
+    {
+        preproc->table[s] = (struct slot){.hash = 0, .pattern = -1};
+    }
+
+    preproc->top = 1;
+    for (long long i = 1; i < preproc->m; i++)
+    {
+        preproc->top *= HASH_BASE;
+    }
+
+    for (long long i = 0; i < k; i++)
+    {
+        // The window only makes sense if all patterns have the same length
+        assert(p[i].len == preproc->m);
+        preproc->p[i] = p[i];
+
+        // Duplicated patterns get separate slots, so each is reported
+        uint64_t h = hash_slice(p[i]);
+        uint64_t s = home_slot(preproc, h);
+        while (preproc->table[s].pattern != -1)
+        {
+            s = (s + 1) & preproc->mask;
+        }
+        preproc->table[s] = (struct slot){.hash = h, .pattern = i};
+    }
+
+    return preproc;
+}
+
+void cstr_free_rk_preproc(cstr_rk_preproc *preproc)
+{
+    free(preproc->table);
+    free(preproc);
+}
+
+// The matcher remembers the window start, its hash, and how far we got in
+// the probe sequence for that window, so we can continue from there when
+// we are asked for the next match.
+struct cstr_multi_matcher
+{
+    cstr_rk_preproc *preproc;
+    cstr_const_sslice x;
+    long long i;  // start of current window
+    uint64_t h;   // hash of current window
+    uint64_t s;   // next slot to probe for the current window
+};
+
+cstr_multi_matcher *cstr_rk_search(cstr_rk_preproc *preproc, cstr_const_sslice x)
+{
+    cstr_multi_matcher *m = cstr_malloc(sizeof *m);
+    m->preproc = preproc;
+    m->x = x;
+    m->i = 0;
+    m->h = 0;
+    m->s = 0;
+
+    if (preproc->k == 0 || preproc->m == 0 || preproc->m > x.len)
+    {
+        // No windows to look at, so put us past the last one.
+        m->i = x.len;
+        return m;
+    }
+
+    m->h = hash_slice(CSTR_PREFIX(x, preproc->m));
+    m->s = home_slot(preproc, m->h);
+    return m;
+}
+
+cstr_multi_match cstr_multi_next_match(cstr_multi_matcher *m)
+{
+    cstr_rk_preproc const *preproc = m->preproc;
+    const uint8_t *x = m->x.buf;
+    long long n = m->x.len, len = preproc->m;
+
+    while (m->i + len <= n)
+    {
+        cstr_const_sslice window = CSTR_SLICE(x + m->i, len);
+        for (; preproc->table[m->s].pattern != -1; m->s = (m->s + 1) & preproc->mask)
+        {
+            struct slot slot = preproc->table[m->s];
+            if (slot.hash == m->h && cstr_eq_const_sslice(window, preproc->p[slot.pattern]))
+            {
+                // Next time, we continue probing after this slot
+                m->s = (m->s + 1) & preproc->mask;
+                return (cstr_multi_match){.pattern = slot.pattern, .pos = m->i};
+            }
+        }
+
+        // Slide the window one to the right
+        if (m->i + len < n)
+        {
+            m->h = (m->h - x[m->i] * preproc->top) * HASH_BASE + x[m->i + len];
+            m->s = home_slot(preproc, m->h);
+        }
+        m->i++;
+    }
+
+    return (cstr_multi_match){.pattern = -1, .pos = -1};
+}
+
+void cstr_free_multi_matcher(cstr_multi_matcher *matcher)
+{
+    free(matcher);
+}
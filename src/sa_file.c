@@ -0,0 +1,255 @@
+// We build with C_EXTENSIONS off, so we must ask for POSIX to get mmap.
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "cstr.h"
+#include "sa_file_internal.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The file is a fixed-size header followed by the suffix array as
+// unsigned ints in the writer's byte order. The payload starts at a page
+// boundary, so when we map the file, the suffix array is aligned and we can
+// use it where it is. We don't convert between byte orders or int sizes;
+// a file from a different machine is rejected, not translated.
+#define SA_FILE_MAGIC "CSTR-SA"
+#define SA_FILE_VERSION 1
+#define SA_FILE_BYTE_ORDER 0x01020304U
+#define SA_FILE_PAYLOAD_OFFSET 4096
+
+struct sa_file_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // SA_FILE_BYTE_ORDER as the writer stored it
+    uint32_t elem_size;  // sizeof(unsigned int) on the writer
+    uint32_t alpha_size;
+    uint64_t n;
+    uint64_t payload_offset;
+    uint64_t checksum; // of the payload, see cstr_file_checksum
+    uint16_t map[CSTR_MAX_ALPHABET_SIZE];
+    uint16_t revmap[CSTR_MAX_ALPHABET_SIZE];
+};
+static_assert(sizeof(struct sa_file_header) <= SA_FILE_PAYLOAD_OFFSET, "Header must fit before the payload");
+
+#define FNV_PRIME 0x100000001b3ULL
+
+uint64_t cstr_file_checksum(uint64_t h, void const *buf, size_t size)
+{
+    unsigned char const *bytes = buf;
+    size_t i = 0;
+    for (; i + sizeof(unsigned int) <= size; i += sizeof(unsigned int))
+    {
+        unsigned int word;
+        memcpy(&word, bytes + i, sizeof word);
+        h = (h ^ word) * FNV_PRIME;
+    }
+    for (; i < size; i++)
+    {
+        h = (h ^ bytes[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+// MARK: Writing
+
+static void fill_header(struct sa_file_header *hdr, long long n,
+                        cstr_alphabet const *alpha, uint64_t checksum)
+{
+    memset(hdr, 0, sizeof *hdr);
+    memcpy(hdr->magic, SA_FILE_MAGIC, sizeof hdr->magic);
+    hdr->version = SA_FILE_VERSION;
+    hdr->byte_order = SA_FILE_BYTE_ORDER;
+    hdr->elem_size = sizeof(unsigned int);
+    hdr->n = (uint64_t)n;
+    hdr->payload_offset = SA_FILE_PAYLOAD_OFFSET;
+    hdr->checksum = checksum;
+    if (alpha)
+    {
+        hdr->alpha_size = alpha->size;
+        memcpy(hdr->map, alpha->map, sizeof hdr->map);
+        memcpy(hdr->revmap, alpha->revmap, sizeof hdr->revmap);
+    }
+}
+
+static bool write_header(FILE *f, long long n, cstr_alphabet const *alpha, uint64_t checksum)
+{
+    struct sa_file_header hdr;
+    fill_header(&hdr, n, alpha, checksum);
+    static const char padding[SA_FILE_PAYLOAD_OFFSET - sizeof hdr] = {0};
+    return fwrite(&hdr, sizeof hdr, 1, f) == 1 &&
+           fwrite(padding, sizeof padding, 1, f) == 1;
+}
+
+bool cstr_sa_file_begin(FILE *f, long long n, cstr_alphabet const *alpha)
+{
+    return write_header(f, n, alpha, 0);
+}
+
+bool cstr_sa_file_finish(FILE *f, long long n, cstr_alphabet const *alpha, uint64_t checksum)
+{
+    return fseek(f, 0, SEEK_SET) == 0 && write_header(f, n, alpha, checksum);
+}
+
+bool cstr_write_sa(const char *fname, cstr_suffix_array sa, cstr_alphabet const *alpha)
+{
+    FILE *f = fopen(fname, "wb");
+    if (!f)
+    {
+        return false;
+    }
+    uint64_t checksum = cstr_file_checksum(CSTR_FILE_CHECKSUM_INIT, sa.buf, (size_t)sa.len * sizeof *sa.buf);
+    bool ok = write_header(f, sa.len, alpha, checksum) &&
+              fwrite(sa.buf, sizeof *sa.buf, (size_t)sa.len, f) == (size_t)sa.len;
+    return (fclose(f) == 0) && ok;
+}
+
+// MARK: Mapping files
+
+#ifdef HAVE_SYS_MMAN_H
+// We map the pages private and writable, so the view is plain memory,
+// but writing to it only changes our copy of a page.
+bool cstr_open_file_view(cstr_file_view *view, const char *fname)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    view->size = (size_t)st.st_size;
+    view->data = mmap(0, view->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    return view->data != MAP_FAILED;
+}
+
+void cstr_close_file_view(cstr_file_view *view)
+{
+    munmap(view->data, view->size);
+}
+#else
+// Without mmap we read the whole file into memory. It costs the read, but
+// malloc'ed memory is aligned well enough for the payload.
+bool cstr_open_file_view(cstr_file_view *view, const char *fname)
+{
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    long size;
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) != 0)
+    {
+        fclose(f);
+        return false;
+    }
+    view->size = (size_t)size;
+    view->data = cstr_malloc(view->size);
+    bool ok = fread(view->data, 1, view->size, f) == view->size;
+    fclose(f);
+    if (!ok)
+    {
+        free(view->data);
+    }
+    return ok;
+}
+
+void cstr_close_file_view(cstr_file_view *view)
+{
+    free(view->data);
+}
+#endif
+
+// MARK: Loading
+
+struct cstr_sa_file
+{
+    cstr_file_view view; // the whole file
+    bool has_alpha;
+    cstr_alphabet alpha;
+    cstr_suffix_array sa;
+};
+
+static bool valid_header(struct sa_file_header const *hdr, size_t size)
+{
+    if (memcmp(hdr->magic, SA_FILE_MAGIC, sizeof hdr->magic) != 0 ||
+        hdr->version != SA_FILE_VERSION ||
+        hdr->byte_order != SA_FILE_BYTE_ORDER ||
+        hdr->elem_size != sizeof(unsigned int) ||
+        hdr->payload_offset != SA_FILE_PAYLOAD_OFFSET ||
+        hdr->alpha_size > CSTR_MAX_ALPHABET_SIZE ||
+        hdr->n > (uint64_t)LLONG_MAX / sizeof(unsigned int))
+    {
+        return false;
+    }
+    return size - hdr->payload_offset == hdr->n * sizeof(unsigned int);
+}
+
+cstr_sa_file *cstr_load_sa(const char *fname, bool verify)
+{
+    cstr_sa_file *file = cstr_malloc(sizeof *file);
+    if (!cstr_open_file_view(&file->view, fname))
+    {
+        free(file);
+        return 0;
+    }
+
+    struct sa_file_header hdr;
+    if (file->view.size < SA_FILE_PAYLOAD_OFFSET)
+    {
+        goto error;
+    }
+    memcpy(&hdr, file->view.data, sizeof hdr);
+    if (!valid_header(&hdr, file->view.size))
+    {
+        goto error;
+    }
+
+    unsigned int *payload = (unsigned int *)((char *)file->view.data + hdr.payload_offset);
+    file->sa = CSTR_SLICE(payload, (long long)hdr.n);
+    if (verify && cstr_file_checksum(CSTR_FILE_CHECKSUM_INIT, file->sa.buf, (size_t)file->sa.len * sizeof *file->sa.buf) != hdr.checksum)
+    {
+        goto error;
+    }
+
+    file->has_alpha = hdr.alpha_size > 0;
+    file->alpha.size = hdr.alpha_size;
+    memcpy(file->alpha.map, hdr.map, sizeof hdr.map);
+    memcpy(file->alpha.revmap, hdr.revmap, sizeof hdr.revmap);
+    return file;
+
+error:
+    cstr_close_file_view(&file->view);
+    free(file);
+    return 0;
+}
+
+cstr_suffix_array cstr_sa_file_sa(cstr_sa_file const *file)
+{
+    return file->sa;
+}
+
+cstr_alphabet const *cstr_sa_file_alphabet(cstr_sa_file const *file)
+{
+    return file->has_alpha ? &file->alpha : 0;
+}
+
+void cstr_free_sa_file(cstr_sa_file *file)
+{
+    cstr_close_file_view(&file->view);
+    free(file);
+}
@@ -0,0 +1,32 @@
+#ifndef SA_FILE_INTERNAL_H
+#define SA_FILE_INTERNAL_H
+
+#include "cstr.h"
+
+// The checksum in suffix array and suffix tree files: FNV-1a over whole
+// unsigned ints, then over the bytes left after the last of them. It is
+// a checksum against truncated and damaged files, not against tampering.
+// Start from CSTR_FILE_CHECKSUM_INIT and fold in the data a piece at a
+// time; size is in bytes.
+#define CSTR_FILE_CHECKSUM_INIT 0xcbf29ce484222325ULL
+uint64_t cstr_file_checksum(uint64_t h, void const *buf, size_t size);
+
+// For writers that produce the suffix array a block at a time, like the
+// semi-external construction. Begin writes a placeholder header and
+// leaves f at the payload; fold each block into the checksum as you write
+// it; finish rewrites the header with the checksum. Both return false if
+// the writes fail.
+bool cstr_sa_file_begin(FILE *f, long long n, cstr_alphabet const *alpha);
+bool cstr_sa_file_finish(FILE *f, long long n, cstr_alphabet const *alpha, uint64_t checksum);
+
+// The whole of a file in memory, mapped if we have mmap and read if we
+// don't. Suffix array and suffix tree files both load this way.
+typedef struct cstr_file_view
+{
+    void *data;
+    size_t size;
+} cstr_file_view;
+bool cstr_open_file_view(cstr_file_view *view, const char *fname);
+void cstr_close_file_view(cstr_file_view *view);
+
+#endif // SA_FILE_INTERNAL_H
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+
+#include "cstr.h"
+
+// Checking a suffix array without sorting it again (Burkhardt and
+// Kärkkäinen 2003). If sa is a permutation, it is the suffix array if and
+// only if each pair of neighbours, i = sa[r-1] and j = sa[r], are in order:
+// either x[i] < x[j], or x[i] == x[j] and suffix i+1 comes before suffix
+// j+1 in sa. The second condition only needs the rank of i+1 and j+1,
+// so with the inverse suffix array the check is linear.
+
+// The inverse suffix array, or NULL if sa isn't a permutation of 0..n-1.
+static unsigned int *inverse(cstr_suffix_array sa)
+{
+    long long n = sa.len;
+    unsigned int *isa = cstr_malloc_buffer(sizeof *isa, (size_t)n);
+    for (long long i = 0; i < n; i++)
+    {
+        isa[i] = (unsigned int)n; // Not seen yet
+    }
+    for (long long r = 0; r < n; r++)
+    {
+        unsigned int i = sa.buf[r];
+        if (i >= n || isa[i] != n)
+        {
+            free(isa);
+            return 0;
+        }
+        isa[i] = (unsigned int)r;
+    }
+    return isa;
+}
+
+// The rank of suffix i, where the empty suffix at n comes before all others
+static inline long long rank(unsigned int const *isa, long long n, long long i)
+{
+    return i < n ? (long long)isa[i] : -1;
+}
+
+bool cstr_sa_verify(cstr_suffix_array sa, cstr_const_sslice x)
+{
+    long long n = x.len;
+    if (sa.len != n)
+    {
+        return false;
+    }
+    if (n == 0)
+    {
+        return true;
+    }
+
+    unsigned int *isa = inverse(sa);
+    if (!isa)
+    {
+        return false;
+    }
+    bool ok = true;
+    for (long long r = 1; ok && r < n; r++)
+    {
+        long long i = sa.buf[r - 1], j = sa.buf[r];
+        ok = x.buf[i] < x.buf[j] ||
+             (x.buf[i] == x.buf[j] && rank(isa, n, i + 1) < rank(isa, n, j + 1));
+    }
+    free(isa);
+    return ok;
+}
+
+// Suffix i comes strictly before suffix j
+static bool suffix_less(cstr_const_sslice x, long long i, long long j)
+{
+    long long l = cstr_lcp_const_sslice(CSTR_SUFFIX(x, i), CSTR_SUFFIX(x, j));
+    if (i + l == x.len)
+    {
+        return j + l < x.len; // A proper prefix comes first
+    }
+    return j + l < x.len && x.buf[i + l] < x.buf[j + l];
+}
+
+bool cstr_sa_verify_sampled(cstr_suffix_array sa, cstr_const_sslice x, long long samples)
+{
+    long long n = x.len;
+    if (sa.len != n)
+    {
+        return false;
+    }
+    if (n < 2)
+    {
+        return n == 0 || sa.buf[0] == 0;
+    }
+
+    samples = samples < n - 1 ? samples : n - 1;
+    for (long long s = 0; s < samples; s++)
+    {
+        // Evenly spaced pairs, so the first and last are always checked
+        long long r = 1 + (samples > 1 ? s * (n - 2) / (samples - 1) : 0);
+        long long i = sa.buf[r - 1], j = sa.buf[r];
+        if (i >= n || j >= n || !suffix_less(x, i, j))
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,301 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "cstr.h"
+
+// SA-IS with constant workspace, in the style of SACA-K (Nong 2013).
+//
+// The top level reads the mapped byte string directly, so we don't need
+// an unsigned int copy of it, and it never stores the S/L types. We get
+// the types on the fly instead: when we scan right to left, the type of
+// i follows from x[i], x[i+1] and the type of i+1, and during induced
+// sorting, the position we are scanning and the bucket pointers tell us
+// what we need. The buckets at the top level take CSTR_MAX_ALPHABET_SIZE
+// entries on the stack.
+//
+// The reduced string and its suffix array both fit in sa, since there are
+// at most n/2 LMS suffixes, and the buckets for the reduced alphabet go
+// in the space between them when there is room for it. When there isn't,
+// which needs an unusual string, we allocate them. Each level is also
+// handled this way.
+
+static const unsigned int EMPTY = UINT_MAX;
+
+// Level zero is bytes, the reduced strings are unsigned ints in sa.
+struct text
+{
+    long long n;
+    const uint8_t *bytes;
+    const unsigned int *ints;
+};
+#define CHR(S, I) ((S).bytes ? (unsigned int)(S).bytes[I] : (S).ints[I])
+
+static void get_buckets(struct text s, unsigned int *bkt, unsigned int sigma, bool end)
+{
+    for (unsigned int c = 0; c < sigma; c++)
+    {
+        bkt[c] = 0;
+    }
+    for (long long i = 0; i < s.n; i++)
+    {
+        bkt[CHR(s, i)]++;
+    }
+    unsigned int sum = 0;
+    for (unsigned int c = 0; c < sigma; c++)
+    {
+        sum += bkt[c];
+        bkt[c] = end ? sum - 1 : sum - bkt[c];
+    }
+}
+
+// Iterating through the LMS positions from right to left, computing
+// the types as we go.
+struct lms_iter
+{
+    struct text s;
+    long long i;
+    bool is_s; // the type of i
+};
+
+static struct lms_iter lms_iter(struct text s)
+{
+    // The sentinel is S
+    return (struct lms_iter){.s = s, .i = s.n - 1, .is_s = true};
+}
+
+// Returns the next LMS position to the left, or -1 when there are no more.
+static long long prev_lms(struct lms_iter *it)
+{
+    while (it->i > 0)
+    {
+        long long i = it->i--;
+        unsigned int a = CHR(it->s, i - 1), b = CHR(it->s, i);
+        bool was_s = it->is_s;
+        it->is_s = a < b || (a == b && was_s);
+        if (was_s && !it->is_s)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline void undefine(cstr_suffix_array sa)
+{
+    for (long long i = 0; i < sa.len; i++)
+    {
+        sa.buf[i] = EMPTY;
+    }
+}
+
+// In the scans below, the suffixes we have placed are LMS and L suffixes
+// when we go left to right, so j = sa[i] - 1 is L if x[j] >= x[j+1].
+// Going right to left, j is S if x[j] < x[j+1], and if they are equal,
+// it has the same type as j+1, which is S exactly when the S pointer
+// for the bucket has moved past i.
+//
+// With lms_only we remove the suffixes once they have induced, which leaves
+// only the LMS suffixes, sorted by their LMS substrings, after both scans.
+
+static void induce_l(struct text s, cstr_suffix_array sa,
+                     unsigned int *bkt, unsigned int sigma, bool lms_only)
+{
+    get_buckets(s, bkt, sigma, false);
+    for (long long i = 0; i < s.n; i++)
+    {
+        unsigned int v = sa.buf[i];
+        if (v == EMPTY || v == 0)
+        {
+            continue;
+        }
+        unsigned int j = v - 1, c = CHR(s, j);
+        if (c >= CHR(s, v))
+        {
+            sa.buf[bkt[c]++] = j;
+            if (lms_only && i > 0) // keep the sentinel
+            {
+                sa.buf[i] = EMPTY;
+            }
+        }
+    }
+}
+
+static void induce_s(struct text s, cstr_suffix_array sa,
+                     unsigned int *bkt, unsigned int sigma, bool lms_only)
+{
+    get_buckets(s, bkt, sigma, true);
+    for (long long i = s.n - 1; i > 0; i--)
+    {
+        unsigned int v = sa.buf[i];
+        if (v == EMPTY || v == 0)
+        {
+            continue;
+        }
+        unsigned int j = v - 1, c = CHR(s, j);
+        if (c <= CHR(s, v) && bkt[c] < i)
+        {
+            sa.buf[bkt[c]--] = j;
+            if (lms_only)
+            {
+                sa.buf[i] = EMPTY;
+            }
+        }
+    }
+}
+
+static bool equal_chars(struct text s, long long i, long long j, long long len)
+{
+    for (long long k = 0; k < len; k++)
+    {
+        if (CHR(s, i + k) != CHR(s, j + k))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sort the LMS substrings, name them, and put the reduced string at the
+// end of sa. Returns the number of LMS suffixes, n1, and sets the size of
+// the reduced alphabet.
+static long long reduce(struct text s, cstr_suffix_array sa,
+                        unsigned int *bkt, unsigned int sigma,
+                        unsigned int *sigma1)
+{
+    long long n = s.n;
+
+    undefine(sa);
+    get_buckets(s, bkt, sigma, true);
+    struct lms_iter it = lms_iter(s);
+    for (long long i = prev_lms(&it); i >= 0; i = prev_lms(&it))
+    {
+        sa.buf[bkt[CHR(s, i)]--] = (unsigned int)i;
+    }
+    induce_l(s, sa, bkt, sigma, true);
+    induce_s(s, sa, bkt, sigma, true);
+
+    // Only the LMS suffixes are left (and suffix 0 if it never induced).
+    long long n1 = 0;
+    for (long long i = 0; i < n; i++)
+    {
+        unsigned int v = sa.buf[i];
+        if (v != EMPTY && v != 0)
+        {
+            sa.buf[n1++] = v;
+        }
+    }
+
+    // LMS positions are at least two apart, so we can store the length
+    // of the substring at j in n1 + j/2, and later replace it with its name.
+    undefine(CSTR_SUFFIX(sa, n1));
+    long long next = n - 1;
+    it = lms_iter(s);
+    for (long long i = prev_lms(&it); i >= 0; i = prev_lms(&it))
+    {
+        sa.buf[n1 + i / 2] = (unsigned int)(next - i + 1);
+        next = i;
+    }
+
+    unsigned int name = 0;
+    long long prev = sa.buf[0];
+    long long prev_len = sa.buf[n1 + prev / 2];
+    sa.buf[n1 + prev / 2] = name;
+    for (long long i = 1; i < n1; i++)
+    {
+        long long cur = sa.buf[i];
+        long long cur_len = sa.buf[n1 + cur / 2];
+        if (cur_len != prev_len || !equal_chars(s, prev, cur, cur_len))
+        {
+            name++;
+        }
+        sa.buf[n1 + cur / 2] = name;
+        prev = cur;
+        prev_len = cur_len;
+    }
+    *sigma1 = name + 1;
+
+    // Move the names to the end of sa, keeping their order.
+    long long k = n;
+    for (long long i = n - 1; i >= n1; i--)
+    {
+        if (sa.buf[i] != EMPTY)
+        {
+            sa.buf[--k] = sa.buf[i];
+        }
+    }
+
+    return n1;
+}
+
+static void sacak_rec(struct text s, cstr_suffix_array sa,
+                      unsigned int *bkt, unsigned int sigma)
+{
+    long long n = s.n;
+    if (n == 1)
+    {
+        sa.buf[0] = 0;
+        return;
+    }
+
+    unsigned int sigma1;
+    long long n1 = reduce(s, sa, bkt, sigma, &sigma1);
+
+    cstr_suffix_array sa1 = CSTR_PREFIX(sa, n1);
+    struct text s1 = {.n = n1, .ints = sa.buf + n - n1};
+    if (sigma1 < n1)
+    {
+        // Buckets go between sa1 and s1 if there is room
+        bool fits = n - 2 * n1 >= sigma1;
+        unsigned int *bkt1 = fits ? sa.buf + n1 : cstr_malloc_buffer(sizeof *bkt1, sigma1);
+        sacak_rec(s1, sa1, bkt1, sigma1);
+        if (!fits)
+        {
+            free(bkt1);
+        }
+    }
+    else
+    {
+        for (long long i = 0; i < n1; i++)
+        {
+            sa1.buf[s1.ints[i]] = (unsigned int)i;
+        }
+    }
+
+    // Replace the reduced string with the LMS positions, then
+    // map sa1 to the positions in s.
+    long long k = n;
+    struct lms_iter it = lms_iter(s);
+    for (long long i = prev_lms(&it); i >= 0; i = prev_lms(&it))
+    {
+        sa.buf[--k] = (unsigned int)i;
+    }
+    for (long long i = 0; i < n1; i++)
+    {
+        sa.buf[i] = sa.buf[n - n1 + sa.buf[i]];
+    }
+    undefine(CSTR_SUFFIX(sa, n1));
+
+    // Put the sorted LMS suffixes at the end of their buckets, largest
+    // first. The sentinel is first and stays at index zero.
+    get_buckets(s, bkt, sigma, true);
+    for (long long i = n1 - 1; i > 0; i--)
+    {
+        unsigned int j = sa.buf[i];
+        sa.buf[i] = EMPTY;
+        sa.buf[bkt[CHR(s, j)]--] = j;
+    }
+
+    induce_l(s, sa, bkt, sigma, false);
+    induce_s(s, sa, bkt, sigma, false);
+}
+
+void cstr_sacak(cstr_suffix_array sa, cstr_const_sslice x, cstr_alphabet const *alpha)
+{
+    if (x.len == 0)
+    {
+        return;
+    }
+    unsigned int bkt[CSTR_MAX_ALPHABET_SIZE];
+    struct text s = {.n = x.len, .bytes = x.buf};
+    sacak_rec(s, sa, bkt, alpha->size);
+}
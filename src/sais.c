@@ -1,8 +1,10 @@
-#include "testlib.h"
 #include "unittests.h"
 #include <cstr.h>
 #include <limits.h>
 
+#include "parallel_internal.h"
+#include "sais_internal.h"
+
 // clang-format off
 // We will use the largest unsigned int to mean undefined
 static const unsigned int UNDEF = UINT_MAX;
@@ -24,18 +26,6 @@ static inline long long *alloc_buckets(long long sigma)
     return buckets;
 }
 
-static void count_buckets(cstr_const_uislice x, long long sigma, long long buckets[sigma])
-{
-    for (long long i = 0; i < sigma; i++)
-    {
-        buckets[i] = 0;
-    }
-    for (long long i = 0; i < x.len; i++)
-    {
-        buckets[x.buf[i]]++;
-    }
-}
-
 static void init_buckets_start(long long sigma, long long start[sigma],
                                const long long buckets[sigma])
 {
@@ -58,22 +48,6 @@ static void init_buckets_end(long long sigma, long long end[sigma],
     }
 }
 
-static void classify_sl(cstr_const_uislice x, cstr_bit_vector *is_s)
-{
-    if (x.len == 0)
-    {
-        return;
-    }
-
-    cstr_bv_set(is_s, x.len - 1, true);
-    for (long long i = x.len - 1; i > 0; i--)
-    {
-        bool smaller_start = (x.buf[i - 1] < x.buf[i]);
-        bool equal_class = ((x.buf[i - 1] == x.buf[i]) && cstr_bv_get(is_s, i));
-        cstr_bv_set(is_s, i - 1, smaller_start || equal_class);
-    }
-}
-
 static inline void undefine_sa_slice(cstr_suffix_array sa)
 {
     for (long long i = 0; i < sa.len; i++)
@@ -82,87 +56,6 @@ static inline void undefine_sa_slice(cstr_suffix_array sa)
     }
 }
 
-static void bucket_lms(cstr_const_uislice x, cstr_suffix_array sa,
-                       cstr_bit_vector *is_s, long long ends[])
-{
-    for (long long i = x.len - 1; i >= 0; i--)
-    {
-        if (IS_LMS(i))
-        {
-            sa.buf[--ends[x.buf[i]]] = (unsigned int)i;
-        }
-    }
-}
-
-static void induce_l(cstr_const_uislice x, cstr_suffix_array sa,
-                     cstr_bit_vector *is_s, long long start[])
-{
-    for (long long i = 0; i < x.len; i++)
-    {
-        if (sa.buf[i] == 0 || is_undef(sa.buf[i]))
-        {
-            continue;
-        }
-        long long j = sa.buf[i] - 1;
-        if (IS_L(j))
-        {
-            sa.buf[start[x.buf[j]]++] = (unsigned int)j;
-        }
-    }
-}
-
-static void induce_s(cstr_const_uislice x, cstr_suffix_array sa,
-                     cstr_bit_vector *is_s, long long end[])
-{
-    for (long long i = x.len - 1; i > 0; i--)
-    {
-        if (sa.buf[i] == 0)
-        {
-            continue;
-        }
-        long long j = sa.buf[i] - 1;
-        if (IS_S(j))
-        {
-            sa.buf[--end[x.buf[j]]] = (unsigned int)j;
-        }
-    }
-}
-
-static bool equal_lms_strings(cstr_const_uislice x, cstr_bit_vector *is_s,
-                              long long i, long long j)
-{
-    // They are obviously equal if they are the same string...
-    if (i == j)
-    {
-        return true;
-    }
-
-    // Now they can't be equal, so if one is the sentinel, they are different
-    if (i == x.len - 1 || j == x.len - 1)
-    {
-        return false;
-    }
-
-    // Now we can scan along until we see a difference or reach the next LMS index
-    for (long long k = 0;; k++)
-    {
-        // If we reach the end of both strings, they are equal.
-        // The k > 0 to not test at the very first index where both
-        // are obviously also LMS.
-        if (k > 0 && IS_LMS(i + k) && IS_LMS(j + k))
-        {
-            return true;
-        }
-        if (IS_LMS(i + k) != IS_LMS(j + k) || x.buf[i + k] != x.buf[j + k])
-        {
-            // We found a difference (in either termination or character)
-            return false;
-        }
-    }
-
-    return false;
-}
-
 // Move all the LMS index to the beginning of sa, then put the sub-slice
 // that contains them in compact and put the rest of sa in rest.
 static cstr_uislice compact_lms(cstr_suffix_array sa,
@@ -196,147 +89,885 @@ static cstr_uislice compact_defined(cstr_uislice x)
     return CSTR_PREFIX(x, k);
 }
 
-static cstr_uislice reduce(cstr_const_uislice x, cstr_suffix_array sa, cstr_bit_vector *is_s,
-                           cstr_uislice *compact, unsigned int *sigma)
+// When all letters in a reduced string are unique, we just need to
+// sort them in their buckets. This only works for the reduced strings,
+// where the alphabet is exactly the letters we use; the input string
+// can have sigma == x.len and still repeat letters.
+static void sort_unique(cstr_suffix_array sa, cstr_const_uislice x)
 {
-    cstr_uislice buffer;
-    *compact = compact_lms(sa, is_s, &buffer);
-    undefine_sa_slice(buffer);
-
-    // Use buffer to make the map of ordered lms strings, exploiting that
-    // we never have two lms index next to each other, so we can map in half
-    // the space.
-    *sigma = 0;
-    long long prev_lms = compact->buf[0];
-    buffer.buf[prev_lms / 2] = *sigma;
-    for (long long i = 1; i < compact->len; i++)
+    for (unsigned int i = 0; i < x.len; i++)
     {
-        unsigned int j = compact->buf[i];
-        if (!equal_lms_strings(x, is_s, prev_lms, j))
-        {
-            (*sigma)++; // We've seen a new letter
-        }
-        buffer.buf[j / 2] = *sigma;
-        prev_lms = j;
+        sa.buf[x.buf[i]] = i;
     }
-    (*sigma)++; // Alphabet size is one larger than the largets letter
+}
+
+// MARK: Induced sorting
+//
+// The induce scans move through sa in order, but for each entry they read
+// x[sa[i] - 1], which is a random access, and then write to the bucket
+// pointer for that letter, which is random in sa when the alphabet is
+// large (as it is in the recursion). We prefetch both ahead of the scan:
+// the letter 2 * PREFETCH_DIST entries ahead, and the place it will be
+// written PREFETCH_DIST entries ahead, where the letter should be in cache.
+// Entries we prefetch might not be induced yet, but then we just prefetch
+// something we don't need.
+
+#define PREFETCH_DIST 16
+
+// MARK: The sequential algorithm
+//
+// The top level can work on the text as bytes, the way cstr_alphabet_map
+// gives it to us, and the recursion works on reduced strings in the
+// narrowest of bytes, uint16_t and unsigned int that their alphabet fits
+// in, so we generate the algorithm for each text type, the way cstr.h
+// generates slice functions. The instances are called <function>_<slice type>,
+// and the dispatch macros after the instances pick one from the type of x.
+// Inside the generator, we use comments with slashes and stars since the
+// lines are joined into one.
+
+// Sorts the reduced string, which reduce() leaves as unsigned int
+static void sais_reduced(cstr_suffix_array sa_u, cstr_uislice u,
+                         cstr_bit_vector *is_s, unsigned int u_sigma);
 
-    // Now all there is left is to compact the table in buffer into the reduced string
-    return compact_defined(buffer);
+// clang-format off
+#define SAIS_GENERATOR(NAME)                                                                     \
+static void count_buckets_##NAME(cstr_##NAME x, long long sigma, long long buckets[sigma])       \
+{                                                                                                \
+    for (long long i = 0; i < sigma; i++)                                                        \
+    {                                                                                            \
+        buckets[i] = 0;                                                                          \
+    }                                                                                            \
+    for (long long i = 0; i < x.len; i++)                                                        \
+    {                                                                                            \
+        buckets[x.buf[i]]++;                                                                     \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void classify_sl_##NAME(cstr_##NAME x, cstr_bit_vector *is_s)                             \
+{                                                                                                \
+    if (x.len == 0)                                                                              \
+    {                                                                                            \
+        return;                                                                                  \
+    }                                                                                            \
+                                                                                                 \
+    cstr_bv_set(is_s, x.len - 1, true);                                                          \
+    for (long long i = x.len - 1; i > 0; i--)                                                    \
+    {                                                                                            \
+        bool smaller_start = (x.buf[i - 1] < x.buf[i]);                                          \
+        bool equal_class = ((x.buf[i - 1] == x.buf[i]) && cstr_bv_get(is_s, i));                 \
+        cstr_bv_set(is_s, i - 1, smaller_start || equal_class);                                  \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void bucket_lms_##NAME(cstr_##NAME x, cstr_suffix_array sa,                               \
+                       cstr_bit_vector *is_s, long long ends[])                                  \
+{                                                                                                \
+    for (long long i = x.len - 1; i >= 0; i--)                                                   \
+    {                                                                                            \
+        if (IS_LMS(i))                                                                           \
+        {                                                                                        \
+            sa.buf[--ends[x.buf[i]]] = (unsigned int)i;                                          \
+        }                                                                                        \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static inline void prefetch_letter_##NAME(cstr_##NAME x, cstr_suffix_array sa, long long i)      \
+{                                                                                                \
+    if (0 <= i && i < sa.len)                                                                    \
+    {                                                                                            \
+        /* Wraps around for 0 and UNDEF, so we only test once */                                 \
+        unsigned int j = sa.buf[i] - 1;                                                          \
+        if (j < x.len)                                                                           \
+        {                                                                                        \
+            CSTR_PREFETCH(x.buf + j);                                                            \
+        }                                                                                        \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static inline void prefetch_bucket_##NAME(cstr_##NAME x, cstr_suffix_array sa,                   \
+                                   long long i, long long const ptr[])                           \
+{                                                                                                \
+    if (0 <= i && i < sa.len)                                                                    \
+    {                                                                                            \
+        unsigned int j = sa.buf[i] - 1;                                                          \
+        if (j < x.len)                                                                           \
+        {                                                                                        \
+            CSTR_PREFETCH(sa.buf + ptr[x.buf[j]]);                                               \
+        }                                                                                        \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void induce_l_##NAME(cstr_##NAME x, cstr_suffix_array sa,                                 \
+                     cstr_bit_vector *is_s, long long start[])                                   \
+{                                                                                                \
+    for (long long i = 0; i < x.len; i++)                                                        \
+    {                                                                                            \
+        prefetch_letter_##NAME(x, sa, i + 2 * PREFETCH_DIST);                                    \
+        prefetch_bucket_##NAME(x, sa, i + PREFETCH_DIST, start);                                 \
+        if (sa.buf[i] == 0 || is_undef(sa.buf[i]))                                               \
+        {                                                                                        \
+            continue;                                                                            \
+        }                                                                                        \
+        long long j = sa.buf[i] - 1;                                                             \
+        if (IS_L(j))                                                                             \
+        {                                                                                        \
+            sa.buf[start[x.buf[j]]++] = (unsigned int)j;                                         \
+        }                                                                                        \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void induce_s_##NAME(cstr_##NAME x, cstr_suffix_array sa,                                 \
+                     cstr_bit_vector *is_s, long long end[])                                     \
+{                                                                                                \
+    for (long long i = x.len - 1; i > 0; i--)                                                    \
+    {                                                                                            \
+        prefetch_letter_##NAME(x, sa, i - 2 * PREFETCH_DIST);                                    \
+        prefetch_bucket_##NAME(x, sa, i - PREFETCH_DIST, end);                                   \
+        if (sa.buf[i] == 0)                                                                      \
+        {                                                                                        \
+            continue;                                                                            \
+        }                                                                                        \
+        long long j = sa.buf[i] - 1;                                                             \
+        if (IS_S(j))                                                                             \
+        {                                                                                        \
+            sa.buf[--end[x.buf[j]]] = (unsigned int)j;                                           \
+        }                                                                                        \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static bool equal_lms_strings_##NAME(cstr_##NAME x, cstr_bit_vector *is_s,                       \
+                              long long i, long long j)                                          \
+{                                                                                                \
+    /* They are obviously equal if they are the same string... */                                \
+    if (i == j)                                                                                  \
+    {                                                                                            \
+        return true;                                                                             \
+    }                                                                                            \
+                                                                                                 \
+    /* Now they can't be equal, so if one is the sentinel, they are different */                 \
+    if (i == x.len - 1 || j == x.len - 1)                                                        \
+    {                                                                                            \
+        return false;                                                                            \
+    }                                                                                            \
+                                                                                                 \
+    /* Now we can scan along until we see a difference or reach the next LMS index */            \
+    for (long long k = 0;; k++)                                                                  \
+    {                                                                                            \
+        /* If we reach the end of both strings, they are equal. */                               \
+        /* The k > 0 to not test at the very first index where both */                           \
+        /* are obviously also LMS. */                                                            \
+        if (k > 0 && IS_LMS(i + k) && IS_LMS(j + k))                                             \
+        {                                                                                        \
+            return true;                                                                         \
+        }                                                                                        \
+        if (IS_LMS(i + k) != IS_LMS(j + k) || x.buf[i + k] != x.buf[j + k])                      \
+        {                                                                                        \
+            /* We found a difference (in either termination or character) */                     \
+            return false;                                                                        \
+        }                                                                                        \
+    }                                                                                            \
+                                                                                                 \
+    return false;                                                                                \
+}                                                                                                \
+                                                                                                 \
+static cstr_uislice reduce_##NAME(cstr_##NAME x, cstr_suffix_array sa, cstr_bit_vector *is_s,    \
+                           cstr_uislice *compact, unsigned int *sigma)                           \
+{                                                                                                \
+    cstr_uislice buffer;                                                                         \
+    *compact = compact_lms(sa, is_s, &buffer);                                                   \
+    undefine_sa_slice(buffer);                                                                   \
+                                                                                                 \
+    /* Use buffer to make the map of ordered lms strings, exploiting that */                     \
+    /* we never have two lms index next to each other, so we can map in half */                  \
+    /* the space. */                                                                             \
+    *sigma = 0;                                                                                  \
+    long long prev_lms = compact->buf[0];                                                        \
+    buffer.buf[prev_lms / 2] = *sigma;                                                           \
+    for (long long i = 1; i < compact->len; i++)                                                 \
+    {                                                                                            \
+        unsigned int j = compact->buf[i];                                                        \
+        if (!equal_lms_strings_##NAME(x, is_s, prev_lms, j))                                     \
+        {                                                                                        \
+            (*sigma)++; /* We've seen a new letter */                                            \
+        }                                                                                        \
+        buffer.buf[j / 2] = *sigma;                                                              \
+        prev_lms = j;                                                                            \
+    }                                                                                            \
+    (*sigma)++; /* Alphabet size is one larger than the largets letter */                        \
+                                                                                                 \
+    /* Now all there is left is to compact the table in buffer into the reduced string */        \
+    return compact_defined(buffer);                                                              \
+}                                                                                                \
+                                                                                                 \
+/* Compact the LMS indices into offsets, so we have them there */                                \
+/* in their original order, and return how many there are */                                     \
+static long long collect_lms_##NAME(cstr_##NAME x, cstr_bit_vector *is_s,                        \
+                             cstr_uislice offsets)                                               \
+{                                                                                                \
+    long long k = 0;                                                                             \
+    for (long long i = 0; i < x.len; i++)                                                        \
+    {                                                                                            \
+        if (IS_LMS(i))                                                                           \
+        {                                                                                        \
+            offsets.buf[k++] = (unsigned int)i;                                                  \
+        }                                                                                        \
+    }                                                                                            \
+    return k;                                                                                    \
+}                                                                                                \
+                                                                                                 \
+/* Move the ordered LMS indices in the first k entries of sa */                                  \
+/* to their correct position using bucketing. */                                                 \
+static void bucket_sorted_lms_##NAME(cstr_##NAME x, cstr_suffix_array sa,                        \
+                              long long k, long long ends[])                                     \
+{                                                                                                \
+    for (long long i = k - 1; i >= 0; i--)                                                       \
+    {                                                                                            \
+        /* Get the next value and undef its entry */                                             \
+        unsigned int j = sa.buf[i];                                                              \
+        sa.buf[i] = UNDEF;                                                                       \
+        /* Then insert it in the right bucket */                                                 \
+        sa.buf[--ends[x.buf[j]]] = j;                                                            \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void reverse_u_##NAME(cstr_##NAME x,                                                      \
+                      cstr_suffix_array sa,                                                      \
+                      cstr_bit_vector *is_s,                                                     \
+                      cstr_const_uislice sa_u,                                                   \
+                      cstr_uislice offsets,                                                      \
+                      long long ends[])                                                          \
+{                                                                                                \
+    long long k = collect_lms_##NAME(x, is_s, offsets);                                          \
+                                                                                                 \
+    /* Now reorder the offsets according to the suffix array of u */                             \
+    /* and put the result at the top of sa */                                                    \
+    for (long long i = 0; i < k; i++)                                                            \
+    {                                                                                            \
+        sa.buf[i] = offsets.buf[sa_u.buf[i]];                                                    \
+    }                                                                                            \
+                                                                                                 \
+    /* Data after k isn't used any more, but we need to clear */                                 \
+    /* it to undefined for the later imputing. */                                                \
+    undefine_sa_slice(CSTR_SUFFIX(sa, k));                                                       \
+                                                                                                 \
+    /* Then move the ordered LMS indices to their correct position */                            \
+    /* using bucketing. */                                                                       \
+    bucket_sorted_lms_##NAME(x, sa, k, ends);                                                    \
+}                                                                                                \
+                                                                                                 \
+static void sais_rec_##NAME(cstr_suffix_array sa, cstr_##NAME x,                                 \
+                     cstr_bit_vector *is_s, unsigned int sigma)                                  \
+{                                                                                                \
+    if (x.len == 1)                                                                              \
+    {                                                                                            \
+        /* Just the sentinel, so there are no LMS-strings to sort. */                            \
+        sa.buf[0] = 0;                                                                           \
+        return;                                                                                  \
+    }                                                                                            \
+                                                                                                 \
+    /* We need to sort LMS-strings and create reduced string. */                                 \
+    long long *buckets = alloc_buckets(sigma);                                                   \
+    long long *buck_ptr = alloc_buckets(sigma);                                                  \
+    count_buckets_##NAME(x, sigma, buckets);                                                     \
+    undefine_sa_slice(sa);                                                                       \
+    classify_sl_##NAME(x, is_s);                                                                 \
+                                                                                                 \
+    init_buckets_end(sigma, buck_ptr, buckets);                                                  \
+    bucket_lms_##NAME(x, sa, is_s, buck_ptr);                                                    \
+                                                                                                 \
+    init_buckets_start(sigma, buck_ptr, buckets);                                                \
+    induce_l_##NAME(x, sa, is_s, buck_ptr);                                                      \
+                                                                                                 \
+    init_buckets_end(sigma, buck_ptr, buckets);                                                  \
+    induce_s_##NAME(x, sa, is_s, buck_ptr);                                                      \
+                                                                                                 \
+    CSTR_FREE_NULL(buckets);                                                                     \
+    CSTR_FREE_NULL(buck_ptr);                                                                    \
+                                                                                                 \
+    /* Construct u for the recursion */                                                          \
+    unsigned int u_sigma;                                                                        \
+    cstr_uislice sa_u, u;                                                                        \
+    u = reduce_##NAME(x, sa, is_s, &sa_u, &u_sigma);                                             \
+                                                                                                 \
+    /* Now sa_u is the first bit of sa and u the rest of sa. Remember that they overlap. */      \
+    /* Don't fuck around with sa before you are done with u and sa_u, or things will break. */   \
+    /* We create u here, but sa_u is just getting working memory, not initialised. */            \
+                                                                                                 \
+    /* Construct suffix array for u */                                                           \
+    sais_reduced(sa_u, u, is_s, u_sigma);                                                        \
+                                                                                                 \
+    /* Now we need the LMS strings back from u, in the correct order, */                         \
+    /* and then induce once more. */                                                             \
+    buckets = alloc_buckets(sigma);                                                              \
+    buck_ptr = alloc_buckets(sigma);                                                             \
+    count_buckets_##NAME(x, sigma, buckets);                                                     \
+    classify_sl_##NAME(x, is_s);                                                                 \
+                                                                                                 \
+    /* Get the sorted LMS strings back into sa and then impute the rest */                       \
+    init_buckets_end(sigma, buck_ptr, buckets);                                                  \
+    reverse_u_##NAME(x, sa, is_s, CSTR_SLICE_CONST_CAST(sa_u), u, buck_ptr);                     \
+                                                                                                 \
+    init_buckets_start(sigma, buck_ptr, buckets);                                                \
+    induce_l_##NAME(x, sa, is_s, buck_ptr);                                                      \
+                                                                                                 \
+    init_buckets_end(sigma, buck_ptr, buckets);                                                  \
+    induce_s_##NAME(x, sa, is_s, buck_ptr);                                                      \
+                                                                                                 \
+    CSTR_FREE_NULL(buckets);                                                                     \
+    CSTR_FREE_NULL(buck_ptr);                                                                    \
 }
+// clang-format on
 
-static void reverse_u(cstr_const_uislice x,
-                      cstr_suffix_array sa,
-                      cstr_bit_vector *is_s,
-                      cstr_const_uislice sa_u,
-                      cstr_uislice offsets,
-                      long long ends[])
+SAIS_GENERATOR(const_uislice)
+SAIS_GENERATOR(const_u16slice)
+SAIS_GENERATOR(const_sslice)
+
+// clang-format off
+#define SAIS_DISPATCH(X, FUNC)            \
+    _Generic((X),                         \
+             cstr_const_sslice            \
+             : FUNC##_const_sslice,       \
+             cstr_const_u16slice          \
+             : FUNC##_const_u16slice,     \
+             cstr_const_uislice           \
+             : FUNC##_const_uislice)
+// clang-format on
+
+// With these, the code outside the generator, and the tests, can call
+// the functions without worrying about the text type.
+#define count_buckets(X, ...) SAIS_DISPATCH(X, count_buckets)(X, __VA_ARGS__)
+#define classify_sl(X, ...) SAIS_DISPATCH(X, classify_sl)(X, __VA_ARGS__)
+#define bucket_lms(X, ...) SAIS_DISPATCH(X, bucket_lms)(X, __VA_ARGS__)
+#define induce_l(X, ...) SAIS_DISPATCH(X, induce_l)(X, __VA_ARGS__)
+#define induce_s(X, ...) SAIS_DISPATCH(X, induce_s)(X, __VA_ARGS__)
+#define equal_lms_strings(X, ...) SAIS_DISPATCH(X, equal_lms_strings)(X, __VA_ARGS__)
+#define collect_lms(X, ...) SAIS_DISPATCH(X, collect_lms)(X, __VA_ARGS__)
+#define bucket_sorted_lms(X, ...) SAIS_DISPATCH(X, bucket_sorted_lms)(X, __VA_ARGS__)
+#define reverse_u(X, ...) SAIS_DISPATCH(X, reverse_u)(X, __VA_ARGS__)
+#define sais_rec(SA, X, ...) SAIS_DISPATCH(X, sais_rec)(SA, X, __VA_ARGS__)
+
+// The reduced string often has a small alphabet, and then we recurse on it
+// in the narrowest type it fits in, so the deeper levels move less memory.
+// We pack it into the memory it is already in; element i of the narrow
+// type only overwrites elements we have already read, and memcpy keeps
+// the type punning well-defined.
+static cstr_const_sslice pack_u8(cstr_uislice u)
 {
-    // Compact the LMS indices into offset so we have them there
-    // in their original order
-    long long k = 0;
-    for (long long i = 0; i < x.len; i++)
+    uint8_t *buf = (uint8_t *)u.buf;
+    for (long long i = 0; i < u.len; i++)
     {
-        if (IS_LMS(i))
-        {
-            offsets.buf[k++] = (unsigned int)i;
-        }
+        buf[i] = (uint8_t)u.buf[i];
     }
+    return CSTR_SLICE((const uint8_t *)buf, u.len);
+}
 
-    // Now reorder the offsets according to the suffix array of u
-    // and put the result at the top of sa
-    for (long long i = 0; i < k; i++)
+static cstr_const_u16slice pack_u16(cstr_uislice u)
+{
+    uint8_t *bytes = (uint8_t *)u.buf;
+    for (long long i = 0; i < u.len; i++)
     {
-        sa.buf[i] = offsets.buf[sa_u.buf[i]];
+        uint16_t a = (uint16_t)u.buf[i];
+        memcpy(bytes + i * (long long)sizeof a, &a, sizeof a);
     }
+    return CSTR_SLICE((const uint16_t *)(void *)bytes, u.len);
+}
 
-    // Data after k isn't used any more, but we need to clear
-    // it to undefined for the later imputing.
-    undefine_sa_slice(CSTR_SUFFIX(sa, k));
-
-    // Then move the ordered LMS indices to their correct position
-    // using bucketing.
-    for (long long i = k - 1; i >= 0; i--)
+static void sais_reduced(cstr_suffix_array sa_u, cstr_uislice u,
+                         cstr_bit_vector *is_s, unsigned int u_sigma)
+{
+    if (u_sigma == u.len)
     {
-        // Get the next value and undef its entry
-        unsigned int j = sa.buf[i];
-        sa.buf[i] = UNDEF;
-        // Then insert it in the right bucket
-        sa.buf[--ends[x.buf[j]]] = j;
+        sort_unique(sa_u, CSTR_SLICE_CONST_CAST(u));
+    }
+    else if (u_sigma <= UINT8_MAX + 1)
+    {
+        sais_rec(sa_u, pack_u8(u), is_s, u_sigma);
+    }
+    else if (u_sigma <= UINT16_MAX + 1)
+    {
+        sais_rec(sa_u, pack_u16(u), is_s, u_sigma);
+    }
+    else
+    {
+        sais_rec(sa_u, CSTR_SLICE_CONST_CAST(u), is_s, u_sigma);
     }
 }
 
-static void sais_rec(cstr_suffix_array sa, cstr_const_uislice x,
-                     cstr_bit_vector *is_s, unsigned int sigma)
+void cstr_sais(cstr_suffix_array sa, cstr_const_uislice x, cstr_alphabet *alpha)
 {
-    if (sigma == x.len)
-    {
-        // We are done with recursing when all letters are unique.
-        // We just need to sort them in their buckets.
-        for (unsigned int i = 0; i < x.len; i++)
-        {
-            sa.buf[x.buf[i]] = i;
-        }
-        return;
-    }
+    cstr_bit_vector *is_s = cstr_new_bv(x.len);
+    sais_rec(sa, x, is_s, alpha->size);
+    free(is_s);
+}
 
-    // Recursive case. We need to sort LMS-strings and create reduced string.
-    long long *buckets = alloc_buckets(sigma);
-    long long *buck_ptr = alloc_buckets(sigma);
-    count_buckets(x, sigma, buckets);
-    undefine_sa_slice(sa);
-    classify_sl(x, is_s);
+void cstr_sais_sslice(cstr_suffix_array sa, cstr_const_sslice x, cstr_alphabet *alpha)
+{
+    cstr_bit_vector *is_s = cstr_new_bv(x.len);
+    sais_rec(sa, x, is_s, alpha->size);
+    free(is_s);
+}
 
-    init_buckets_end(sigma, buck_ptr, buckets);
-    bucket_lms(x, sa, is_s, buck_ptr);
+void cstr_sais_reduced(cstr_suffix_array sa, cstr_uislice u, unsigned int sigma)
+{
+    cstr_bit_vector *is_s = cstr_new_bv(u.len);
+    sais_reduced(sa, u, is_s, sigma);
+    free(is_s);
+}
 
-    init_buckets_start(sigma, buck_ptr, buckets);
-    induce_l(x, sa, is_s, buck_ptr);
+// MARK: Parallel SA-IS
+//
+// The parallel construction runs the same algorithm as cstr_sais, and
+// produces exactly the same suffix array, but spreads the work that doesn't
+// depend on the order of operations over a pool of threads:
+//
+// - S/L classification is done in blocks. Each block guesses the type of
+//   the position just after it, and afterwards we fix the run of positions
+//   that depended on a wrong guess.
+// - Induced sorting is block-buffered. For a block of the suffix array, the
+//   threads read the entries and look up the preceding character and its
+//   type, which is where the cache misses are, and then the calling thread
+//   does the bucket writes in the sequential order. Entries that change
+//   while we write a block are looked up again.
+// - LMS naming compares neighbouring LMS strings in parallel and then
+//   assigns the names from a prefix sum over the threads' counts.
+//
+// Short strings, which we always get at the bottom of the recursion, are
+// handled by the sequential code.
+
+#define PAR_MIN_LEN (1 << 12) // shorter strings are sorted sequentially
+#define PAR_BLOCK (1 << 15)   // suffix array entries per induce block
+#define BV_WORD_BITS 64       // aligning thread ranges in bit vectors to this
+
+// An SA entry as we saw it, and the bucket to induce into from it (or UNDEF)
+struct prepared
+{
+    unsigned int sa;
+    unsigned int c;
+};
 
-    init_buckets_end(sigma, buck_ptr, buckets);
-    induce_s(x, sa, is_s, buck_ptr);
+struct par_sais
+{
+    cstr_par_pool *pool;
+    struct prepared *block; // PAR_BLOCK entries
+    long long *counts;      // one per thread
+};
 
-    CSTR_FREE_NULL(buckets);
-    CSTR_FREE_NULL(buck_ptr);
+struct undefine_ctx
+{
+    cstr_suffix_array sa;
+};
 
-    // Construct u for the recursion
-    unsigned int u_sigma;
-    cstr_uislice sa_u, u;
-    u = reduce(x, sa, is_s, &sa_u, &u_sigma);
+static void undefine_range(struct undefine_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->sa.len, t, no_threads, 1, &from, &to);
+    undefine_sa_slice(CSTR_SUBSLICE(ctx->sa, from, to));
+}
 
-    // Now sa_u is the first bit of sa and u the rest of sa. Remember that they overlap.
-    // Don't fuck around with sa before you are done with u and sa_u, or things will break.
-    // We create u here, but sa_u is just getting working memory, not initialised.
+static void par_undefine(struct par_sais *ps, cstr_suffix_array sa)
+{
+    struct undefine_ctx ctx = {.sa = sa};
+    cstr_par_run(ps->pool, (cstr_par_fn)undefine_range, &ctx);
+}
 
-    // Construct suffix array for u
-    sais_rec(sa_u, CSTR_SLICE_CONST_CAST(u), is_s, u_sigma);
+struct gather_ctx
+{
+    cstr_suffix_array sa;
+    cstr_const_uislice sa_u;
+    cstr_uislice offsets;
+};
 
-    // Now we need the LMS strings back from u, in the correct order,
-    // and then induce once more.
-    buckets = alloc_buckets(sigma);
-    buck_ptr = alloc_buckets(sigma);
-    count_buckets(x, sigma, buckets);
-    classify_sl(x, is_s);
+static void gather_lms(struct gather_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->sa.len, t, no_threads, 1, &from, &to);
+    for (long long i = from; i < to; i++)
+    {
+        ctx->sa.buf[i] = ctx->offsets.buf[ctx->sa_u.buf[i]];
+    }
+}
 
-    // Get the sorted LMS strings back into sa and then impute the rest
-    init_buckets_end(sigma, buck_ptr, buckets);
-    reverse_u(x, sa, is_s, CSTR_SLICE_CONST_CAST(sa_u), u, buck_ptr);
+// The parallel steps touch x, so we generate them for integer and byte
+// strings, like the sequential ones. The reduced strings are integers.
+// clang-format off
+#define PAR_SAIS_GENERATOR(NAME)                                                                 \
+struct classify_ctx_##NAME                                                                       \
+{                                                                                                \
+    cstr_##NAME x;                                                                               \
+    cstr_bit_vector *is_s;                                                                       \
+    long long *run; /* start of the positions that depend on the next block */                   \
+    bool *fix;      /* the guess for the run was wrong */                                        \
+};                                                                                               \
+                                                                                                 \
+static void classify_block_##NAME(struct classify_ctx_##NAME *ctx, int t, int no_threads)        \
+{                                                                                                \
+    cstr_##NAME x = ctx->x;                                                                      \
+    cstr_bit_vector *is_s = ctx->is_s;                                                           \
+    long long from, to;                                                                          \
+    cstr_par_range(x.len, t, no_threads, BV_WORD_BITS, &from, &to);                              \
+    ctx->run[t] = to;                                                                            \
+    if (from == to)                                                                              \
+    {                                                                                            \
+        return;                                                                                  \
+    }                                                                                            \
+                                                                                                 \
+    /* Unless x[to - 1] == x[to], we know the type of to - 1. If they are */                     \
+    /* equal, it has the same type as to, and we guess S. */                                     \
+    bool depends = to < x.len && x.buf[to - 1] == x.buf[to];                                     \
+    cstr_bv_set(is_s, to - 1, to == x.len || x.buf[to - 1] <= x.buf[to]);                        \
+    for (long long i = to - 1; i > from; i--)                                                    \
+    {                                                                                            \
+        bool smaller_start = (x.buf[i - 1] < x.buf[i]);                                          \
+        bool equal_class = ((x.buf[i - 1] == x.buf[i]) && cstr_bv_get(is_s, i));                 \
+        cstr_bv_set(is_s, i - 1, smaller_start || equal_class);                                  \
+    }                                                                                            \
+                                                                                                 \
+    if (depends)                                                                                 \
+    {                                                                                            \
+        long long r = to - 1;                                                                    \
+        while (r > from && x.buf[r - 1] == x.buf[r])                                             \
+        {                                                                                        \
+            r--;                                                                                 \
+        }                                                                                        \
+        ctx->run[t] = r;                                                                         \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void fix_block_##NAME(struct classify_ctx_##NAME *ctx, int t, int no_threads)             \
+{                                                                                                \
+    long long from, to;                                                                          \
+    cstr_par_range(ctx->x.len, t, no_threads, BV_WORD_BITS, &from, &to);                         \
+    for (long long i = ctx->run[t]; ctx->fix[t] && i < to; i++)                                  \
+    {                                                                                            \
+        cstr_bv_set(ctx->is_s, i, false);                                                        \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void par_classify_sl_##NAME(struct par_sais *ps, cstr_##NAME x, cstr_bit_vector *is_s)    \
+{                                                                                                \
+    int no_threads = cstr_par_no_threads(ps->pool);                                              \
+    struct classify_ctx_##NAME ctx = {                                                           \
+        .x = x, .is_s = is_s,                                                                    \
+        .run = cstr_malloc_buffer(sizeof *ctx.run, (size_t)no_threads),                          \
+        .fix = cstr_malloc_buffer(sizeof *ctx.fix, (size_t)no_threads)};                         \
+                                                                                                 \
+    cstr_par_run(ps->pool, (cstr_par_fn)classify_block_##NAME, &ctx);                            \
+                                                                                                 \
+    /* From right to left, we now know the type of the first position */                         \
+    /* in the next block, and thus if a block guessed wrong. The first */                        \
+    /* position in a block has the type we computed, unless the whole */                         \
+    /* block depended on the guess. */                                                           \
+    bool next_s = true;                                                                          \
+    for (int t = no_threads - 1; t >= 0; t--)                                                    \
+    {                                                                                            \
+        long long from, to;                                                                      \
+        cstr_par_range(x.len, t, no_threads, BV_WORD_BITS, &from, &to);                          \
+        ctx.fix[t] = ctx.run[t] < to && !next_s;                                                 \
+        if (from < to && ctx.run[t] != from)                                                     \
+        {                                                                                        \
+            next_s = cstr_bv_get(is_s, from);                                                    \
+        }                                                                                        \
+    }                                                                                            \
+                                                                                                 \
+    cstr_par_run(ps->pool, (cstr_par_fn)fix_block_##NAME, &ctx);                                 \
+                                                                                                 \
+    free(ctx.run);                                                                               \
+    free(ctx.fix);                                                                               \
+}                                                                                                \
+                                                                                                 \
+/* The bucket we induce into from SA entry v, in the L and the S scan, */                        \
+/* or UNDEF if v doesn't induce anything. */                                                     \
+static inline unsigned int induced_l_##NAME(cstr_##NAME x, cstr_bit_vector *is_s, unsigned int v) \
+{                                                                                                \
+    return (v == 0 || is_undef(v) || IS_S(v - 1)) ? UNDEF : x.buf[v - 1];                        \
+}                                                                                                \
+static inline unsigned int induced_s_##NAME(cstr_##NAME x, cstr_bit_vector *is_s, unsigned int v) \
+{                                                                                                \
+    return (v == 0 || is_undef(v) || IS_L(v - 1)) ? UNDEF : x.buf[v - 1];                        \
+}                                                                                                \
+                                                                                                 \
+struct induce_ctx_##NAME                                                                         \
+{                                                                                                \
+    cstr_##NAME x;                                                                               \
+    cstr_suffix_array sa;                                                                        \
+    cstr_bit_vector *is_s;                                                                       \
+    struct prepared *block;                                                                      \
+    long long from, to; /* the current block of sa */                                            \
+};                                                                                               \
+                                                                                                 \
+static void prepare_l_##NAME(struct induce_ctx_##NAME *ctx, int t, int no_threads)               \
+{                                                                                                \
+    long long from, to;                                                                          \
+    cstr_par_range(ctx->to - ctx->from, t, no_threads, 1, &from, &to);                           \
+    for (long long k = from; k < to; k++)                                                        \
+    {                                                                                            \
+        unsigned int v = ctx->sa.buf[ctx->from + k];                                             \
+        ctx->block[k] = (struct prepared){.sa = v, .c = induced_l_##NAME(ctx->x, ctx->is_s, v)}; \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void prepare_s_##NAME(struct induce_ctx_##NAME *ctx, int t, int no_threads)               \
+{                                                                                                \
+    long long from, to;                                                                          \
+    cstr_par_range(ctx->to - ctx->from, t, no_threads, 1, &from, &to);                           \
+    for (long long k = from; k < to; k++)                                                        \
+    {                                                                                            \
+        unsigned int v = ctx->sa.buf[ctx->from + k];                                             \
+        ctx->block[k] = (struct prepared){.sa = v, .c = induced_s_##NAME(ctx->x, ctx->is_s, v)}; \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void par_induce_l_##NAME(struct par_sais *ps, cstr_##NAME x, cstr_suffix_array sa,        \
+                         cstr_bit_vector *is_s, long long start[])                               \
+{                                                                                                \
+    struct induce_ctx_##NAME ctx = {.x = x, .sa = sa, .is_s = is_s, .block = ps->block};         \
+    for (ctx.from = 0; ctx.from < x.len; ctx.from = ctx.to)                                      \
+    {                                                                                            \
+        ctx.to = (ctx.from + PAR_BLOCK < x.len) ? ctx.from + PAR_BLOCK : x.len;                  \
+        cstr_par_run(ps->pool, (cstr_par_fn)prepare_l_##NAME, &ctx);                             \
+                                                                                                 \
+        for (long long i = ctx.from; i < ctx.to; i++)                                            \
+        {                                                                                        \
+            unsigned int v = sa.buf[i];                                                          \
+            struct prepared p = ctx.block[i - ctx.from];                                         \
+            unsigned int c = (v == p.sa) ? p.c : induced_l_##NAME(x, is_s, v);                   \
+            if (is_def(c))                                                                       \
+            {                                                                                    \
+                sa.buf[start[c]++] = v - 1;                                                      \
+            }                                                                                    \
+        }                                                                                        \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void par_induce_s_##NAME(struct par_sais *ps, cstr_##NAME x, cstr_suffix_array sa,        \
+                         cstr_bit_vector *is_s, long long end[])                                 \
+{                                                                                                \
+    /* Like induce_s, we scan from the right and never look at index 0 */                        \
+    struct induce_ctx_##NAME ctx = {.x = x, .sa = sa, .is_s = is_s, .block = ps->block};         \
+    for (ctx.to = x.len; ctx.to > 1; ctx.to = ctx.from)                                          \
+    {                                                                                            \
+        ctx.from = (ctx.to - PAR_BLOCK > 1) ? ctx.to - PAR_BLOCK : 1;                            \
+        cstr_par_run(ps->pool, (cstr_par_fn)prepare_s_##NAME, &ctx);                             \
+                                                                                                 \
+        for (long long i = ctx.to - 1; i >= ctx.from; i--)                                       \
+        {                                                                                        \
+            unsigned int v = sa.buf[i];                                                          \
+            struct prepared p = ctx.block[i - ctx.from];                                         \
+            unsigned int c = (v == p.sa) ? p.c : induced_s_##NAME(x, is_s, v);                   \
+            if (is_def(c))                                                                       \
+            {                                                                                    \
+                sa.buf[--end[c]] = v - 1;                                                        \
+            }                                                                                    \
+        }                                                                                        \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+struct name_ctx_##NAME                                                                           \
+{                                                                                                \
+    cstr_##NAME x;                                                                               \
+    cstr_bit_vector *is_s;                                                                       \
+    cstr_uislice compact, buffer;                                                                \
+    cstr_bit_vector *new_name; /* compact[i] gets a new name */                                  \
+    long long *counts;         /* new names per thread, later name offsets */                    \
+};                                                                                               \
+                                                                                                 \
+static void flag_new_names_##NAME(struct name_ctx_##NAME *ctx, int t, int no_threads)            \
+{                                                                                                \
+    long long from, to;                                                                          \
+    cstr_par_range(ctx->compact.len, t, no_threads, BV_WORD_BITS, &from, &to);                   \
+    long long count = 0;                                                                         \
+    for (long long i = from; i < to; i++)                                                        \
+    {                                                                                            \
+        bool new_name = i > 0 &&                                                                 \
+                        !equal_lms_strings(ctx->x, ctx->is_s,                                    \
+                                           ctx->compact.buf[i - 1], ctx->compact.buf[i]);        \
+        cstr_bv_set(ctx->new_name, i, new_name);                                                 \
+        count += new_name;                                                                       \
+    }                                                                                            \
+    ctx->counts[t] = count;                                                                      \
+}                                                                                                \
+                                                                                                 \
+static void assign_names_##NAME(struct name_ctx_##NAME *ctx, int t, int no_threads)              \
+{                                                                                                \
+    long long from, to;                                                                          \
+    cstr_par_range(ctx->compact.len, t, no_threads, BV_WORD_BITS, &from, &to);                   \
+    unsigned int name = (unsigned int)ctx->counts[t];                                            \
+    for (long long i = from; i < to; i++)                                                        \
+    {                                                                                            \
+        name += cstr_bv_get(ctx->new_name, i);                                                   \
+        ctx->buffer.buf[ctx->compact.buf[i] / 2] = name;                                         \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static cstr_uislice par_reduce_##NAME(struct par_sais *ps, cstr_##NAME x, cstr_suffix_array sa,  \
+                               cstr_bit_vector *is_s, cstr_uislice *compact, unsigned int *sigma) \
+{                                                                                                \
+    cstr_uislice buffer;                                                                         \
+    *compact = compact_lms(sa, is_s, &buffer);                                                   \
+    par_undefine(ps, buffer);                                                                    \
+                                                                                                 \
+    struct name_ctx_##NAME ctx = {                                                               \
+        .x = x, .is_s = is_s, .compact = *compact, .buffer = buffer,                             \
+        .new_name = cstr_new_bv(compact->len), .counts = ps->counts};                            \
+    cstr_par_run(ps->pool, (cstr_par_fn)flag_new_names_##NAME, &ctx);                            \
+                                                                                                 \
+    /* Turn the counts into the name before each thread's range */                               \
+    long long names = 0;                                                                         \
+    for (int t = 0; t < cstr_par_no_threads(ps->pool); t++)                                      \
+    {                                                                                            \
+        long long count = ctx.counts[t];                                                         \
+        ctx.counts[t] = names;                                                                   \
+        names += count;                                                                          \
+    }                                                                                            \
+    *sigma = (unsigned int)names + 1;                                                            \
+                                                                                                 \
+    cstr_par_run(ps->pool, (cstr_par_fn)assign_names_##NAME, &ctx);                              \
+    free(ctx.new_name);                                                                          \
+                                                                                                 \
+    return compact_defined(buffer);                                                              \
+}                                                                                                \
+                                                                                                 \
+static void par_reverse_u_##NAME(struct par_sais *ps,                                            \
+                          cstr_##NAME x,                                                         \
+                          cstr_suffix_array sa,                                                  \
+                          cstr_bit_vector *is_s,                                                 \
+                          cstr_const_uislice sa_u,                                               \
+                          cstr_uislice offsets,                                                  \
+                          long long ends[])                                                      \
+{                                                                                                \
+    long long k = collect_lms(x, is_s, offsets);                                                 \
+                                                                                                 \
+    /* sa_u is the first k entries of sa, but each thread only */                                \
+    /* reads the entries it writes, so we can gather in place. */                                \
+    struct gather_ctx ctx = {.sa = CSTR_PREFIX(sa, k), .sa_u = sa_u, .offsets = offsets};        \
+    cstr_par_run(ps->pool, (cstr_par_fn)gather_lms, &ctx);                                       \
+    par_undefine(ps, CSTR_SUFFIX(sa, k));                                                        \
+                                                                                                 \
+    bucket_sorted_lms(x, sa, k, ends);                                                           \
+}                                                                                                \
+                                                                                                 \
+static void par_sais_rec_##NAME(struct par_sais *ps, cstr_suffix_array sa,                       \
+                         cstr_##NAME x, cstr_bit_vector *is_s,                                   \
+                         unsigned int sigma)                                                     \
+{                                                                                                \
+    if (x.len < PAR_MIN_LEN)                                                                     \
+    {                                                                                            \
+        sais_rec(sa, x, is_s, sigma);                                                            \
+        return;                                                                                  \
+    }                                                                                            \
+                                                                                                 \
+    /* The same steps as sais_rec, see the comments there. */                                    \
+    long long *buckets = alloc_buckets(sigma);                                                   \
+    long long *buck_ptr = alloc_buckets(sigma);                                                  \
+    count_buckets(x, sigma, buckets);                                                            \
+    par_undefine(ps, sa);                                                                        \
+    par_classify_sl_##NAME(ps, x, is_s);                                                         \
+                                                                                                 \
+    init_buckets_end(sigma, buck_ptr, buckets);                                                  \
+    bucket_lms(x, sa, is_s, buck_ptr);                                                           \
+                                                                                                 \
+    init_buckets_start(sigma, buck_ptr, buckets);                                                \
+    par_induce_l_##NAME(ps, x, sa, is_s, buck_ptr);                                              \
+                                                                                                 \
+    init_buckets_end(sigma, buck_ptr, buckets);                                                  \
+    par_induce_s_##NAME(ps, x, sa, is_s, buck_ptr);                                              \
+                                                                                                 \
+    CSTR_FREE_NULL(buckets);                                                                     \
+    CSTR_FREE_NULL(buck_ptr);                                                                    \
+                                                                                                 \
+    unsigned int u_sigma;                                                                        \
+    cstr_uislice sa_u, u;                                                                        \
+    u = par_reduce_##NAME(ps, x, sa, is_s, &sa_u, &u_sigma);                                     \
+                                                                                                 \
+    if (u_sigma == u.len)                                                                        \
+    {                                                                                            \
+        sort_unique(sa_u, CSTR_SLICE_CONST_CAST(u));                                             \
+    }                                                                                            \
+    else                                                                                         \
+    {                                                                                            \
+        par_sais_rec_const_uislice(ps, sa_u, CSTR_SLICE_CONST_CAST(u), is_s, u_sigma);           \
+    }                                                                                            \
+                                                                                                 \
+    buckets = alloc_buckets(sigma);                                                              \
+    buck_ptr = alloc_buckets(sigma);                                                             \
+    count_buckets(x, sigma, buckets);                                                            \
+    par_classify_sl_##NAME(ps, x, is_s);                                                         \
+                                                                                                 \
+    init_buckets_end(sigma, buck_ptr, buckets);                                                  \
+    par_reverse_u_##NAME(ps, x, sa, is_s, CSTR_SLICE_CONST_CAST(sa_u), u, buck_ptr);             \
+                                                                                                 \
+    init_buckets_start(sigma, buck_ptr, buckets);                                                \
+    par_induce_l_##NAME(ps, x, sa, is_s, buck_ptr);                                              \
+                                                                                                 \
+    init_buckets_end(sigma, buck_ptr, buckets);                                                  \
+    par_induce_s_##NAME(ps, x, sa, is_s, buck_ptr);                                              \
+                                                                                                 \
+    CSTR_FREE_NULL(buckets);                                                                     \
+    CSTR_FREE_NULL(buck_ptr);                                                                    \
+}
+// clang-format on
 
-    init_buckets_start(sigma, buck_ptr, buckets);
-    induce_l(x, sa, is_s, buck_ptr);
+PAR_SAIS_GENERATOR(const_uislice)
+PAR_SAIS_GENERATOR(const_sslice)
 
-    init_buckets_end(sigma, buck_ptr, buckets);
-    induce_s(x, sa, is_s, buck_ptr);
+// clang-format off
+#define PAR_SAIS_DISPATCH(X, FUNC)        \
+    _Generic((X),                         \
+             cstr_const_sslice            \
+             : FUNC##_const_sslice,       \
+             cstr_const_uislice           \
+             : FUNC##_const_uislice)
+// clang-format on
+
+#define par_classify_sl(PS, X, ...) PAR_SAIS_DISPATCH(X, par_classify_sl)(PS, X, __VA_ARGS__)
+#define par_sais_rec(PS, SA, X, ...) PAR_SAIS_DISPATCH(X, par_sais_rec)(PS, SA, X, __VA_ARGS__)
 
-    CSTR_FREE_NULL(buckets);
-    CSTR_FREE_NULL(buck_ptr);
+static struct par_sais new_par_sais(int no_threads)
+{
+    struct par_sais ps = {.pool = cstr_new_par_pool(no_threads)};
+    ps.block = cstr_malloc_buffer(sizeof *ps.block, PAR_BLOCK);
+    ps.counts = cstr_malloc_buffer(sizeof *ps.counts, (size_t)cstr_par_no_threads(ps.pool));
+    return ps;
 }
 
-void cstr_sais(cstr_suffix_array sa, cstr_const_uislice x, cstr_alphabet *alpha)
+static void free_par_sais(struct par_sais *ps)
+{
+    free(ps->counts);
+    free(ps->block);
+    cstr_free_par_pool(ps->pool);
+}
+
+void cstr_sais_parallel(cstr_suffix_array sa, cstr_const_uislice x,
+                        cstr_alphabet *alpha, int no_threads)
 {
+    if (no_threads <= 1)
+    {
+        // The buffering only costs us if no one shares the work
+        cstr_sais(sa, x, alpha);
+        return;
+    }
+
+    struct par_sais ps = new_par_sais(no_threads);
     cstr_bit_vector *is_s = cstr_new_bv(x.len);
-    sais_rec(sa, x, is_s, alpha->size);
+    par_sais_rec(&ps, sa, x, is_s, alpha->size);
+    free(is_s);
+    free_par_sais(&ps);
+}
+
+void cstr_sais_parallel_sslice(cstr_suffix_array sa, cstr_const_sslice x,
+                               cstr_alphabet *alpha, int no_threads)
+{
+    if (no_threads <= 1)
+    {
+        cstr_sais_sslice(sa, x, alpha);
+        return;
+    }
+
+    struct par_sais ps = new_par_sais(no_threads);
+    cstr_bit_vector *is_s = cstr_new_bv(x.len);
+    par_sais_rec(&ps, sa, x, is_s, alpha->size);
     free(is_s);
+    free_par_sais(&ps);
 }
 
 #ifdef GEN_UNIT_TESTS // unit testing of static functions...
@@ -472,6 +1103,51 @@ TL_TEST(sais_classify_sl_random)
     TL_END();
 }
 
+TL_TEST(sais_par_classify_sl)
+{
+    TL_BEGIN();
+
+    // Runs that cross and cover the 64-bit blocks the threads get,
+    // so the guessed types at block ends are sometimes wrong.
+    const long long n = 1000;
+    cstr_uislice *x_buf = cstr_alloc_uislice(n);
+    cstr_const_uislice x = CSTR_SLICE_CONST_CAST(*x_buf);
+    cstr_bit_vector *expected = cstr_new_bv(n);
+    cstr_bit_vector *observed = cstr_new_bv(n);
+
+    for (int no_threads = 1; no_threads <= 5; no_threads++)
+    {
+        struct par_sais ps = {.pool = cstr_new_par_pool(no_threads)};
+        for (int k = 0; k < 20; k++)
+        {
+            for (long long i = 0, run = 0; i < n - 1; i++, run--)
+            {
+                if (run <= 0)
+                {
+                    run = 1 + rand() % 300;
+                    x_buf->buf[i] = 1 + (unsigned int)(rand() % 3);
+                }
+                else
+                {
+                    x_buf->buf[i] = x_buf->buf[i - 1];
+                }
+            }
+            x_buf->buf[n - 1] = 0;
+
+            classify_sl(x, expected);
+            par_classify_sl(&ps, x, observed);
+            TL_ERROR_IF(!cstr_bv_eq(expected, observed));
+        }
+        cstr_free_par_pool(ps.pool);
+    }
+
+    free(expected);
+    free(observed);
+    free(x_buf);
+
+    TL_END();
+}
+
 TL_TEST(induce_mississippi)
 {
     TL_BEGIN();
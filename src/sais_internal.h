@@ -0,0 +1,18 @@
+#ifndef SAIS_INTERNAL_H
+#define SAIS_INTERNAL_H
+
+#include "cstr.h"
+
+// SA-IS on u, a string over 0, ..., sigma - 1 for any sigma, ending with
+// a unique sentinel 0. This is what constructions that reduce a string
+// to one over a larger alphabet use. We pack u into the narrowest type
+// that sigma fits in, in u's own buffer, so u is gone afterwards.
+void cstr_sais_reduced(cstr_suffix_array sa, cstr_uislice u, unsigned int sigma);
+
+// Sorts the positions in pos by the first limit characters of the suffixes
+// that start there, with the multikey quicksort cstr_sparse_sa uses, so
+// that no comparison looks further than limit characters. Positions whose
+// prefixes are equal end up in arbitrary order.
+void cstr_sort_prefixes(cstr_uislice pos, cstr_const_sslice x, long long limit);
+
+#endif // SAIS_INTERNAL_H
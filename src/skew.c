@@ -6,6 +6,7 @@
 
 #include <cstr.h>
 
+#include "parallel_internal.h"
 #include "unittests.h"
 
 // these calculations are only valid for n > 0. For n == 0, they are both
@@ -100,75 +101,209 @@ static void bucket_sort_with_buffers(cstr_const_uislice x,
     memcpy(idx.buf, buffer, (size_t)idx.len * sizeof(*buffer));
 }
 
-static void bucket_sort(cstr_const_uislice x,
+// MARK: Parallel passes
+//
+// With a thread pool, the bucket sorts and the merge are spread over the
+// threads. The sorts count letters per thread and then scatter, where
+// each thread starts in each bucket after the elements from the threads
+// before it, so the sort remains stable. The merge splits the output into
+// one range per thread and finds where each range starts in sa12 and sa3
+// with a binary search along the "merge path". Without a pool, or for short
+// input, we use the sequential code.
+
+#define PAR_MIN_LEN (1 << 14) // shorter input is sorted sequentially
+
+struct radix_ctx
+{
+    cstr_const_uislice x;
+    cstr_uislice idx;
+    unsigned int offset;
+    unsigned int asize;
+    unsigned int *counts; // asize for each thread
+    unsigned int *buffer;
+};
+
+static void radix_count(struct radix_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->idx.len, t, no_threads, 1, &from, &to);
+    unsigned int *counts = ctx->counts + (size_t)t * ctx->asize;
+    for (unsigned int a = 0; a < ctx->asize; a++)
+    {
+        counts[a] = 0;
+    }
+    for (long long i = from; i < to; i++)
+    {
+        counts[safe_idx(ctx->x, ctx->idx.buf[i] + ctx->offset)]++;
+    }
+}
+
+static void radix_scatter(struct radix_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->idx.len, t, no_threads, 1, &from, &to);
+    unsigned int *counts = ctx->counts + (size_t)t * ctx->asize;
+    for (long long i = from; i < to; i++)
+    {
+        unsigned int bucket = safe_idx(ctx->x, ctx->idx.buf[i] + ctx->offset);
+        ctx->buffer[counts[bucket]++] = ctx->idx.buf[i];
+    }
+}
+
+static void radix_copy(struct radix_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->idx.len, t, no_threads, 1, &from, &to);
+    memcpy(ctx->idx.buf + from, ctx->buffer + from, (size_t)(to - from) * sizeof *ctx->buffer);
+}
+
+static bool use_pool(cstr_par_pool *pool, long long n)
+{
+    return pool && cstr_par_no_threads(pool) > 1 && n >= PAR_MIN_LEN;
+}
+
+// counts must have room for asize entries per thread, and buffer for idx.len
+static void par_bucket_sort_with_buffers(cstr_par_pool *pool,
+                                         cstr_const_uislice x,
+                                         cstr_uislice idx,
+                                         unsigned int offset,
+                                         unsigned int asize,
+                                         unsigned int *restrict counts,
+                                         unsigned int *restrict buffer)
+{
+    // With a large alphabet, the prefix sum over all the threads' counts
+    // costs more than we save.
+    if (!use_pool(pool, idx.len) || asize > idx.len)
+    {
+        bucket_sort_with_buffers(x, idx, offset, asize, counts, buffer);
+        return;
+    }
+
+    int no_threads = cstr_par_no_threads(pool);
+    struct radix_ctx ctx = {.x = x, .idx = idx, .offset = offset, .asize = asize,
+                            .counts = counts, .buffer = buffer};
+    cstr_par_run(pool, (cstr_par_fn)radix_count, &ctx);
+    unsigned int acc = 0;
+    for (unsigned int a = 0; a < asize; a++)
+    {
+        for (int t = 0; t < no_threads; t++)
+        {
+            unsigned int k = counts[(size_t)t * asize + a];
+            counts[(size_t)t * asize + a] = acc;
+            acc += k;
+        }
+    }
+    cstr_par_run(pool, (cstr_par_fn)radix_scatter, &ctx);
+    cstr_par_run(pool, (cstr_par_fn)radix_copy, &ctx);
+}
+
+static unsigned int *alloc_counts(cstr_par_pool *pool, unsigned int asize)
+{
+    size_t no_threads = pool ? (size_t)cstr_par_no_threads(pool) : 1;
+    return cstr_malloc_buffer(sizeof(unsigned int), no_threads * asize);
+}
+
+static void bucket_sort(cstr_par_pool *pool,
+                        cstr_const_uislice x,
                         cstr_uislice idx,
                         unsigned int offset,
                         unsigned int asize)
 {
-    unsigned int *buckets = cstr_malloc((size_t)asize * sizeof *buckets);
+    unsigned int *counts = alloc_counts(pool, asize);
     unsigned int *buffer = cstr_malloc((size_t)idx.len * sizeof *buffer);
-    bucket_sort_with_buffers(x, idx, offset, asize, buckets, buffer);
+    par_bucket_sort_with_buffers(pool, x, idx, offset, asize, counts, buffer);
 
-    free(buckets);
+    free(counts);
     free(buffer);
 }
 
-static void radix3(cstr_const_uislice x, cstr_uislice idx, unsigned int asize)
+static void radix3(cstr_par_pool *pool, cstr_const_uislice x, cstr_uislice idx, unsigned int asize)
 {
-    unsigned int *buckets = cstr_malloc((size_t)asize * sizeof *buckets);
+    unsigned int *counts = alloc_counts(pool, asize);
     unsigned int *buffer = cstr_malloc((size_t)idx.len * sizeof *buffer);
 
-    bucket_sort_with_buffers(x, idx, 2, asize, buckets, buffer);
-    bucket_sort_with_buffers(x, idx, 1, asize, buckets, buffer);
-    bucket_sort_with_buffers(x, idx, 0, asize, buckets, buffer);
+    par_bucket_sort_with_buffers(pool, x, idx, 2, asize, counts, buffer);
+    par_bucket_sort_with_buffers(pool, x, idx, 1, asize, counts, buffer);
+    par_bucket_sort_with_buffers(pool, x, idx, 0, asize, counts, buffer);
 
-    free(buckets);
+    free(counts);
     free(buffer);
 }
 
+// Compare suffixes i and j, where at most one of them is in sa3. After
+// at most two steps, both are in sa12 and we can use their ranks.
 static bool less(cstr_const_uislice x,
                  unsigned int i, unsigned int j,
-                 unsigned int isa[])
+                 unsigned int const isa[])
 {
-    unsigned int a = safe_idx(x, i);
-    unsigned int b = safe_idx(x, j);
-
-    if (a < b)
-        return true;
-    if (a > b)
-        return false;
-    if (i % 3 != 0 && j % 3 != 0)
-        return isa[i] < isa[j];
+    for (;; i++, j++)
+    {
+        unsigned int a = safe_idx(x, i);
+        unsigned int b = safe_idx(x, j);
 
-    return less(x, i + 1, j + 1, isa);
+        if (a != b)
+            return a < b;
+        if (i % 3 != 0 && j % 3 != 0)
+            return isa[i] < isa[j];
+    }
 }
 
-static void merge(cstr_suffix_array sa,
-                  cstr_const_uislice x,
-                  cstr_suffix_array sa12,
-                  cstr_suffix_array sa3)
+struct merge_ctx
 {
-    // For the static analyser.
-    // We cannot have n==0 because of the sentinel, but the analyser
-    // is right that isa could be allocated with length zero, and that
-    // would be a potential problem later. It can't happen, though.
-    assert(x.len > 0);
-    assert(sa.buf && x.buf && sa12.buf && sa3.buf);
-
-    unsigned int *isa = cstr_malloc((size_t)x.len * sizeof *isa);
+    cstr_suffix_array sa;
+    cstr_const_uislice x;
+    cstr_suffix_array sa12;
+    cstr_suffix_array sa3;
+    unsigned int *isa;
+};
+
+// Without a map, the easiest solution for the inverse
+// suffix array is to use an array with the same
+// length as x.
+static void fill_isa(struct merge_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->sa12.len, t, no_threads, 1, &from, &to);
+    for (long long i = from; i < to; i++)
+    {
+        ctx->isa[ctx->sa12.buf[i]] = (unsigned int)i;
+    }
+}
 
-    // Without a map, the easiest solution for the inverse
-    // suffix array is to use an array with the same
-    // length as x.
-    for (unsigned int i = 0; i < sa12.len; i++)
+// The number of sa12 suffixes among the first k in the merged array
+static long long merge_split(struct merge_ctx *ctx, long long k)
+{
+    long long lo = k > ctx->sa3.len ? k - ctx->sa3.len : 0;
+    long long hi = k < ctx->sa12.len ? k : ctx->sa12.len;
+    while (lo < hi)
     {
-        isa[sa12.buf[i]] = i;
+        // If sa12[i] comes before sa3[k - i - 1], more than i of the
+        // first k suffixes are from sa12.
+        long long i = lo + (hi - lo) / 2;
+        if (less(ctx->x, ctx->sa12.buf[i], ctx->sa3.buf[k - i - 1], ctx->isa))
+        {
+            lo = i + 1;
+        }
+        else
+        {
+            hi = i;
+        }
     }
+    return lo;
+}
 
-    unsigned int i = 0, j = 0, k = 0;
-    while (i < sa12.len && j < sa3.len)
+static void merge_range(struct merge_ctx *ctx, int t, int no_threads)
+{
+    long long from, to;
+    cstr_par_range(ctx->sa.len, t, no_threads, 1, &from, &to);
+    long long i = merge_split(ctx, from), j = from - i;
+    long long i_end = merge_split(ctx, to), j_end = to - i_end;
+
+    cstr_suffix_array sa = ctx->sa, sa12 = ctx->sa12, sa3 = ctx->sa3;
+    long long k = from;
+    while (i < i_end && j < j_end)
     {
-        if (less(x, sa12.buf[i], sa3.buf[j], isa))
+        if (less(ctx->x, sa12.buf[i], sa3.buf[j], ctx->isa))
         {
             sa.buf[k++] = sa12.buf[i++];
         }
@@ -177,14 +312,42 @@ static void merge(cstr_suffix_array sa,
             sa.buf[k++] = sa3.buf[j++];
         }
     }
-    for (; i < sa12.len; i++)
+    for (; i < i_end; i++)
         sa.buf[k++] = sa12.buf[i];
-    for (; j < sa3.len; j++)
+    for (; j < j_end; j++)
         sa.buf[k++] = sa3.buf[j];
 
-    assert(k == x.len); // for the static analyser
+    assert(k == to); // for the static analyser
+}
+
+static void merge(cstr_par_pool *pool,
+                  cstr_suffix_array sa,
+                  cstr_const_uislice x,
+                  cstr_suffix_array sa12,
+                  cstr_suffix_array sa3)
+{
+    // For the static analyser.
+    // We cannot have n==0 because of the sentinel, but the analyser
+    // is right that isa could be allocated with length zero, and that
+    // would be a potential problem later. It can't happen, though.
+    assert(x.len > 0);
+    assert(sa.buf && x.buf && sa12.buf && sa3.buf);
+
+    struct merge_ctx ctx = {.sa = sa, .x = x, .sa12 = sa12, .sa3 = sa3,
+                            .isa = cstr_malloc((size_t)x.len * sizeof *ctx.isa)};
 
-    free(isa);
+    if (use_pool(pool, x.len))
+    {
+        cstr_par_run(pool, (cstr_par_fn)fill_isa, &ctx);
+        cstr_par_run(pool, (cstr_par_fn)merge_range, &ctx);
+    }
+    else
+    {
+        fill_isa(&ctx, 0, 1);
+        merge_range(&ctx, 0, 1);
+    }
+
+    free(ctx.isa);
 }
 
 static inline bool equal3(cstr_const_uislice x,
@@ -250,11 +413,13 @@ static void build_u(cstr_uislice u, unsigned int const encoding[])
     assert(k == u.len); // for the static analyser
 }
 
-static void skew_rec(cstr_suffix_array sa, cstr_const_uislice x, unsigned int asize)
+// pool is NULL for the sequential algorithm
+static void skew_rec(cstr_par_pool *pool, cstr_suffix_array sa, cstr_const_uislice x,
+                     unsigned int asize)
 {
     cstr_suffix_array *sa12 = cstr_alloc_uislice(sa12len(x.len));
     get_sa12(*sa12, x);
-    radix3(x, *sa12, asize);
+    radix3(pool, x, *sa12, asize);
 
     unsigned int *encoding = cstr_malloc((size_t)sa12->len * sizeof *encoding);
     unsigned int new_asize = build_alphabet(encoding, x, *sa12);
@@ -270,7 +435,7 @@ static void skew_rec(cstr_suffix_array sa, cstr_const_uislice x, unsigned int as
 
         cstr_suffix_array *u_sa = cstr_alloc_uislice(u->len);
 
-        skew_rec(*u_sa, CSTR_SLICE_CONST_CAST(*u), new_asize);
+        skew_rec(pool, *u_sa, CSTR_SLICE_CONST_CAST(*u), new_asize);
 
         unsigned int m = (unsigned int)(u_sa->len + 1) / 2;
         for (unsigned int i = 0; i < u_sa->len; i++)
@@ -285,9 +450,9 @@ static void skew_rec(cstr_suffix_array sa, cstr_const_uislice x, unsigned int as
     cstr_suffix_array *sa3 = cstr_alloc_uislice(sa3len(x.len));
     get_sa3(*sa3, *sa12, x);
 
-    bucket_sort(x, *sa3, /* offset */ 0, asize);
+    bucket_sort(pool, x, *sa3, /* offset */ 0, asize);
 
-    merge(sa, x, *sa12, *sa3);
+    merge(pool, sa, x, *sa12, *sa3);
 
     free(sa12);
     free(sa3);
@@ -299,7 +464,22 @@ void cstr_skew(cstr_suffix_array sa, cstr_const_uislice x, cstr_alphabet *alpha)
     // we need to store indices in int, so there is a limit to the
     // length.
     assert(x.len <= INT_MAX - 1);
-    skew_rec(sa, x, (unsigned int)alpha->size);
+    skew_rec(0, sa, x, (unsigned int)alpha->size);
+}
+
+void cstr_skew_parallel(cstr_suffix_array sa, cstr_const_uislice x,
+                        cstr_alphabet *alpha, int no_threads)
+{
+    if (no_threads <= 1)
+    {
+        cstr_skew(sa, x, alpha);
+        return;
+    }
+
+    assert(x.len <= INT_MAX - 1);
+    cstr_par_pool *pool = cstr_new_par_pool(no_threads);
+    skew_rec(pool, sa, x, (unsigned int)alpha->size);
+    cstr_free_par_pool(pool);
 }
 
 #ifdef GEN_UNIT_TESTS // unit testing of static functions...
@@ -0,0 +1,205 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cstr.h"
+#include "sais_internal.h"
+
+// Sparse suffix arrays, sorting only a sample of the suffixes and using
+// memory proportional to the sample, not to x.
+
+static inline uint8_t chr(cstr_const_sslice x, long long i)
+{
+    return (i < x.len) ? x.buf[i] : 0;
+}
+
+// MARK: Arbitrary positions
+
+// Multikey quicksort (Bentley and Sedgewick 1997) on the suffixes, where
+// all the suffixes in a[0..n) share their first depth characters. We
+// partition on the character at depth, recurse on the smaller and larger
+// parts, and continue one character deeper with the equal part. If that
+// character is the sentinel, the equal suffixes are the same suffix, so
+// we are done. We never look at characters at or beyond limit, so with a
+// limit we sort prefixes rather than suffixes.
+#define SPARSE_INSERTION_SORT 16
+
+static bool suffix_less(cstr_const_sslice x, long long i, long long j,
+                        long long depth, long long limit)
+{
+    while (depth < limit && chr(x, i + depth) == chr(x, j + depth) && chr(x, i + depth) != 0)
+    {
+        depth++;
+    }
+    return depth < limit && chr(x, i + depth) < chr(x, j + depth);
+}
+
+static inline void swap(unsigned int *a, long long i, long long j)
+{
+    unsigned int tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
+}
+
+static uint8_t median3(cstr_const_sslice x, unsigned int const *a, long long n, long long depth)
+{
+    uint8_t p = chr(x, a[0] + depth), q = chr(x, a[n / 2] + depth), r = chr(x, a[n - 1] + depth);
+    if (p > q)
+    {
+        uint8_t tmp = p;
+        p = q;
+        q = tmp;
+    }
+    return r < p ? p : (r > q ? q : r);
+}
+
+static void multikey_qsort(cstr_const_sslice x, unsigned int *a, long long n,
+                           long long depth, long long limit)
+{
+    while (n > SPARSE_INSERTION_SORT && depth < limit)
+    {
+        uint8_t pivot = median3(x, a, n, depth);
+
+        // Dutch flag: [0, lt) smaller, [lt, i) equal, [gt, n) larger
+        long long lt = 0, i = 0, gt = n;
+        while (i < gt)
+        {
+            uint8_t c = chr(x, a[i] + depth);
+            if (c < pivot)
+            {
+                swap(a, lt++, i++);
+            }
+            else if (c > pivot)
+            {
+                swap(a, i, --gt);
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        multikey_qsort(x, a, lt, depth, limit);
+        multikey_qsort(x, a + gt, n - gt, depth, limit);
+        if (pivot == 0)
+        {
+            return;
+        }
+        a += lt;
+        n = gt - lt;
+        depth++;
+    }
+
+    for (long long i = 1; i < n; i++)
+    {
+        unsigned int v = a[i];
+        long long j = i;
+        for (; j > 0 && suffix_less(x, v, a[j - 1], depth, limit); j--)
+        {
+            a[j] = a[j - 1];
+        }
+        a[j] = v;
+    }
+}
+
+void cstr_sparse_sa(cstr_suffix_array ssa, cstr_const_sslice x, cstr_const_uislice pos)
+{
+    assert(ssa.len == pos.len);
+    if (ssa.buf != pos.buf)
+    {
+        memcpy(ssa.buf, pos.buf, (size_t)pos.len * sizeof *ssa.buf);
+    }
+    multikey_qsort(x, ssa.buf, ssa.len, 0, LLONG_MAX);
+}
+
+void cstr_sort_prefixes(cstr_uislice pos, cstr_const_sslice x, long long limit)
+{
+    multikey_qsort(x, pos.buf, pos.len, 0, limit);
+}
+
+// MARK: Every k'th position
+
+// With evenly spaced samples, the suffix at i*k is the string of k-mers
+// x[i*k..(i+1)*k), x[(i+1)*k..(i+2)*k), ..., where we pad the last with
+// sentinels. Comparing two sampled suffixes is comparing those strings,
+// so we radix sort the k-mers, name them by rank, and build the suffix
+// array of the string of names.
+
+// LSD radix sort of the block indices in idx on the k characters, using tmp.
+static void sort_blocks(cstr_const_sslice x, long long k,
+                        unsigned int *idx, unsigned int *tmp, long long m)
+{
+    for (long long i = 0; i < m; i++)
+    {
+        idx[i] = (unsigned int)i;
+    }
+    for (long long d = k - 1; d >= 0; d--)
+    {
+        long long start[CSTR_MAX_ALPHABET_SIZE + 1] = {0};
+        for (long long i = 0; i < m; i++)
+        {
+            start[chr(x, i * k + d) + 1]++;
+        }
+        for (int a = 1; a <= CSTR_MAX_ALPHABET_SIZE; a++)
+        {
+            start[a] += start[a - 1];
+        }
+        for (long long i = 0; i < m; i++)
+        {
+            tmp[start[chr(x, idx[i] * k + d)]++] = idx[i];
+        }
+        memcpy(idx, tmp, (size_t)m * sizeof *idx);
+    }
+}
+
+static bool equal_blocks(cstr_const_sslice x, long long k, long long i, long long j)
+{
+    for (long long d = 0; d < k; d++)
+    {
+        if (chr(x, i * k + d) != chr(x, j * k + d))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void cstr_sparse_sa_every(cstr_suffix_array ssa, cstr_const_sslice x, long long k)
+{
+    long long m = (x.len + k - 1) / k;
+    assert(ssa.len == m);
+    if (m == 0)
+    {
+        return;
+    }
+
+    // Sort the blocks in ssa, then name them in u, with the names
+    // starting at one so we can add a sentinel.
+    unsigned int *tmp = cstr_malloc_buffer(sizeof *tmp, (size_t)m);
+    sort_blocks(x, k, ssa.buf, tmp, m);
+    free(tmp);
+
+    cstr_uislice *u = cstr_alloc_uislice(m + 1);
+    unsigned int name = 1;
+    u->buf[ssa.buf[0]] = name;
+    for (long long i = 1; i < m; i++)
+    {
+        if (!equal_blocks(x, k, ssa.buf[i - 1], ssa.buf[i]))
+        {
+            name++;
+        }
+        u->buf[ssa.buf[i]] = name;
+    }
+    u->buf[m] = 0;
+
+    // The sentinel suffix comes first in the reduced suffix array
+    cstr_suffix_array *sa_u = cstr_alloc_uislice(m + 1);
+    cstr_sais_reduced(*sa_u, *u, name + 1);
+    for (long long i = 0; i < m; i++)
+    {
+        ssa.buf[i] = (unsigned int)(sa_u->buf[i + 1] * k);
+    }
+
+    free(sa_u);
+    free(u);
+}
@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cstr.h"
+#include "sa_file_internal.h"
+#include "st_file_internal.h"
+
+// The file is a fixed-size header followed by the flattened tree (see
+// st_file_internal.h) and the string, each section at an offset the
+// header gives us. Sections start at multiples of eight and the first at a
+// page boundary, so when we map the file the arrays are aligned and we
+// search them where they are. As for suffix array files, we don't convert
+// between byte orders; a file from a different machine is rejected.
+#define ST_FILE_MAGIC "CSTR-ST"
+#define ST_FILE_VERSION 1
+#define ST_FILE_BYTE_ORDER 0x01020304U
+#define ST_FILE_PAYLOAD_OFFSET 4096
+#define ST_FILE_ALIGN 8
+
+enum st_section
+{
+    NODES,
+    LEAVES,
+    CHILD_REFS,
+    CHILD_LETTERS,
+    STRING,
+    NO_SECTIONS
+};
+
+struct st_file_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // ST_FILE_BYTE_ORDER as the writer stored it
+    uint32_t alpha_size;
+    uint32_t node_size; // sizeof(struct st_flat_node) on the writer
+    uint64_t n;
+    uint64_t no_nodes;
+    uint64_t no_children;
+    uint64_t offset[NO_SECTIONS];
+    uint64_t size;     // of the whole file
+    uint64_t checksum; // of the sections, see cstr_file_checksum
+    uint16_t map[CSTR_MAX_ALPHABET_SIZE];
+    uint16_t revmap[CSTR_MAX_ALPHABET_SIZE];
+};
+static_assert(sizeof(struct st_file_header) <= ST_FILE_PAYLOAD_OFFSET, "Header must fit before the payload");
+
+// The sections' lengths in bytes
+static void section_sizes(uint64_t sizes[NO_SECTIONS], uint64_t n, uint64_t no_nodes, uint64_t no_children)
+{
+    sizes[NODES] = no_nodes * sizeof(struct st_flat_node);
+    sizes[LEAVES] = n * sizeof(uint32_t);
+    sizes[CHILD_REFS] = no_children * sizeof(uint32_t);
+    sizes[CHILD_LETTERS] = no_children * sizeof(uint8_t);
+    sizes[STRING] = n * sizeof(uint8_t);
+}
+
+// MARK: Writing
+
+static bool write_padding(FILE *f, uint64_t *pos, uint64_t to)
+{
+    static const char zeros[ST_FILE_PAYLOAD_OFFSET] = {0};
+    assert(to >= *pos && to - *pos <= sizeof zeros);
+    size_t len = (size_t)(to - *pos);
+    *pos = to;
+    return len == 0 || fwrite(zeros, 1, len, f) == len;
+}
+
+bool cstr_write_suffix_tree(const char *fname, cstr_suffix_tree *st)
+{
+    struct st_flat flat;
+    cstr_st_flatten(st, &flat);
+    uint64_t n = (uint64_t)flat.x.len;
+    void const *data[NO_SECTIONS] = {
+        [NODES] = flat.nodes,
+        [LEAVES] = flat.leaves,
+        [CHILD_REFS] = flat.child_refs,
+        [CHILD_LETTERS] = flat.child_letters,
+        [STRING] = flat.x.buf,
+    };
+
+    struct st_file_header hdr;
+    memset(&hdr, 0, sizeof hdr);
+    memcpy(hdr.magic, ST_FILE_MAGIC, sizeof hdr.magic);
+    hdr.version = ST_FILE_VERSION;
+    hdr.byte_order = ST_FILE_BYTE_ORDER;
+    hdr.alpha_size = flat.alpha->size;
+    hdr.node_size = sizeof(struct st_flat_node);
+    hdr.n = n;
+    hdr.no_nodes = (uint64_t)flat.no_nodes;
+    hdr.no_children = (uint64_t)flat.no_children;
+    memcpy(hdr.map, flat.alpha->map, sizeof hdr.map);
+    memcpy(hdr.revmap, flat.alpha->revmap, sizeof hdr.revmap);
+
+    uint64_t sizes[NO_SECTIONS];
+    section_sizes(sizes, hdr.n, hdr.no_nodes, hdr.no_children);
+    uint64_t pos = ST_FILE_PAYLOAD_OFFSET;
+    hdr.checksum = CSTR_FILE_CHECKSUM_INIT;
+    for (int s = 0; s < NO_SECTIONS; s++)
+    {
+        hdr.offset[s] = pos;
+        pos = (pos + sizes[s] + ST_FILE_ALIGN - 1) / ST_FILE_ALIGN * ST_FILE_ALIGN;
+        hdr.checksum = cstr_file_checksum(hdr.checksum, data[s], (size_t)sizes[s]);
+    }
+    hdr.size = hdr.offset[STRING] + sizes[STRING];
+
+    bool ok = false;
+    FILE *f = fopen(fname, "wb");
+    if (f)
+    {
+        pos = 0;
+        ok = fwrite(&hdr, sizeof hdr, 1, f) == 1;
+        pos += sizeof hdr;
+        for (int s = 0; ok && s < NO_SECTIONS; s++)
+        {
+            ok = write_padding(f, &pos, hdr.offset[s]) &&
+                 fwrite(data[s], 1, (size_t)sizes[s], f) == (size_t)sizes[s];
+            pos += sizes[s];
+        }
+        ok = (fclose(f) == 0) && ok;
+    }
+
+    cstr_free_st_flat(&flat);
+    return ok;
+}
+
+// MARK: Loading
+
+struct cstr_st_file
+{
+    cstr_file_view view; // the whole file
+    cstr_alphabet alpha;
+    cstr_const_sslice x;
+    uint64_t no_nodes, no_children;
+    struct st_flat_node const *nodes;
+    uint32_t const *leaves;
+    uint32_t const *child_refs;
+    uint8_t const *child_letters;
+};
+
+static bool valid_header(struct st_file_header const *hdr, size_t size)
+{
+    if (memcmp(hdr->magic, ST_FILE_MAGIC, sizeof hdr->magic) != 0 ||
+        hdr->version != ST_FILE_VERSION ||
+        hdr->byte_order != ST_FILE_BYTE_ORDER ||
+        hdr->node_size != sizeof(struct st_flat_node) ||
+        hdr->alpha_size > CSTR_MAX_ALPHABET_SIZE ||
+        hdr->size != size ||
+        // A tree has a root and at least the sentinel leaf, every node but
+        // the root is a child, and the leaves are numbered in 31 bits
+        hdr->n == 0 || hdr->n >= ST_FLAT_LEAF ||
+        hdr->no_nodes == 0 || hdr->no_nodes > hdr->n ||
+        hdr->no_children != hdr->no_nodes + hdr->n - 1)
+    {
+        return false;
+    }
+
+    uint64_t sizes[NO_SECTIONS];
+    section_sizes(sizes, hdr->n, hdr->no_nodes, hdr->no_children);
+    for (int s = 0; s < NO_SECTIONS; s++)
+    {
+        if (hdr->offset[s] < ST_FILE_PAYLOAD_OFFSET ||
+            hdr->offset[s] % ST_FILE_ALIGN != 0 ||
+            hdr->offset[s] > size || sizes[s] > size - hdr->offset[s])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint64_t sections_checksum(struct st_file_header const *hdr, char const *data)
+{
+    uint64_t sizes[NO_SECTIONS];
+    section_sizes(sizes, hdr->n, hdr->no_nodes, hdr->no_children);
+    uint64_t h = CSTR_FILE_CHECKSUM_INIT;
+    for (int s = 0; s < NO_SECTIONS; s++)
+    {
+        h = cstr_file_checksum(h, data + hdr->offset[s], (size_t)sizes[s]);
+    }
+    return h;
+}
+
+cstr_st_file *cstr_load_suffix_tree(const char *fname, bool verify)
+{
+    cstr_st_file *file = cstr_malloc(sizeof *file);
+    if (!cstr_open_file_view(&file->view, fname))
+    {
+        free(file);
+        return 0;
+    }
+
+    struct st_file_header hdr;
+    char const *data = file->view.data;
+    if (file->view.size < ST_FILE_PAYLOAD_OFFSET)
+    {
+        goto error;
+    }
+    memcpy(&hdr, data, sizeof hdr);
+    if (!valid_header(&hdr, file->view.size) ||
+        (verify && sections_checksum(&hdr, data) != hdr.checksum))
+    {
+        goto error;
+    }
+
+    file->nodes = (struct st_flat_node const *)(void const *)(data + hdr.offset[NODES]);
+    file->leaves = (uint32_t const *)(void const *)(data + hdr.offset[LEAVES]);
+    file->child_refs = (uint32_t const *)(void const *)(data + hdr.offset[CHILD_REFS]);
+    file->child_letters = (uint8_t const *)(data + hdr.offset[CHILD_LETTERS]);
+    file->x = CSTR_SLICE((uint8_t const *)(data + hdr.offset[STRING]), (long long)hdr.n);
+    file->no_nodes = hdr.no_nodes;
+    file->no_children = hdr.no_children;
+    file->alpha.size = hdr.alpha_size;
+    memcpy(file->alpha.map, hdr.map, sizeof hdr.map);
+    memcpy(file->alpha.revmap, hdr.revmap, sizeof hdr.revmap);
+    return file;
+
+error:
+    cstr_close_file_view(&file->view);
+    free(file);
+    return 0;
+}
+
+void cstr_free_st_file(cstr_st_file *file)
+{
+    cstr_close_file_view(&file->view);
+    free(file);
+}
+
+cstr_alphabet const *cstr_st_file_alphabet(cstr_st_file const *file)
+{
+    return &file->alpha;
+}
+
+cstr_const_sslice cstr_st_file_string(cstr_st_file const *file)
+{
+    return file->x;
+}
+
+// MARK: Searching
+//
+// Without verify, nothing but the header is checked when we load, so the
+// sections can hold anything. We check every index we follow before we
+// use it, which costs a few compares per node. A search through a broken
+// tree can give wrong answers, but it never reads outside the file.
+
+// The child of v on letter a, or false if there isn't one. The children
+// are sorted by letter, so we can stop when we pass a.
+static bool find_child(cstr_st_file const *file, struct st_flat_node const *v, uint8_t a, uint32_t *child)
+{
+    if ((uint64_t)v->children + v->no_children > file->no_children)
+    {
+        return false;
+    }
+    uint8_t const *letters = file->child_letters + v->children;
+    for (uint32_t k = 0; k < v->no_children && letters[k] <= a; k++)
+    {
+        if (letters[k] == a)
+        {
+            *child = file->child_refs[v->children + k];
+            return true;
+        }
+    }
+    return false;
+}
+
+// A node whose leaves are in the file, or null if there isn't one
+static struct st_flat_node const *get_node(cstr_st_file const *file, uint32_t v)
+{
+    struct st_flat_node const *node = v < file->no_nodes ? &file->nodes[v] : 0;
+    return (node && node->lo < node->hi && node->hi <= file->x.len) ? node : 0;
+}
+
+// The leaves [*lo, *hi) below where p ends in the tree, if p is in it
+static bool locate(cstr_st_file const *file, cstr_const_sslice p, uint32_t *lo, uint32_t *hi)
+{
+    struct st_flat_node const *v = get_node(file, 0);
+    if (!v)
+    {
+        return false;
+    }
+    *lo = v->lo;
+    *hi = v->hi;
+    for (long long d = 0; d < p.len;)
+    {
+        uint32_t child;
+        if (!v || !find_child(file, v, p.buf[d], &child))
+        {
+            return false; // At a leaf, or no edge to continue along
+        }
+
+        long long s, depth;
+        if (child & ST_FLAT_LEAF)
+        {
+            *lo = child & ~ST_FLAT_LEAF;
+            *hi = *lo + 1;
+            if (*lo >= file->x.len)
+            {
+                return false;
+            }
+            s = file->leaves[*lo];
+            depth = file->x.len - s;
+            v = 0;
+        }
+        else
+        {
+            v = get_node(file, child);
+            if (!v)
+            {
+                return false;
+            }
+            *lo = v->lo;
+            *hi = v->hi;
+            s = file->leaves[v->lo]; // Any suffix below will do
+            depth = v->depth;
+        }
+
+        // The edge is x[s + d, s + depth), and we already matched its first
+        // letter. In a sound tree it is a non-empty edge inside x.
+        if (s >= file->x.len || depth <= d || depth > file->x.len - s)
+        {
+            return false;
+        }
+        long long end = depth < p.len ? depth : p.len;
+        if (memcmp(file->x.buf + s + d + 1, p.buf + d + 1, (size_t)(end - d - 1)) != 0)
+        {
+            return false;
+        }
+        d = end;
+    }
+    return true;
+}
+
+struct st_file_matcher
+{
+    cstr_exact_matcher matcher;
+    uint32_t const *leaves;
+    uint32_t next, end;
+};
+
+static long long st_file_next(struct st_file_matcher *m)
+{
+    return (m->next < m->end) ? (long long)m->leaves[m->next++] : -1;
+}
+
+typedef long long (*next_f)(cstr_exact_matcher *);
+typedef void (*free_f)(cstr_exact_matcher *);
+static cstr_exact_matcher_vtab st_file_vtab = {.next = (next_f)st_file_next, .free = (free_f)free};
+
+static cstr_exact_matcher *leaf_matcher(cstr_st_file const *file, uint32_t lo, uint32_t hi)
+{
+    struct st_file_matcher *m = cstr_malloc(sizeof *m);
+    m->matcher.vtab = &st_file_vtab;
+    m->leaves = file->leaves;
+    m->next = lo;
+    m->end = hi;
+    return (cstr_exact_matcher *)m;
+}
+
+cstr_exact_matcher *cstr_st_file_search(cstr_st_file const *file, cstr_const_sslice p)
+{
+    uint32_t lo, hi;
+    if (!locate(file, p, &lo, &hi))
+    {
+        lo = hi = 0;
+    }
+    return leaf_matcher(file, lo, hi);
+}
+
+cstr_exact_matcher *cstr_st_file_search_map(cstr_st_file const *file, cstr_const_sslice p)
+{
+    cstr_exact_matcher *m = 0;
+    cstr_sslice *p_buf = cstr_alloc_sslice(p.len);
+    if (cstr_alphabet_map(*p_buf, p, &file->alpha))
+    {
+        m = cstr_st_file_search(file, CSTR_SLICE_CONST_CAST(*p_buf));
+    }
+    else
+    {
+        m = leaf_matcher(file, 0, 0); // no map means no match
+    }
+    free(p_buf);
+    return m;
+}
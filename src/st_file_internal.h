@@ -0,0 +1,37 @@
+#ifndef ST_FILE_INTERNAL_H
+#define ST_FILE_INTERNAL_H
+
+#include "cstr.h"
+
+// A suffix tree laid out flat, in depth-first order, with indices instead
+// of pointers, as we store it in files. The leaves are just their suffixes
+// in the order we see them, which is the suffix array, so the leaves below
+// an inner node are an interval of them. The children of an inner node
+// are a run in the child arrays, in the order of their first letters. A
+// child is an inner node's index, or a leaf's rank with ST_FLAT_LEAF set.
+// Node 0 is the root.
+#define ST_FLAT_LEAF ((uint32_t)1 << 31)
+
+struct st_flat_node
+{
+    uint32_t depth;  // string depth
+    uint32_t lo, hi; // the leaves below are leaves[lo, hi)
+    uint32_t children, no_children;
+};
+
+struct st_flat
+{
+    cstr_alphabet const *alpha;
+    cstr_const_sslice x;
+    long long no_nodes, no_children;
+    struct st_flat_node *nodes;
+    uint32_t *leaves; // x.len of them
+    uint32_t *child_refs;
+    uint8_t *child_letters;
+};
+
+// Flattens a complete tree. Free the arrays with cstr_free_st_flat.
+void cstr_st_flatten(cstr_suffix_tree *st, struct st_flat *flat);
+void cstr_free_st_flat(struct st_flat *flat);
+
+#endif // ST_FILE_INTERNAL_H
@@ -59,22 +59,415 @@ static long long next_match(sa_matcher *m)
 typedef long long (*next_f)(cstr_exact_matcher *);
 typedef void (*free_f)(cstr_exact_matcher *);
 static cstr_exact_matcher_vtab sa_matcher_vtab = {.next = (next_f)next_match, .free = (free_f)free};
-cstr_exact_matcher *cstr_sa_bsearch(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_sslice p)
+// Narrows [lo, hi), where the suffixes all start with the first
+// offset characters of p, down to the suffixes that start with p.
+static cstr_exact_matcher *sa_search_from(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_sslice p,
+                                          long long lo, long long hi, long long offset)
 {
     sa_matcher *m = cstr_malloc(sizeof *m);
     m->matcher = (cstr_exact_matcher){.vtab = &sa_matcher_vtab};
     m->sa = sa;
-    m->next = 0;
-    m->end = sa.len;
+    m->next = lo;
+    m->end = hi;
 
-    for (long long i = 0, offset = 0; i < p.len; i++)
+    for (long long i = offset; i < p.len && m->next < m->end; i++)
     {
         update_block(&m->next, &m->end, &offset, p.buf[i], x, sa);
-        if (m->next == m->end)
+    }
+
+    return (cstr_exact_matcher *)m;
+}
+
+cstr_exact_matcher *cstr_sa_bsearch(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_sslice p)
+{
+    return sa_search_from(sa, x, p, 0, sa.len, 0);
+}
+
+cstr_exact_matcher *cstr_sa_kmer_search(cstr_suffix_array sa, cstr_const_sslice x,
+                                        cstr_kmer_table const *tab, cstr_const_sslice p)
+{
+    long long lo, hi;
+    long long depth = cstr_kmer_table_lookup(tab, p, &lo, &hi);
+    return sa_search_from(sa, x, p, lo, hi, depth);
+}
+
+// MARK: Enhanced suffix array
+
+// We search with the invariant that the suffix at lo is to the left of
+// the boundary we are looking for and the suffix at hi to the right of it,
+// starting with the virtual positions lo = -1 and hi = n. Each midpoint m
+// then comes from exactly one (lo, hi) pair, so we can store the longest
+// common prefix of m with lo and hi at m (Manber and Myers 1993). The
+// virtual boundaries share no prefix with anything.
+struct lcp_lr
+{
+    unsigned int left;  // lcp of the suffixes at lo and m
+    unsigned int right; // lcp of the suffixes at m and hi
+};
+
+struct cstr_esa
+{
+    cstr_suffix_array sa;
+    cstr_const_sslice x;
+    struct lcp_lr lr[];
+};
+
+// Fills in lr for the midpoints between lo and hi and returns the smallest
+// LCP value in (lo, hi], which is the lcp of the suffixes at lo and hi.
+static unsigned int fill_lcp_lr(struct lcp_lr *lr, cstr_uislice lcp, long long lo, long long hi)
+{
+    if (hi - lo == 1)
+    {
+        return (lo < 0 || hi == lcp.len) ? 0 : lcp.buf[hi];
+    }
+    long long m = lo + (hi - lo) / 2;
+    unsigned int left = fill_lcp_lr(lr, lcp, lo, m);
+    unsigned int right = fill_lcp_lr(lr, lcp, m, hi);
+    lr[m] = (struct lcp_lr){.left = left, .right = right};
+    return left < right ? left : right;
+}
+
+cstr_esa *cstr_esa_preprocess(cstr_suffix_array sa, cstr_const_sslice x)
+{
+    cstr_esa *esa = CSTR_MALLOC_FLEX_ARRAY(esa, lr, (size_t)sa.len);
+    esa->sa = sa;
+    esa->x = x;
+    if (sa.len > 0)
+    {
+        cstr_uislice *lcp = cstr_alloc_uislice(sa.len);
+        cstr_lcp_kasai(*lcp, sa, x);
+        fill_lcp_lr(esa->lr, *lcp, -1, sa.len);
+        free(lcp);
+    }
+    return esa;
+}
+
+void cstr_free_esa(cstr_esa *esa)
+{
+    free(esa);
+}
+
+// Finds the first suffix that is not smaller than p or, with upper, the
+// first that is larger than p and doesn't have it as a prefix. We know
+// that the suffix at lo shares l characters with p and the one at hi
+// shares r. If l >= r and the lcp of lo and m is different from l, we know
+// which side m is on without looking at it: if it is larger, m agrees
+// with lo, which is smaller than p, on the first mismatch, and if it is
+// smaller, m has a character there larger than p's. The same goes for
+// r > l, the other way around. Otherwise we compare from max(l, r), and
+// since neither ever decreases, we look at each character of p at most
+// once plus once per step.
+static long long esa_bound(cstr_esa const *esa, cstr_const_sslice p, bool upper)
+{
+    long long lo = -1, hi = esa->sa.len;
+    long long l = 0, r = 0;
+    while (hi - lo > 1)
+    {
+        long long m = lo + (hi - lo) / 2;
+        struct lcp_lr lr = esa->lr[m];
+        long long k;
+        if (l >= r)
+        {
+            if (lr.left > l)
+            {
+                lo = m;
+                continue;
+            }
+            if (lr.left < l)
+            {
+                hi = m;
+                r = lr.left;
+                continue;
+            }
+            k = l;
+        }
+        else
         {
-            break;
+            if (lr.right > r)
+            {
+                hi = m;
+                continue;
+            }
+            if (lr.right < r)
+            {
+                lo = m;
+                l = lr.right;
+                continue;
+            }
+            k = r;
+        }
+
+        long long offset = esa->sa.buf[m];
+        while (k < p.len && sentinel_idx(esa->x, offset + k) == p.buf[k])
+        {
+            k++;
+        }
+        bool right_of_m = (k == p.len) ? upper : sentinel_idx(esa->x, offset + k) < p.buf[k];
+        if (right_of_m)
+        {
+            lo = m;
+            l = k;
+        }
+        else
+        {
+            hi = m;
+            r = k;
         }
     }
+    return hi;
+}
 
+cstr_exact_matcher *cstr_esa_search(cstr_esa const *esa, cstr_const_sslice p)
+{
+    sa_matcher *m = cstr_malloc(sizeof *m);
+    m->matcher = (cstr_exact_matcher){.vtab = &sa_matcher_vtab};
+    m->sa = esa->sa;
+    m->next = esa_bound(esa, p, false);
+    m->end = esa_bound(esa, p, true);
     return (cstr_exact_matcher *)m;
 }
+
+// MARK: Batch search
+
+// We sort the patterns with an MSD radix sort on their bytes. A pattern
+// that ends goes before those that continue, in bucket zero. We recurse
+// on all buckets but the largest and loop on that one, so the recursion
+// depth stays logarithmic even when the batch has many duplicates.
+// Small groups we insertion sort.
+#define BATCH_INSERTION_SORT 16
+
+static inline bool pattern_less(cstr_const_sslice a, cstr_const_sslice b, long long depth)
+{
+    cstr_const_sslice x = CSTR_SUFFIX(a, depth), y = CSTR_SUFFIX(b, depth);
+    long long l = cstr_lcp_const_sslice(x, y);
+    return l < y.len && (l == x.len || x.buf[l] < y.buf[l]);
+}
+
+static inline int pattern_key(cstr_const_sslice p, long long depth)
+{
+    return depth < p.len ? 1 + p.buf[depth] : 0;
+}
+
+static void sort_patterns(long long *idx, long long *tmp, long long k,
+                          cstr_const_sslice const p[], long long depth)
+{
+    while (k > BATCH_INSERTION_SORT)
+    {
+        long long start[258] = {0};
+        for (long long i = 0; i < k; i++)
+        {
+            start[pattern_key(p[idx[i]], depth) + 1]++;
+        }
+        for (int b = 1; b < 258; b++)
+        {
+            start[b] += start[b - 1];
+        }
+        long long next[257];
+        memcpy(next, start, sizeof next);
+        for (long long i = 0; i < k; i++)
+        {
+            tmp[next[pattern_key(p[idx[i]], depth)]++] = idx[i];
+        }
+        memcpy(idx, tmp, (size_t)k * sizeof *idx);
+
+        // Bucket zero is sorted, as the patterns are equal.
+        int largest = 1;
+        for (int b = 1; b < 257; b++)
+        {
+            if (start[b + 1] - start[b] > start[largest + 1] - start[largest])
+            {
+                largest = b;
+            }
+        }
+        for (int b = 1; b < 257; b++)
+        {
+            if (b != largest && start[b + 1] - start[b] > 1)
+            {
+                sort_patterns(idx + start[b], tmp, start[b + 1] - start[b], p, depth + 1);
+            }
+        }
+        idx += start[largest];
+        k = start[largest + 1] - start[largest];
+        depth++;
+    }
+
+    for (long long i = 1; i < k; i++)
+    {
+        long long j = i, q = idx[i];
+        for (; j > 0 && pattern_less(p[q], p[idx[j - 1]], depth); j--)
+        {
+            idx[j] = idx[j - 1];
+        }
+        idx[j] = q;
+    }
+}
+
+// We walk through the patterns in sorted order and remember the interval
+// for each prefix of the previous pattern, ivs[d] for the first d
+// characters, as far as it was non-empty. The next pattern shares its
+// first l characters with the previous one, so it starts from ivs[l].
+void cstr_sa_batch_search(cstr_suffix_array sa, cstr_const_sslice x,
+                          long long k, cstr_const_sslice const p[k],
+                          cstr_sa_interval iv[k])
+{
+    if (k == 0)
+    {
+        return;
+    }
+
+    long long *idx = cstr_malloc_buffer(sizeof *idx, (size_t)k);
+    long long *tmp = cstr_malloc_buffer(sizeof *tmp, (size_t)k);
+    long long max_len = 0;
+    for (long long i = 0; i < k; i++)
+    {
+        idx[i] = i;
+        max_len = p[i].len > max_len ? p[i].len : max_len;
+    }
+    sort_patterns(idx, tmp, k, p, 0);
+    free(tmp);
+
+    cstr_sa_interval *ivs = cstr_malloc_buffer(sizeof *ivs, (size_t)max_len + 1);
+    ivs[0] = (cstr_sa_interval){.lo = 0, .hi = sa.len};
+    long long known = 0; // ivs[0..known] hold the previous pattern's intervals
+    cstr_const_sslice prev = CSTR_SLICE(p[idx[0]].buf, 0);
+    for (long long i = 0; i < k; i++)
+    {
+        cstr_const_sslice q = p[idx[i]];
+        long long d = cstr_lcp_const_sslice(prev, q);
+        d = d < known ? d : known;
+
+        long long lo = ivs[d].lo, hi = ivs[d].hi, offset = d;
+        for (; d < q.len && lo < hi; d++)
+        {
+            update_block(&lo, &hi, &offset, q.buf[d], x, sa);
+            ivs[d + 1] = (cstr_sa_interval){.lo = lo, .hi = hi};
+        }
+        known = d;
+        prev = q;
+        iv[idx[i]] = (cstr_sa_interval){.lo = lo, .hi = hi};
+    }
+
+    free(ivs);
+    free(idx);
+}
+
+// MARK: Sampled Eytzinger index
+
+// The first steps of a binary search hit a new cache line in sa and
+// another in x for every probe. We take every k'th suffix in sa, pack its
+// first SAMPLE_KEY_BYTES characters into an integer, most significant
+// first, so comparing keys is comparing prefixes, and lay the keys out
+// in Eytzinger order: the root at 1 and the children of i at 2i and 2i+1
+// (Khuong and Morin 2017). The top of the tree then shares a few cache
+// lines, and we can prefetch the great-grandchildren of a node while we
+// compare with it, since they are consecutive. They are 16 keys, which is
+// two cache lines when keys[16i] starts one, so we align the keys to
+// cache lines and prefetch both.
+#define SAMPLE_KEY_BYTES 8
+// 16 keys, four levels down
+#define EYTZINGER_PREFETCH 16
+#define CACHE_LINE_BYTES 64
+#define CACHE_LINE_KEYS (CACHE_LINE_BYTES / (long long)sizeof(uint64_t))
+
+struct cstr_sa_sample_index
+{
+    cstr_suffix_array sa;
+    cstr_const_sslice x;
+    long long k;
+    long long m;           // number of samples
+    unsigned int *sample;  // the sample's index in sorted order, by tree node
+    uint64_t *keys;        // 1-based, keys[0] is unused; cache aligned in buf
+    uint64_t buf[];
+};
+
+// The first SAMPLE_KEY_BYTES characters of s, padded with fill
+static uint64_t prefix_key(cstr_const_sslice s, uint8_t fill)
+{
+    uint64_t key = 0;
+    for (long long i = 0; i < SAMPLE_KEY_BYTES; i++)
+    {
+        key = (key << 8) | (i < s.len ? s.buf[i] : fill);
+    }
+    return key;
+}
+
+// Fills in the subtree at node with the samples from the j'th, in order,
+// and returns the index of the next sample.
+static long long fill_eytzinger(cstr_sa_sample_index *idx, long long node, long long j)
+{
+    if (node <= idx->m)
+    {
+        j = fill_eytzinger(idx, 2 * node, j);
+        idx->keys[node] = prefix_key(CSTR_SUFFIX(idx->x, idx->sa.buf[j * idx->k]), 0);
+        idx->sample[node] = (unsigned int)j++;
+        j = fill_eytzinger(idx, 2 * node + 1, j);
+    }
+    return j;
+}
+
+cstr_sa_sample_index *cstr_sa_sample_index_build(cstr_suffix_array sa, cstr_const_sslice x, long long k)
+{
+    if (k < 1)
+    {
+        return 0;
+    }
+    long long m = (sa.len + k - 1) / k;
+    cstr_sa_sample_index *idx = CSTR_MALLOC_FLEX_ARRAY(idx, buf, (size_t)(m + CACHE_LINE_KEYS));
+    uintptr_t misalign = (uintptr_t)idx->buf % CACHE_LINE_BYTES;
+    idx->keys = idx->buf + (misalign ? (CACHE_LINE_BYTES - misalign) / sizeof *idx->buf : 0);
+    idx->sa = sa;
+    idx->x = x;
+    idx->k = k;
+    idx->m = m;
+    idx->sample = cstr_malloc_buffer(sizeof *idx->sample, (size_t)m + 1);
+    fill_eytzinger(idx, 1, 0);
+    return idx;
+}
+
+void cstr_free_sa_sample_index(cstr_sa_sample_index *idx)
+{
+    free(idx->sample);
+    free(idx);
+}
+
+// The index of the first sample whose key is at least key, or m if there is none
+static long long first_sample_geq(cstr_sa_sample_index const *idx, uint64_t key)
+{
+    long long i = 1;
+    while (i <= idx->m)
+    {
+        if (EYTZINGER_PREFETCH * i <= idx->m)
+        {
+            CSTR_PREFETCH(idx->keys + EYTZINGER_PREFETCH * i);
+            CSTR_PREFETCH(idx->keys + EYTZINGER_PREFETCH * i + CACHE_LINE_KEYS);
+        }
+        i = 2 * i + (idx->keys[i] < key);
+    }
+    // We went right after the node we want and left ever since,
+    // so we strip the right turns and then that left turn.
+    while (i & 1)
+    {
+        i >>= 1;
+    }
+    i >>= 1;
+    return i == 0 ? idx->m : idx->sample[i];
+}
+
+// With q the first SAMPLE_KEY_BYTES characters of p (or all of them), a
+// sample whose key is smaller than q padded with zeros is smaller than p,
+// and one whose key is larger than q padded with 0xff doesn't start with q
+// and comes after p. The suffixes that start with p are between the last
+// sample of the first kind and the first of the second, which is less than
+// 2k suffixes more than the matches, and there we search as cstr_sa_bsearch.
+cstr_exact_matcher *cstr_sa_sample_index_search(cstr_sa_sample_index const *idx, cstr_const_sslice p)
+{
+    long long n = idx->sa.len, k = idx->k;
+    uint64_t lo_key = prefix_key(p, 0), hi_key = prefix_key(p, 0xff);
+
+    long long a = first_sample_geq(idx, lo_key);
+    long long lo = (a == 0) ? 0 : (a - 1) * k + 1;
+    long long b = (hi_key == UINT64_MAX) ? idx->m : first_sample_geq(idx, hi_key + 1);
+    long long hi = (b == idx->m) ? n : b * k;
+
+    return sa_search_from(idx->sa, idx->x, p, lo, hi, 0);
+}
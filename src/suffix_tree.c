@@ -1,204 +1,358 @@
 #include "cstr.h"
+#include "parallel_internal.h"
+#include "st_file_internal.h"
 #include "unittests.h"
 #include <stdalign.h>
 #include <stddef.h>
 #include <stdlib.h>
-#include <testlib.h>
-
-// We could put slices on the edges, but if we use ranges instead, we can encode
-// a leaf tag in the encoding of the range. Proper ranges will always have beg < end,
-// since we don't have empty edge labels outside of the root, and leaves will always
-// have edges that end at the end of the underlying string, so we can put the leaf label
-// in 'end' and recognise that we have a leaf if end >= beg, and in that case, the real
-// `end` should be st->x.len
-// clang-format off
-typedef struct
-{
-    // Always the beginning of the range
-    long long beg;
-    // But the end for internal nodes or the suffix index for leaves
-    union { long long end, leaf; };
-} range;
+#include <string.h>
+
+// Nodes refer to each other with 32-bit references instead of pointers, and
+// edges are 32-bit offsets into x, which halves the memory of the tree. The
+// leaves are an array with the leaf for suffix i at index i, so a leaf's
+// reference is its suffix, and we don't store that. Inner nodes live in a pool,
+// and their references are their index in the pool with the top bit set.
+// That bit is how we tell leaves from inner nodes, so x.len must be below
+// 2^31. That also leaves room for NO_NODE, since there are fewer than
+// x.len inner nodes. CSTR_ST_MAX_LEN keeps a margin below 2^31 for the
+// pool slots that the parallel construction reserves per thread.
+typedef uint32_t node_ref;
+#define INNER_TAG ((node_ref)1 << 31)
+#define NO_NODE UINT32_MAX
 
-static inline bool is_leaf_range(range r) { return r.end <= r.beg; }
+// clang-format off
+static inline bool is_leaf(node_ref v)  { return !(v & INNER_TAG); }
+static inline bool is_inner(node_ref v) { return !is_leaf(v); }
 // clang-format on
 
-// Putting SHARED at the top of both 'node' and 'inner_node' makes the
-// memory layout the same, so we can use them interchangable, except that
-// only inner_node will have the flexible array of children.
-// The parent/next union is used such that we have a parent when constructing
-// the tree (needed for McCreight) and a threaded tree when we want to
-// traverse the tree.
-#define SHARED                     \
-    range range;                   \
-    union                          \
-    {                              \
-        struct inner_node *parent; \
-        struct node *next;         \
-    };
+// The link is a parent when constructing the tree (needed for McCreight)
+// and a threaded tree when we want to traverse the tree.
+// A leaf's edge always runs to the end of x, so it only needs the beginning.
+typedef struct leaf_node
+{
+    uint32_t beg;
+    node_ref link;
+} leaf_node;
 
-// clang-format off
-typedef struct node       { SHARED } node;
-typedef struct inner_node { SHARED 
-    struct inner_node *slink; // suffix link (needed by McCreight) FIXME: union with the other pointers?
-    struct node *children[]; // children will be in a block of memory following the struct.
+typedef struct inner_node
+{
+    uint32_t beg, end;
+    node_ref link;
+    node_ref slink; // suffix link (needed by McCreight)
+    // children will be in a block of memory following the struct, in one
+    // of the two layouts below.
+    alignas(uint64_t) char children[];
 } inner_node;
 
-static inline bool is_leaf(node const *n)  { return is_leaf_range(n->range); }
-static inline bool is_inner(node const *n) { return !is_leaf(n); }
-// clang-format on
+// For small alphabets, the children are a dense array with a slot for
+// each letter, so we can look up a child directly. For large alphabets,
+// that is most of the memory in the tree, sigma references per node where
+// most are NO_NODE, so there we pack the children in an array sorted by the
+// first letter on their edges and keep a bit mask of the letters that
+// have a child. The child on letter a is then at the number of bits set
+// below a. The children array grows as we add children.
+#define DENSE_MAX_SIGMA 16
 
-// We use a pool (of sub-pools) to allocate inner nodes. We use sub-pools so we can grow
-// the pool without reallocating (and then moving) inner nodes. That way, we can have stable
-// pointers to our nodes. The sub-pools are a linked lists of blocks of nodes, where each
-// block is a contiguous chunk of memory storing the nodes.
+struct packed_children
+{
+    node_ref *buf;
+    unsigned int len, cap;
+    uint64_t mask[]; // (sigma + 63) / 64 words
+};
+
+// clang-format off
+static inline node_ref *dense_children(inner_node *n) { return (node_ref *)(void *)n->children; }
+static inline struct packed_children *packed_children(inner_node *n) { return (struct packed_children *)(void *)n->children; }
+// clang-format on
 
-static const size_t sub_pool_size = 256; // Number of nodes in a sub-pool
-struct sub_pool
+static inline int mask_words(long long sigma)
 {
-    // Link to next sub pool in the list.
-    struct sub_pool *next;
+    return (int)((sigma + 63) / 64);
+}
 
-    // The block of raw memory where we store the nodes.
-    // Alignned as an inner_node but of type char * so we can manipulate
-    // it as raw memory. We know how many there are (sub_pool_size), but
-    // their size depends on the alphabet, so we cannot allocate them
-    // statically.
-    alignas(struct inner_node) char node_blocks[];
-};
+static inline int popcount(uint64_t w)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(w);
+#else
+    int count = 0;
+    for (; w; w &= w - 1)
+    {
+        count++;
+    }
+    return count;
+#endif
+}
 
-struct inner_node_pool
+static inline bool has_child(struct packed_children const *c, uint8_t a)
 {
-    struct sub_pool *sub_pool; // Linked list of sub-pools
-    size_t block_size;         // The run-time size of an inner node
-    char *next;                // Pointer to the next free node
-    char *end;                 // End of allocated memory
-};
+    return (c->mask[a / 64] >> (a % 64)) & 1;
+}
 
-static void new_sub_pool(struct inner_node_pool *pool)
+// The index in buf where the child on letter a is, or would go
+static inline unsigned int child_rank(struct packed_children const *c, uint8_t a)
 {
-    struct sub_pool *sub_pool =
-        cstr_malloc_header_array(offsetof(struct sub_pool, node_blocks),
-                                 pool->block_size, sub_pool_size);
-    sub_pool->next = pool->sub_pool;
-    pool->sub_pool = sub_pool;
-    pool->next = &sub_pool->node_blocks[0];
-    pool->end = pool->next + pool->block_size * sub_pool_size;
+    unsigned int r = 0;
+    for (int w = 0; w < a / 64; w++)
+    {
+        r += (unsigned int)popcount(c->mask[w]);
+    }
+    uint64_t below = (UINT64_C(1) << (a % 64)) - 1;
+    return r + (unsigned int)popcount(c->mask[a / 64] & below);
 }
 
+// We use a pool (of sub-pools) to allocate inner nodes. We use sub-pools so we can grow
+// the pool without reallocating (and then moving) inner nodes. That way, we can have stable
+// pointers to our nodes. The sub-pools are blocks of nodes, where each block is a contiguous
+// chunk of memory storing the nodes, and we find node k in block k / SUB_POOL_SIZE.
+// We allocate a block when we first put a node in it. Usually that is
+// in order, but the parallel construction gives each thread its own range
+// of blocks, so there can be blocks we never allocate (they are NULL) and
+// partly used blocks in the middle.
+
+#define SUB_POOL_SIZE 256 // Number of nodes in a sub-pool
+
+struct inner_node_pool
+{
+    char **sub_pools;     // The blocks of raw memory where we store the nodes
+    size_t no_sub_pools;  // Number of sub-pools we have room for in the array
+    size_t cap;           // and room for
+    size_t block_size;    // The run-time size of an inner node
+    uint32_t no_nodes;    // Nodes allocated so far (when we allocate in order)
+};
+
 static void init_pool(struct inner_node_pool *pool, long long sigma, long long n)
 {
     (void)n; // unused parameter
 
     // First, figure out the size of memory blocks we need to store inner nodes.
-    // A node will take up the space for the shared struct and sigma children
-    size_t node_size = offsetof(struct inner_node, children) + ((size_t)sigma * sizeof(node *));
+    // A node will take up the space for the shared struct and sigma children,
+    // or a bit per letter if we pack the children.
+    size_t children_size = (sigma <= DENSE_MAX_SIGMA)
+                               ? (size_t)sigma * sizeof(node_ref)
+                               : offsetof(struct packed_children, mask) + (size_t)mask_words(sigma) * sizeof(uint64_t);
+    size_t node_size = offsetof(struct inner_node, children) + children_size;
     // And a node block must have a size such that consequtive blocks are correctly aligned,
     // so the block size is the node size rounded up to a full number of alignment blocks.
     size_t align_constraint = alignof(struct inner_node);
 
     pool->block_size = align_constraint * ((node_size + align_constraint - 1) / align_constraint);
-    pool->sub_pool = 0;
-    new_sub_pool(pool);
+    pool->sub_pools = 0;
+    pool->no_sub_pools = pool->cap = 0;
+    pool->no_nodes = 0;
 }
 
+// Makes room for no_sub_pools blocks, without allocating them
+static void grow_sub_pools(struct inner_node_pool *pool, size_t no_sub_pools)
+{
+    if (no_sub_pools > pool->cap)
+    {
+        while (pool->cap < no_sub_pools)
+        {
+            pool->cap = pool->cap ? 2 * pool->cap : 16;
+        }
+        pool->sub_pools = cstr_realloc_buffer(pool->sub_pools, sizeof *pool->sub_pools, pool->cap);
+    }
+    for (size_t i = pool->no_sub_pools; i < no_sub_pools; i++)
+    {
+        pool->sub_pools[i] = 0;
+    }
+    pool->no_sub_pools = no_sub_pools;
+}
+
+// Where Ukkonen's algorithm is in the tree. The suffixes we haven't made
+// leaves yet are the last `remainder` of them, and the longest of those
+// that is already in the tree ends active_len characters down the edge
+// out of active_node that starts with x[active_edge].
+struct ukkonen_state
+{
+    node_ref active_node;
+    long long active_edge;
+    long long active_len;
+    long long remainder;
+};
+
 // A suffix tree contains the alphabet and string x, the root
-// of the tree, then a pointer to a pool of inner nodes and embedded
-// in the same memory block, as a flexible array, the leaves. We
-// know the size of a leaf and the number of them at compile time,
-// so it is easier to put those at the flexible array than it is to
-// put the inner nodes there.
+// of the tree, then a pool of inner nodes and an array of the leaves.
+// Trees we build online own x and grow it and the leaves as we append.
 struct cstr_suffix_tree
 {
     cstr_alphabet const *alpha;
     cstr_const_sslice x;
+    bool packed;   // The inner nodes have packed children
+    bool threaded; // The links are next references and the tree is complete
 
-    inner_node *root;
+    node_ref root;
 
     struct inner_node_pool pool; // inner nodes are allocated from a pool
-    node leaves[];               // leaves are allocated together with the tree
+    leaf_node *leaves;           // the leaf for suffix i is at index i
+
+    // Only for trees we build online
+    uint8_t *text;
+    long long cap; // for both text and leaves
+    struct ukkonen_state ukkonen;
 };
 
-// Translating between ranges and slices
-static inline cstr_const_sslice range_to_slice(cstr_suffix_tree *st, range r)
+static inline leaf_node *leaf_ptr(cstr_suffix_tree *st, node_ref v)
+{
+    assert(is_leaf(v));
+    return &st->leaves[v]; // The leaves are allocated in an array, so its just the offset
+}
+
+static inline inner_node *inner_ptr(cstr_suffix_tree *st, node_ref v)
 {
-    return is_leaf_range(r)
-               // A leaf goes to the end
-               ? CSTR_SUFFIX(st->x, r.beg)
-               // An inner node is just the range
-               : CSTR_SUBSLICE(st->x, r.beg, r.end);
+    assert(is_inner(v));
+    uint32_t k = v & ~INNER_TAG;
+    char *block = st->pool.sub_pools[k / SUB_POOL_SIZE] + (size_t)(k % SUB_POOL_SIZE) * st->pool.block_size;
+    return (inner_node *)(void *)block;
 }
-static inline range slice_to_range(cstr_suffix_tree *st, cstr_const_sslice s)
+
+// The parent and next references share the link
+// clang-format off
+static inline node_ref get_link(cstr_suffix_tree *st, node_ref v)
 {
-    // We cannot recover the leaf information from a slice (even though we can)
-    // see if it ends at the end of st->x. That is because the leaf could be an
-    // index much earlier in the search. Therefore, we always return the range
-    // we would get if we had an internal node.
-    long long offset = s.buf - st->x.buf;
-    return (range){.beg = offset, .end = offset + s.len};
+    return is_leaf(v) ? leaf_ptr(st, v)->link : inner_ptr(st, v)->link;
 }
+static inline void set_link(cstr_suffix_tree *st, node_ref v, node_ref w)
+{
+    if (is_leaf(v)) leaf_ptr(st, v)->link = w;
+    else            inner_ptr(st, v)->link = w;
+}
+static inline node_ref get_parent(cstr_suffix_tree *st, node_ref v)          { return get_link(st, v); }
+static inline void     set_parent(cstr_suffix_tree *st, node_ref v, node_ref p) { set_link(st, v, p); }
+static inline node_ref get_next(cstr_suffix_tree *st, node_ref v)            { return get_link(st, v); }
+static inline void     set_next(cstr_suffix_tree *st, node_ref v, node_ref n)   { set_link(st, v, n); }
+// clang-format on
 
-static inline cstr_const_sslice get_edge(cstr_suffix_tree *st, node *n)
+static inline cstr_const_sslice get_edge(cstr_suffix_tree *st, node_ref v)
 {
-    assert(n != NULL);
-    return range_to_slice(st, n->range);
+    assert(v != NO_NODE);
+    if (is_leaf(v))
+    {
+        // A leaf goes to the end
+        return CSTR_SUFFIX(st->x, leaf_ptr(st, v)->beg);
+    }
+    inner_node *n = inner_ptr(st, v);
+    return CSTR_SUBSLICE(st->x, n->beg, n->end);
 }
 
-static void set_edge(cstr_suffix_tree *st, node *n, cstr_const_sslice edge)
+static void set_edge(cstr_suffix_tree *st, node_ref v, cstr_const_sslice edge)
 {
-    range r = slice_to_range(st, edge);
-    if (is_leaf(n))
+    uint32_t offset = (uint32_t)(edge.buf - st->x.buf);
+    if (is_leaf(v))
     {
         // edge must be a suffix of st->x
         assert(st->x.buf <= edge.buf && edge.buf + edge.len == st->x.buf + st->x.len);
         // Changing the edge to a leaf is only changing the beginning of the range
-        n->range.beg = r.beg;
+        leaf_ptr(st, v)->beg = offset;
     }
     else
     {
         // For inner nodes, we update the entire range.
-        n->range = r;
+        inner_node *n = inner_ptr(st, v);
+        n->beg = offset;
+        n->end = offset + (uint32_t)edge.len;
     }
 }
 
-static inner_node *pool_get_next(struct inner_node_pool *pool)
+// Sets up node k in the pool, allocating its block if k is the first in it.
+// With packed children, we clear the block, so the slots we never use
+// have no children buffer to free.
+static node_ref init_inner(cstr_suffix_tree *st, uint32_t k,
+                           cstr_const_sslice edge)
 {
-    if (pool->next == pool->end)
+    struct inner_node_pool *pool = &st->pool;
+    if (k % SUB_POOL_SIZE == 0)
+    {
+        assert(k / SUB_POOL_SIZE < pool->no_sub_pools && !pool->sub_pools[k / SUB_POOL_SIZE]);
+        char *block = cstr_malloc_buffer(pool->block_size, SUB_POOL_SIZE);
+        if (st->packed)
+        {
+            memset(block, 0, pool->block_size * SUB_POOL_SIZE);
+        }
+        pool->sub_pools[k / SUB_POOL_SIZE] = block;
+    }
+    node_ref v = k | INNER_TAG;
+    assert(v != NO_NODE);
+
+    inner_node *n = inner_ptr(st, v);
+    set_edge(st, v, edge);
+    n->slink = n->link = NO_NODE;
+    if (st->packed)
+    {
+        struct packed_children *c = packed_children(n);
+        c->buf = 0;
+        c->len = c->cap = 0;
+        for (int w = 0; w < mask_words(st->alpha->size); w++)
+        {
+            c->mask[w] = 0;
+        }
+    }
+    else
     {
-        new_sub_pool(pool);
+        for (long long i = 0; i < st->alpha->size; i++)
+        {
+            dense_children(n)[i] = NO_NODE;
+        }
     }
-    inner_node *next = (inner_node *)(void *)pool->next;
-    pool->next += pool->block_size;
-    return next;
+
+    return v;
 }
 
-static inline node *get_suffix_leaf(cstr_suffix_tree *st, long long suffix)
+static node_ref new_inner(cstr_suffix_tree *st,
+                          cstr_const_sslice edge)
 {
-    return &st->leaves[suffix]; // The leaves are allocated in an array, so its just the offset
+    struct inner_node_pool *pool = &st->pool;
+    if (pool->no_nodes % SUB_POOL_SIZE == 0)
+    {
+        grow_sub_pools(pool, pool->no_nodes / SUB_POOL_SIZE + 1);
+    }
+    return init_inner(st, pool->no_nodes++, edge);
 }
 
-static inner_node *new_inner(cstr_suffix_tree *st,
-                             cstr_const_sslice edge)
+// Inserts the child on letter a, or replaces the one that is already there
+static void set_packed_child(struct packed_children *c, uint8_t a, node_ref child)
 {
-    inner_node *n = pool_get_next(&st->pool);
-    n->range = slice_to_range(st, edge);
-    n->slink = n->parent = 0;
-    for (long long i = 0; i < st->alpha->size; i++)
+    unsigned int i = child_rank(c, a);
+    if (has_child(c, a))
     {
-        n->children[i] = 0;
+        c->buf[i] = child;
+        return;
     }
+    if (c->len == c->cap)
+    {
+        // Inner nodes have at least two children, so we start there
+        c->cap = c->cap ? 2 * c->cap : 2;
+        c->buf = cstr_realloc_buffer(c->buf, sizeof *c->buf, c->cap);
+    }
+    memmove(c->buf + i + 1, c->buf + i, (c->len - i) * sizeof *c->buf);
+    c->buf[i] = child;
+    c->len++;
+    c->mask[a / 64] |= UINT64_C(1) << (a % 64);
+}
 
-    return n;
+// Puts child in parent's children without touching child's link
+static void put_child(cstr_suffix_tree *st, node_ref parent, node_ref child)
+{
+    uint8_t a = get_edge(st, child).buf[0];
+    inner_node *p = inner_ptr(st, parent);
+    if (st->packed)
+    {
+        set_packed_child(packed_children(p), a, child);
+    }
+    else
+    {
+        dense_children(p)[a] = child;
+    }
 }
 
-static void set_child(cstr_suffix_tree *st, inner_node *parent, node *child)
+static void set_child(cstr_suffix_tree *st, node_ref parent, node_ref child)
 {
-    cstr_const_sslice child_edge = get_edge(st, child);
-    parent->children[child_edge.buf[0]] = child;
-    child->parent = parent;
+    put_child(st, parent, child);
+    set_parent(st, child, parent);
 }
 
-static inner_node *break_edge(cstr_suffix_tree *st, node *to, long long len)
+static node_ref break_edge(cstr_suffix_tree *st, node_ref to, long long len)
 {
     // Split the edge into two slices at offset len
     cstr_const_sslice edge = get_edge(st, to);
@@ -207,104 +361,124 @@ static inner_node *break_edge(cstr_suffix_tree *st, node *to, long long len)
 
     // Create a new node and get the parent of 'to'.
     // The edge to the new node is the prefix of the current edge.
-    inner_node *new_node = new_inner(st, prefix);
+    node_ref new_node = new_inner(st, prefix);
 
     // Change the edge to `to` so it is the suffix of the current
     // edge, then connect the parent to the new node and the new node to to
     set_edge(st, to, suffix);
-    set_child(st, to->parent, (node *)new_node);
+    set_child(st, get_parent(st, to), new_node);
     set_child(st, new_node, to);
 
     return new_node;
 }
 
-static inline node **get_children_begin(cstr_suffix_tree *st, node *n)
+// The children are in [begin, end), with NO_NODE where there is no child
+// in the dense layout. The packed layout has no holes.
+static inline node_ref *get_children_begin(cstr_suffix_tree *st, node_ref v)
 {
-    (void)st; // Unused parameter
-
-    return (n == 0 || is_leaf(n))
-               // Leaves and NULL do not have any children
-               ? 0
-               // Inner nodes have the first here
-               : &((inner_node *)n)->children[0];
+    if (v == NO_NODE || is_leaf(v))
+    {
+        return 0; // Leaves and NO_NODE do not have any children
+    }
+    inner_node *n = inner_ptr(st, v);
+    return st->packed ? packed_children(n)->buf : dense_children(n);
 }
-static inline node **get_children_end(cstr_suffix_tree *st, node *n)
+static inline node_ref *get_children_end(cstr_suffix_tree *st, node_ref v)
 {
-    return (n == 0 || is_leaf(n))
-               // Leaves and NULL do not have any children
-               ? 0
-               // Inner nodes have (one past the last) here
-               : &((inner_node *)n)->children[st->alpha->size];
+    if (v == NO_NODE || is_leaf(v))
+    {
+        return 0; // Leaves and NO_NODE do not have any children
+    }
+    inner_node *n = inner_ptr(st, v);
+    if (st->packed)
+    {
+        struct packed_children *c = packed_children(n);
+        return c->buf + c->len;
+    }
+    return dense_children(n) + st->alpha->size;
 }
 
-static void get_children(cstr_suffix_tree *st, node *n,
-                         node ***beg, node ***end)
+static void get_children(cstr_suffix_tree *st, node_ref v,
+                         node_ref **beg, node_ref **end)
 {
-    *beg = get_children_begin(st, n);
-    *end = get_children_end(st, n);
+    *beg = get_children_begin(st, v);
+    *end = get_children_end(st, v);
 }
 
-static inline node *get_child(inner_node *n, uint8_t a)
+static inline node_ref get_child(cstr_suffix_tree *st, node_ref v, uint8_t a)
 {
-    return n->children[a];
+    inner_node *n = inner_ptr(st, v);
+    if (st->packed)
+    {
+        struct packed_children *c = packed_children(n);
+        return has_child(c, a) ? c->buf[child_rank(c, a)] : NO_NODE;
+    }
+    return dense_children(n)[a];
 }
 
-static node *first_child(cstr_suffix_tree *st, node *n)
+static node_ref first_child(cstr_suffix_tree *st, node_ref v)
 {
-    assert(is_inner(n));
-    node **beg, **end, **child;
-    get_children(st, n, &beg, &end);
+    assert(is_inner(v));
+    node_ref *beg, *end, *child;
+    get_children(st, v, &beg, &end);
     for (child = beg; child != end; child++)
     {
-        if (*child)
+        if (*child != NO_NODE)
         {
             return *child;
         }
     }
     assert(false); // Inner nodes must have a first child
+    return NO_NODE;
 }
 
 // Get the address where a node sits in its parent
-static node **node_addr(cstr_suffix_tree *st, node *n)
+static node_ref *node_addr(cstr_suffix_tree *st, node_ref v)
 {
     // The root is a special case, since it sits in the tree and not
     // in another inner node.
-    if (n == (node *)st->root)
+    if (v == st->root)
     {
-        return (node **)&st->root;
+        return &st->root;
     }
-    uint8_t a = get_edge(st, n).buf[0]; // Out edge to node
-    return &n->parent->children[a];
+    uint8_t a = get_edge(st, v).buf[0]; // Out edge to node
+    inner_node *p = inner_ptr(st, get_parent(st, v));
+    if (st->packed)
+    {
+        struct packed_children *c = packed_children(p);
+        return &c->buf[child_rank(c, a)];
+    }
+    return &dense_children(p)[a];
 }
 
-static node *next_node(cstr_suffix_tree *st, node *n)
+static node_ref next_node(cstr_suffix_tree *st, node_ref v)
 {
-    if (is_inner(n))
+    if (is_inner(v))
     {
         // inner node, so move to first child for the recursion...
-        return first_child(st, n);
+        return first_child(st, v);
     }
 
     // Leaf -- we must search for the next node
     for (;;)
     {
-        node *p = (node *)n->parent;
-        node **sib = node_addr(st, n) + 1; // Start searching one past current
-        node **end = get_children_end(st, p);
+        node_ref p = get_parent(st, v);
+        node_ref *sib = node_addr(st, v) + 1; // Start searching one past current
+        node_ref *end = get_children_end(st, p);
 
-        // We don't need n's parent any more, so we can change it to its
-        // next pointer. We know what next will be, if v is an inner node.
+        // We don't need v's parent any more, so we can change it to its
+        // next reference. We know what next will be, if v is an inner node.
         // If it is a leaf, we have to find the next node first, so we handle
         // that in the node iterator.
-        if (is_inner(n))
+        if (is_inner(v))
         {
-            n->next = first_child(st, n);
+            set_next(st, v, first_child(st, v));
         }
 
-        // Search for the next sibling of n
+        // Search for the next sibling of v
         for (; sib < end; sib++)
         {
-            if (*sib)
+            if (*sib != NO_NODE)
             {
                 return *sib;
             }
@@ -312,40 +486,41 @@ static node *next_node(cstr_suffix_tree *st, node *n)
 
         // If there are no siblings and we are at the root,
         // we can find no more nodes at all.
-        if (p == (node *)st->root)
+        if (p == st->root)
         {
-            return 0;
+            return NO_NODE;
         }
 
         // Otherwise, we move to our parent's sibling.
         // This is a tail-recursive call.
-        n = p;
+        v = p;
     }
 }
 
-// Connects the `next` pointers in the nodes, destroying `parent` in the
+// Connects the `next` references in the nodes, destroying `parent` in the
 // process (of course, since they share the same memory).
 static void thread_nodes(cstr_suffix_tree *st)
 {
-    node *prev = (node *)st->root;
+    node_ref prev = st->root;
     do
     {
-        node *n = next_node(st, prev);
+        node_ref v = next_node(st, prev);
         if (is_leaf(prev))
         {
             // Connect the leaves here, when we know what the next node
             // will be. The inner nodes (where next has to be the first child)
             // are connected in `next_node`.
-            prev->next = n;
+            set_next(st, prev, v);
         }
-        prev = n;
-    } while (prev);
-    st->root->next = first_child(st, (node *)st->root);
+        prev = v;
+    } while (prev != NO_NODE);
+    set_next(st, st->root, first_child(st, st->root));
+    st->threaded = true;
 }
 
-static inline long long lcp(cstr_suffix_tree *st, node *n, cstr_const_sslice p)
+static inline long long lcp(cstr_suffix_tree *st, node_ref v, cstr_const_sslice p)
 {
-    return CSTR_SLICE_LCP(get_edge(st, n), p);
+    return CSTR_SLICE_LCP(get_edge(st, v), p);
 }
 
 // clang-format off
@@ -358,38 +533,38 @@ typedef struct
     } result;
     union
     {
-        struct { node *n; }                                 node_match;
-        struct { node *n; cstr_const_sslice final_string; } node_mismatch;
-        struct { node *n; long long shared; }               edge_match;
-        struct { 
-            node *n; 
-            cstr_const_sslice final_string; 
+        struct { node_ref n; }                                 node_match;
+        struct { node_ref n; cstr_const_sslice final_string; } node_mismatch;
+        struct { node_ref n; long long shared; }               edge_match;
+        struct {
+            node_ref n;
+            cstr_const_sslice final_string;
             long long shared;
         } edge_mismatch;
     };
 } scan_res;
 // clang-format on
 
-static inline scan_res node_match(node *n)
+static inline scan_res node_match(node_ref n)
 {
     return (scan_res){.result = NODE_MATCH, .node_match = {.n = n}};
 }
 
-static inline scan_res node_mismatch(node *n, cstr_const_sslice final_string)
+static inline scan_res node_mismatch(node_ref n, cstr_const_sslice final_string)
 {
     return (scan_res){
         .result = NODE_MISMATCH,
         .node_mismatch = {.n = n, .final_string = final_string}};
 }
 
-static inline scan_res edge_match(node *n, long long shared)
+static inline scan_res edge_match(node_ref n, long long shared)
 {
     return (scan_res){
         .result = EDGE_MATCH,
         .edge_match = {.n = n, .shared = shared}};
 }
 
-static inline scan_res edge_mismatch(node *n,
+static inline scan_res edge_mismatch(node_ref n,
                                      cstr_const_sslice final_string,
                                      long long shared)
 {
@@ -402,22 +577,22 @@ static inline scan_res edge_mismatch(node *n,
 }
 
 static scan_res
-slow_scan(cstr_suffix_tree *st, inner_node *from, cstr_const_sslice p)
+slow_scan(cstr_suffix_tree *st, node_ref from, cstr_const_sslice p)
 {
     for (;;)
     {
         if (p.len == 0)
         {
             // A complete match (just because p is empty)
-            return node_match((node *)from);
+            return node_match(from);
         }
 
-        node *to = get_child(from, p.buf[0]);
-        if (to == NULL)
+        node_ref to = get_child(st, from, p.buf[0]);
+        if (to == NO_NODE)
         {
             // We cannot continue, because there is no where to continue to
             // A complete match
-            return node_mismatch((node *)from, p);
+            return node_mismatch(from, p);
         }
 
         long long shared = lcp(st, to, p);
@@ -440,23 +615,23 @@ slow_scan(cstr_suffix_tree *st, inner_node *from, cstr_const_sslice p)
         // Continue recursion, chop off what we already matched
         // and continue from the node we reached
         p = CSTR_SUFFIX(p, shared);
-        from = (inner_node *)to;
+        from = to;
     }
 }
 
 static scan_res
-fast_scan(cstr_suffix_tree *st, inner_node *from, cstr_const_sslice p)
+fast_scan(cstr_suffix_tree *st, node_ref from, cstr_const_sslice p)
 {
     for (;;)
     {
         if (p.len == 0)
         {
             // A complete match (just because p is empty)
-            return node_match((node *)from);
+            return node_match(from);
         }
 
-        node *to = get_child(from, p.buf[0]);
-        assert(to); // If we search on a node in fast_scan, the child is there
+        node_ref to = get_child(st, from, p.buf[0]);
+        assert(to != NO_NODE); // If we search on a node in fast_scan, the child is there
 
         long long edge_len = get_edge(st, to).len;
         if (p.len == edge_len)
@@ -471,33 +646,37 @@ fast_scan(cstr_suffix_tree *st, inner_node *from, cstr_const_sslice p)
         // Continue recursion, chop off what we already matched
         // and continue from the node we reached
         p = CSTR_SUFFIX(p, edge_len);
-        from = (inner_node *)to;
+        from = to;
     }
 }
 
 static cstr_suffix_tree *
 new_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x)
 {
-    cstr_suffix_tree *st = CSTR_MALLOC_FLEX_ARRAY(st, leaves, (size_t)x.len);
+    assert(x.len <= CSTR_ST_MAX_LEN);
+    cstr_suffix_tree *st = cstr_malloc(sizeof *st);
 
     st->alpha = alpha;
     st->x = x;
+    st->packed = alpha->size > DENSE_MAX_SIGMA;
+    st->threaded = false;
+    st->leaves = cstr_malloc_buffer(sizeof *st->leaves, x.len > 0 ? (size_t)x.len : 1);
+    st->text = 0;
+    st->cap = 0;
 
     init_pool(&st->pool, alpha->size, x.len);
 
     // It doesn't matter what edge we put on the root, we are never going to
-    // look at it, but we want beg < end on the range so we don't confuse
-    // it with a leaf. Here, we just use the entire string.
+    // look at it. Here, we just use the entire string.
     st->root = new_inner(st, x);
 
     // Initialising the leaves (initially, they all just hook up
     // to the root, but this is somewhat arbitrary).
     for (long long i = 0; i < x.len; i++)
     {
-        // The slice_start is wrong here, but will be updated in
+        // The edge is wrong here, but will be updated in
         // the construction algorithms.
-        st->leaves[i] = (node){
-            .range = {.beg = i, .leaf = i}, .parent = st->root};
+        st->leaves[i] = (leaf_node){.beg = (uint32_t)i, .link = st->root};
     }
 
     return st;
@@ -507,13 +686,13 @@ static void naive_insert(cstr_suffix_tree *st, long long i)
 {
     cstr_const_sslice suffix = CSTR_SUFFIX(st->x, i);
     scan_res res = slow_scan(st, st->root, suffix);
+    node_ref leaf = (node_ref)i;
     switch (res.result)
     {
     case NODE_MISMATCH:
     {
-        node *leaf = get_suffix_leaf(st, i);
         // res must be inner node; we don't mismatch on leaves
-        inner_node *v = (inner_node *)res.node_mismatch.n;
+        node_ref v = res.node_mismatch.n;
         set_edge(st, leaf, res.node_mismatch.final_string);
         set_child(st, v, leaf);
     }
@@ -521,8 +700,7 @@ static void naive_insert(cstr_suffix_tree *st, long long i)
 
     case EDGE_MISMATCH:
     {
-        inner_node *breakpoint = break_edge(st, res.edge_mismatch.n, res.edge_mismatch.shared);
-        node *leaf = get_suffix_leaf(st, i);
+        node_ref breakpoint = break_edge(st, res.edge_mismatch.n, res.edge_mismatch.shared);
         set_edge(st, leaf,
                  CSTR_SUFFIX(res.edge_mismatch.final_string, res.edge_mismatch.shared));
         set_child(st, breakpoint, leaf);
@@ -537,6 +715,10 @@ static void naive_insert(cstr_suffix_tree *st, long long i)
 cstr_suffix_tree *
 cstr_naive_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x)
 {
+    if (x.len > CSTR_ST_MAX_LEN)
+    {
+        return NULL;
+    }
     cstr_suffix_tree *st = new_suffix_tree(alpha, x);
     for (long long i = 0; i < x.len; i++)
     {
@@ -551,10 +733,10 @@ cstr_naive_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x)
 // in the root.
 // It boils down to this: chop off the first character from the edge
 //  if the parent is the root, and otherwise, just give us the edge.
-static inline cstr_const_sslice suffix(cstr_suffix_tree *st, node *n)
+static inline cstr_const_sslice suffix(cstr_suffix_tree *st, node_ref v)
 {
-    cstr_const_sslice y = get_edge(st, n);
-    if (n->parent == st->root)
+    cstr_const_sslice y = get_edge(st, v);
+    if (get_parent(st, v) == st->root)
     {
         y.buf++;
         y.len--;
@@ -565,6 +747,10 @@ static inline cstr_const_sslice suffix(cstr_suffix_tree *st, node *n)
 cstr_suffix_tree *
 cstr_mccreight_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x)
 {
+    if (x.len > CSTR_ST_MAX_LEN)
+    {
+        return NULL;
+    }
     cstr_suffix_tree *st = new_suffix_tree(alpha, x);
 
     // The previous suffix we inserted had the form "a|y|z|w" where
@@ -575,50 +761,53 @@ cstr_mccreight_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x)
     // through w as far as we can.
 
     cstr_const_sslice z, w;
-    inner_node *y_node;  // node where string y ends == s(ay)
-    inner_node *yz_node; // node where string yz ends == s(ayz)
+    node_ref y_node;  // node where string y ends == s(ay)
+    node_ref yz_node; // node where string yz ends == s(ayz)
 
-    node *leaf = get_suffix_leaf(st, 0);
+    node_ref leaf = 0;
     set_edge(st, leaf, x);
     set_child(st, st->root, leaf);
 
     // Avoid some special cases by making the root its own parent and suffix
-    st->root->parent = st->root;
-    st->root->slink = st->root;
+    set_parent(st, st->root, st->root);
+    inner_ptr(st, st->root)->slink = st->root;
 
     for (long long i = 1; i < x.len; i++)
     {
-        w = suffix(st, leaf);                // leaf is ayzw, we get the last bit, w
-        inner_node *ayz_node = leaf->parent; // and the parent of leaf is ayz
+        w = suffix(st, leaf);                            // leaf is ayzw, we get the last bit, w
+        node_ref ayz_node = get_parent(st, leaf);        // and the parent of leaf is ayz
+        inner_node *ayz = inner_ptr(st, ayz_node);
 
-        if (ayz_node->slink)
+        if (ayz->slink != NO_NODE)
         {
             // We have the link, so we jump directly from ayz to yz
-            yz_node = ayz_node->slink;
+            yz_node = ayz->slink;
         }
         else
         {
-            inner_node *ay_node = ayz_node->parent;
-            assert(ay_node);
-            y_node = ay_node->slink;
-            assert(y_node);
+            node_ref ay_node = get_parent(st, ayz_node);
+            assert(ay_node != NO_NODE);
+            y_node = inner_ptr(st, ay_node)->slink;
+            assert(y_node != NO_NODE);
 
-            z = suffix(st, (node *)ayz_node); // get z as the last edge on ayz
+            z = suffix(st, ayz_node); // get z as the last edge on ayz
             scan_res res = fast_scan(st, y_node, z);
             switch (res.result)
             {
             case NODE_MATCH:
             {
-                ayz_node->slink = yz_node = (inner_node *)res.node_match.n;
+                ayz->slink = yz_node = res.node_match.n;
                 break;
             }
 
             case EDGE_MATCH:
             {
-                ayz_node->slink = break_edge(st, res.edge_match.n, res.edge_match.shared);
-                leaf = get_suffix_leaf(st, i);
+                // Breaking the edge allocates a node, but nodes never
+                // move, so ayz is still valid.
+                ayz->slink = break_edge(st, res.edge_match.n, res.edge_match.shared);
+                leaf = (node_ref)i;
                 set_edge(st, leaf, w);
-                set_child(st, ayz_node->slink, leaf);
+                set_child(st, ayz->slink, leaf);
                 continue; // We don't need the rest of the loop, we can short circuit here
             }
 
@@ -634,17 +823,17 @@ cstr_mccreight_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x)
         {
         case NODE_MISMATCH:
         {
-            leaf = get_suffix_leaf(st, i);
+            leaf = (node_ref)i;
             set_edge(st, leaf, res.node_mismatch.final_string);
-            set_child(st, (inner_node *)res.node_mismatch.n, leaf);
+            set_child(st, res.node_mismatch.n, leaf);
             break;
         }
 
         case EDGE_MISMATCH:
         {
-            inner_node *head = break_edge(st, res.edge_mismatch.n, res.edge_mismatch.shared);
+            node_ref head = break_edge(st, res.edge_mismatch.n, res.edge_mismatch.shared);
             cstr_const_sslice tail = CSTR_SUFFIX(res.edge_mismatch.final_string, res.edge_mismatch.shared);
-            leaf = get_suffix_leaf(st, i);
+            leaf = (node_ref)i;
             set_edge(st, leaf, tail);
             set_child(st, head, leaf);
             break;
@@ -660,36 +849,516 @@ cstr_mccreight_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x)
     return st;
 }
 
+// MARK: From suffix and LCP arrays
+
+// The suffix array lists the leaves in the order a depth-first traversal
+// sees them, and the LCP array tells us how deep the path is where each leaf
+// branches off from the previous, so we can build the tree in one pass,
+// left to right, keeping the rightmost path on a stack. We never go back
+// into a subtree once we have left it, so nodes that are close in the tree
+// are close in memory, and we never need suffix links or scans.
+//
+// We thread the tree as we go, instead of in a separate pass. A new leaf
+// follows the previous leaf, and when we split an edge above a node, the
+// new node goes between that node and whatever came before it, so we
+// remember what came before each node on the stack.
+//
+// The parallel construction uses the same pass to build subtrees without a
+// parent, and then to put those subtrees together, so what we add doesn't
+// have to be a leaf; it can be a complete subtree, given by its root, its
+// depth, a suffix in it, and its last leaf.
+
+struct lcp_frame
+{
+    node_ref v;
+    node_ref pred; // The node before v in a depth-first traversal
+    long long depth;
+};
+
+struct lcp_builder
+{
+    cstr_suffix_tree *st;
+    struct lcp_frame *stack; // The bottom is the parent of what we build
+    long long top;
+    node_ref prev_leaf; // The last leaf so far
+    uint32_t *cursor;   // The next node we allocate, or NULL to allocate in order
+};
+
+// The bottom of the stack is parent, which may be NO_NODE if we are
+// building a subtree that we attach later. The stack must have room for one
+// more frame than the subtrees we add.
+static void init_lcp_builder(struct lcp_builder *b, cstr_suffix_tree *st,
+                             struct lcp_frame *stack, node_ref parent, uint32_t *cursor)
+{
+    b->st = st;
+    b->stack = stack;
+    b->top = 0;
+    b->stack[0] = (struct lcp_frame){.v = parent, .pred = NO_NODE, .depth = 0};
+    b->prev_leaf = parent;
+    b->cursor = cursor;
+}
+
+// Adds the subtree v, which contains suffix s and goes depth characters
+// down, after what we have, where it shares l characters with the last leaf.
+static void lcp_add(struct lcp_builder *b, node_ref v, long long s, long long depth,
+                    long long l, node_ref last_leaf)
+{
+    cstr_suffix_tree *st = b->st;
+    struct lcp_frame *stack = b->stack;
+
+    struct lcp_frame last = {.v = NO_NODE};
+    while (stack[b->top].depth > l)
+    {
+        last = stack[b->top--];
+    }
+    if (stack[b->top].depth < l)
+    {
+        // The last leaf branches off from this one below top, on
+        // the edge to last, so we split that edge at depth l.
+        long long shared = l - stack[b->top].depth;
+        cstr_const_sslice edge = get_edge(st, last.v);
+        node_ref u = b->cursor ? init_inner(st, (*b->cursor)++, CSTR_PREFIX(edge, shared))
+                               : new_inner(st, CSTR_PREFIX(edge, shared));
+        set_edge(st, last.v, CSTR_SUFFIX(edge, shared));
+        if (stack[b->top].v != NO_NODE)
+        {
+            put_child(st, stack[b->top].v, u);
+        }
+        put_child(st, u, last.v);
+
+        if (last.pred != NO_NODE)
+        {
+            set_next(st, last.pred, u);
+        }
+        set_next(st, u, last.v);
+        b->stack[++b->top] = (struct lcp_frame){.v = u, .pred = last.pred, .depth = l};
+    }
+
+    set_edge(st, v, CSTR_SUBSLICE(st->x, s + l, s + depth));
+    if (stack[b->top].v != NO_NODE)
+    {
+        put_child(st, stack[b->top].v, v);
+    }
+    if (b->prev_leaf != NO_NODE)
+    {
+        set_next(st, b->prev_leaf, v);
+    }
+    b->stack[++b->top] = (struct lcp_frame){.v = v, .pred = b->prev_leaf, .depth = depth};
+    b->prev_leaf = last_leaf;
+}
+
+static inline void lcp_add_leaf(struct lcp_builder *b, long long s, long long l)
+{
+    lcp_add(b, (node_ref)s, s, b->st->x.len - s, l, (node_ref)s);
+}
+
+cstr_suffix_tree *cstr_lcp_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x,
+                                       cstr_suffix_array sa, cstr_uislice lcp)
+{
+    assert(sa.len == x.len && lcp.len == x.len);
+    if (x.len > CSTR_ST_MAX_LEN)
+    {
+        return NULL;
+    }
+    cstr_suffix_tree *st = new_suffix_tree(alpha, x);
+
+    struct lcp_frame *stack = cstr_malloc_buffer(sizeof *stack, (size_t)x.len + 1);
+    struct lcp_builder b;
+    init_lcp_builder(&b, st, stack, st->root, 0);
+    for (long long r = 0; r < sa.len; r++)
+    {
+        lcp_add_leaf(&b, sa.buf[r], lcp.buf[r]);
+    }
+    set_next(st, b.prev_leaf, NO_NODE);
+    st->threaded = true;
+
+    free(stack);
+    return st;
+}
+
+// MARK: Parallel construction
+
+// Suffixes that share their first k letters are a subtree below depth k,
+// and in the suffix array they are a bucket, an interval where the LCP
+// array is at least k inside. We hand out runs of buckets to the threads,
+// each builds the subtrees for its buckets, and then we build the top of
+// the tree, above depth k, over the subtrees.
+//
+// The threads allocate nodes from their own blocks in the pool. A run of
+// buckets with m suffixes has fewer than m inner nodes, so we give each
+// thread a range of node references that large, rounded up to whole
+// blocks, and the threads never share a block. The top of the tree comes
+// first in the pool, with room for a node per bucket.
+
+// Aim for this many buckets per thread, to even out the work
+#define PAR_ST_BUCKETS_PER_THREAD 64
+// Rounding up to blocks costs each thread up to a block, and more threads
+// than this would take us past the margin CSTR_ST_MAX_LEN leaves for that.
+#define PAR_ST_MAX_THREADS 1024
+
+struct st_bucket
+{
+    long long lo; // The bucket is sa[lo, next bucket's lo)
+    node_ref root, last_leaf;
+    long long depth;
+};
+
+struct par_st
+{
+    cstr_suffix_tree *st;
+    cstr_suffix_array sa;
+    cstr_uislice lcp;
+    long long k;               // Buckets share their first k letters
+    struct st_bucket *buckets; // One extra, where lo is n
+    long long *first_bucket;   // Thread t builds [first_bucket[t], first_bucket[t + 1])
+    uint32_t *first_node;      // and allocates from first_node[t]
+};
+
+static inline bool starts_bucket(struct par_st const *ctx, long long r)
+{
+    return r == 0 || ctx->lcp.buf[r] < ctx->k;
+}
+
+// The number of buckets that start in the thread's share of sa, in
+// first_bucket[t + 1], so a prefix sum gives us where they go
+static void count_buckets(struct par_st *ctx, int t, int no_threads)
+{
+    long long from, to, count = 0;
+    cstr_par_range(ctx->sa.len, t, no_threads, 1, &from, &to);
+    for (long long r = from; r < to; r++)
+    {
+        count += starts_bucket(ctx, r);
+    }
+    ctx->first_bucket[t + 1] = count;
+}
+
+static void cut_buckets(struct par_st *ctx, int t, int no_threads)
+{
+    long long from, to, b = ctx->first_bucket[t];
+    cstr_par_range(ctx->sa.len, t, no_threads, 1, &from, &to);
+    for (long long r = from; r < to; r++)
+    {
+        if (starts_bucket(ctx, r))
+        {
+            ctx->buckets[b++].lo = r;
+        }
+    }
+}
+
+static void build_buckets(struct par_st *ctx, int t, int no_threads)
+{
+    (void)no_threads;
+    cstr_suffix_tree *st = ctx->st;
+    long long from = ctx->first_bucket[t], to = ctx->first_bucket[t + 1];
+    if (from == to)
+    {
+        return;
+    }
+
+    uint32_t cursor = ctx->first_node[t];
+    struct lcp_frame *stack =
+        cstr_malloc_buffer(sizeof *stack, (size_t)(ctx->buckets[to].lo - ctx->buckets[from].lo) + 1);
+    for (long long k = from; k < to; k++)
+    {
+        struct st_bucket *bucket = &ctx->buckets[k];
+        struct lcp_builder b;
+        init_lcp_builder(&b, st, stack, NO_NODE, &cursor);
+        lcp_add_leaf(&b, ctx->sa.buf[bucket->lo], 0);
+        for (long long r = bucket->lo + 1; r < bucket[1].lo; r++)
+        {
+            lcp_add_leaf(&b, ctx->sa.buf[r], ctx->lcp.buf[r]);
+        }
+        bucket->root = stack[1].v;
+        bucket->depth = stack[1].depth;
+        bucket->last_leaf = b.prev_leaf;
+    }
+    free(stack);
+}
+
+// The smallest k where sigma^k gives us enough buckets, but at least one
+static long long bucket_prefix(long long sigma, long long n, int no_threads)
+{
+    long long k = 1;
+    for (long long buckets = sigma; buckets < PAR_ST_BUCKETS_PER_THREAD * no_threads && buckets < n; k++)
+    {
+        buckets *= sigma;
+    }
+    return k;
+}
+
+cstr_suffix_tree *cstr_parallel_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x,
+                                            int no_threads)
+{
+    long long n = x.len;
+    if (n > CSTR_ST_MAX_LEN)
+    {
+        return NULL;
+    }
+    no_threads = no_threads > 0 ? no_threads : 1;
+    no_threads = no_threads < PAR_ST_MAX_THREADS ? no_threads : PAR_ST_MAX_THREADS;
+    assert(n + (long long)SUB_POOL_SIZE * (no_threads + 1) < (long long)INNER_TAG - 1);
+
+    // The suffix array and its LCP array, both built in parallel
+    cstr_alphabet sa_alpha = *alpha;
+    cstr_suffix_array *sa = cstr_alloc_uislice(n);
+    cstr_sais_parallel_sslice(*sa, x, &sa_alpha, no_threads);
+    cstr_uislice *lcp = cstr_alloc_uislice(n);
+    cstr_lcp_phi_parallel(*lcp, *sa, x, no_threads);
+
+    // Cut the suffix array into buckets. Each thread gets the buckets
+    // that start in its share of the suffix array, so counting them per
+    // share gives us the threads' first buckets, and then they can find
+    // the buckets' starts in parallel.
+    cstr_par_pool *pool = cstr_new_par_pool(no_threads);
+    struct par_st ctx = {.sa = *sa,
+                         .lcp = *lcp,
+                         .k = bucket_prefix(alpha->size, n, no_threads),
+                         .first_bucket = cstr_malloc_buffer(sizeof *ctx.first_bucket,
+                                                            (size_t)no_threads + 1)};
+    cstr_par_run(pool, (cstr_par_fn)count_buckets, &ctx);
+    long long *first_bucket = ctx.first_bucket;
+    first_bucket[0] = 0;
+    for (int t = 0; t < no_threads; t++)
+    {
+        first_bucket[t + 1] += first_bucket[t];
+    }
+    long long no_buckets = first_bucket[no_threads];
+    struct st_bucket *buckets = cstr_malloc_buffer(sizeof *buckets, (size_t)no_buckets + 1);
+    ctx.buckets = buckets;
+    cstr_par_run(pool, (cstr_par_fn)cut_buckets, &ctx);
+    buckets[no_buckets].lo = n;
+
+    // and the node references each thread may need for its buckets
+    cstr_suffix_tree *st = new_suffix_tree(alpha, x);
+    uint32_t *first_node = cstr_malloc_buffer(sizeof *first_node, (size_t)no_threads);
+    long long blocks = (no_buckets + 1 + SUB_POOL_SIZE - 1) / SUB_POOL_SIZE; // The top
+    for (int t = 0; t < no_threads; t++)
+    {
+        long long m = buckets[first_bucket[t + 1]].lo - buckets[first_bucket[t]].lo;
+        first_node[t] = (uint32_t)(blocks * SUB_POOL_SIZE);
+        blocks += (m + SUB_POOL_SIZE - 1) / SUB_POOL_SIZE;
+    }
+    grow_sub_pools(&st->pool, (size_t)blocks);
+
+    ctx.st = st;
+    ctx.first_node = first_node;
+    cstr_par_run(pool, (cstr_par_fn)build_buckets, &ctx);
+    cstr_free_par_pool(pool);
+
+    // Then the top of the tree, with the buckets' subtrees as its leaves
+    uint32_t cursor = st->pool.no_nodes; // After the root
+    struct lcp_frame *stack = cstr_malloc_buffer(sizeof *stack, (size_t)no_buckets + 1);
+    struct lcp_builder b;
+    init_lcp_builder(&b, st, stack, st->root, &cursor);
+    for (long long i = 0; i < no_buckets; i++)
+    {
+        struct st_bucket *bucket = &buckets[i];
+        lcp_add(&b, bucket->root, sa->buf[bucket->lo], bucket->depth,
+                lcp->buf[bucket->lo], bucket->last_leaf);
+    }
+    set_next(st, b.prev_leaf, NO_NODE);
+    st->threaded = true;
+    st->pool.no_nodes = (uint32_t)(blocks * SUB_POOL_SIZE);
+
+    free(stack);
+    free(first_node);
+    free(first_bucket);
+    free(buckets);
+    free(lcp);
+    free(sa);
+    return st;
+}
+
+// MARK: Ukkonen
+
+// Online construction (Ukkonen 1995). After we add x[i], the tree holds
+// every suffix of x[0..i], the ones that are leaves and, implicitly,
+// the `remainder` shortest that already occur elsewhere. Leaves end at
+// the end of x, so they grow with it for free, and we only have to add the
+// new suffixes: from the longest implicit one down, we add a leaf where
+// it ends, until we get to one that can be extended with x[i] in the tree.
+// Those, and the shorter ones, are then still implicit.
+
+static cstr_suffix_tree *new_online_tree(cstr_alphabet const *alpha)
+{
+    long long cap = 16;
+    uint8_t *text = cstr_malloc_buffer(sizeof *text, (size_t)cap);
+    cstr_suffix_tree *st = new_suffix_tree(alpha, CSTR_SLICE((const uint8_t *)text, 0));
+    st->text = text;
+    st->cap = cap;
+    st->leaves = cstr_realloc_buffer(st->leaves, sizeof *st->leaves, (size_t)cap);
+
+    // Root is its own suffix link, so following it from the root needs no special case
+    inner_ptr(st, st->root)->slink = st->root;
+    st->ukkonen = (struct ukkonen_state){.active_node = st->root};
+    return st;
+}
+
+// The previous node we split or passed, which needs a suffix link to the next
+static inline void add_slink(cstr_suffix_tree *st, node_ref *need_slink, node_ref v)
+{
+    if (*need_slink != NO_NODE)
+    {
+        inner_ptr(st, *need_slink)->slink = v;
+    }
+    *need_slink = v;
+}
+
+static inline void add_leaf(cstr_suffix_tree *st, node_ref parent, long long suffix, long long i)
+{
+    node_ref leaf = (node_ref)suffix;
+    st->leaves[leaf].beg = (uint32_t)i;
+    set_child(st, parent, leaf);
+}
+
+// Add x[i] to the tree of x[0..i)
+static void ukkonen_extend(cstr_suffix_tree *st, long long i)
+{
+    struct ukkonen_state *u = &st->ukkonen;
+    uint8_t a = st->x.buf[i];
+    node_ref need_slink = NO_NODE;
+
+    u->remainder++;
+    while (u->remainder > 0)
+    {
+        if (u->active_len == 0)
+        {
+            u->active_edge = i;
+        }
+        node_ref next = get_child(st, u->active_node, st->x.buf[u->active_edge]);
+        if (next == NO_NODE)
+        {
+            add_leaf(st, u->active_node, i - u->remainder + 1, i);
+            add_slink(st, &need_slink, u->active_node);
+        }
+        else
+        {
+            cstr_const_sslice edge = get_edge(st, next);
+            if (u->active_len >= edge.len)
+            {
+                // The suffix runs past next, so we continue from there
+                u->active_edge += edge.len;
+                u->active_len -= edge.len;
+                u->active_node = next;
+                continue;
+            }
+            if (edge.buf[u->active_len] == a)
+            {
+                // This suffix, and the shorter ones, are already in the tree
+                add_slink(st, &need_slink, u->active_node);
+                u->active_len++;
+                break;
+            }
+            node_ref split = break_edge(st, next, u->active_len);
+            add_leaf(st, split, i - u->remainder + 1, i);
+            add_slink(st, &need_slink, split);
+        }
+
+        // Move on to the next shorter suffix
+        u->remainder--;
+        if (u->active_node == st->root && u->active_len > 0)
+        {
+            u->active_len--;
+            u->active_edge = i - u->remainder + 1;
+        }
+        else
+        {
+            node_ref slink = inner_ptr(st, u->active_node)->slink;
+            u->active_node = (slink != NO_NODE) ? slink : st->root;
+        }
+    }
+}
+
+cstr_suffix_tree *cstr_new_online_suffix_tree(cstr_alphabet const *alpha)
+{
+    return new_online_tree(alpha);
+}
+
+bool cstr_st_append(cstr_suffix_tree *st, cstr_const_sslice s)
+{
+    assert(st->text && !st->threaded); // An online tree we haven't completed
+    long long n = st->x.len + s.len;
+    if (n > CSTR_ST_MAX_LEN)
+    {
+        return false;
+    }
+    if (n > st->cap)
+    {
+        while (st->cap < n)
+        {
+            st->cap *= 2;
+        }
+        st->text = cstr_realloc_buffer(st->text, sizeof *st->text, (size_t)st->cap);
+        st->leaves = cstr_realloc_buffer(st->leaves, sizeof *st->leaves, (size_t)st->cap);
+    }
+
+    for (long long j = 0; j < s.len; j++)
+    {
+        long long i = st->x.len;
+        st->text[i] = s.buf[j];
+        st->x = CSTR_SLICE((const uint8_t *)st->text, i + 1);
+        ukkonen_extend(st, i);
+
+        if (s.buf[j] == 0)
+        {
+            // The sentinel is unique, so now all suffixes are leaves
+            assert(j == s.len - 1 && st->ukkonen.remainder == 0);
+            thread_nodes(st);
+        }
+    }
+    return true;
+}
+
+cstr_suffix_tree *cstr_ukkonen_suffix_tree(cstr_alphabet const *alpha, cstr_const_sslice x)
+{
+    if (x.len > CSTR_ST_MAX_LEN)
+    {
+        return NULL;
+    }
+    cstr_suffix_tree *st = new_online_tree(alpha);
+    cstr_st_append(st, x);
+    return st;
+}
+
 void cstr_free_suffix_tree(cstr_suffix_tree *st)
 {
-    struct sub_pool *spool = st->pool.sub_pool, *next;
-    for (; spool; spool = next)
+    struct inner_node_pool *pool = &st->pool;
+    for (size_t i = 0; i < pool->no_sub_pools; i++)
     {
-        next = spool->next;
-        free(spool);
+        char *block = pool->sub_pools[i];
+        for (size_t k = 0; block && st->packed && k < SUB_POOL_SIZE; k++)
+        {
+            // Cleared when we allocated the block, if we never used the slot
+            free(packed_children((inner_node *)(void *)(block + k * pool->block_size))->buf);
+        }
+        free(block);
     }
+    free(st->pool.sub_pools);
+    free(st->leaves);
+    free(st->text);
     free(st);
 }
 
 struct st_matcher
 {
     cstr_exact_matcher matcher;
-    node *n, *sentinel;
+    cstr_suffix_tree *st;
+    node_ref n, sentinel;
 };
 
 static inline void inc(struct st_matcher *iter)
 {
     // If we are at the sentinel, the next is null, otherwise
     // we take whatever next is
-    iter->n = (iter->n == iter->sentinel) ? 0 : iter->n->next;
+    iter->n = (iter->n == iter->sentinel) ? NO_NODE : get_next(iter->st, iter->n);
 }
 static long long next_match(struct st_matcher *iter)
 {
-    for (; iter->n; inc(iter))
+    for (; iter->n != NO_NODE; inc(iter))
     {
         if (is_leaf(iter->n))
         {
-            long long suf = iter->n->range.leaf;
+            long long suf = iter->n; // A leaf is its suffix
             inc(iter);
             return suf;
         }
@@ -704,52 +1373,134 @@ static cstr_exact_matcher_vtab st_matcher_vtab = {.next = (next_f)next_match, .f
 
 // Get the rightmost leaf in a sub-tree. We use it as a sentinel in a threaded
 // traversal.
-static node *rightmost_leaf(cstr_suffix_tree *st, node *n)
+static node_ref rightmost_leaf(cstr_suffix_tree *st, node_ref v)
 {
     for (;;)
     {
-        if (is_leaf(n))
+        if (is_leaf(v))
         {
-            return n;
+            return v;
         }
-        node **v = get_children_end(st, n);
-        for (v--; *v == 0; v--)
+        node_ref *w = get_children_end(st, v);
+        for (w--; *w == NO_NODE; w--)
             ;
-        n = *v;
+        v = *w;
     }
 }
 
-static inline cstr_exact_matcher *matcher_from_node(cstr_suffix_tree *st, node *n)
+static inline cstr_exact_matcher *matcher_from_node(cstr_suffix_tree *st, node_ref v)
 {
     struct st_matcher *m = cstr_malloc(sizeof *m);
     m->matcher.vtab = &st_matcher_vtab;
-    m->n = n;
-    m->sentinel = n ? rightmost_leaf(st, n) : 0;
+    m->st = st;
+    m->n = v;
+    m->sentinel = (v != NO_NODE) ? rightmost_leaf(st, v) : NO_NODE;
+    return (cstr_exact_matcher *)m;
+}
+
+// Before an online tree is complete, its links are parents, not next
+// references, so we go through the leaves below the match with a stack,
+// and then we check the implicit suffixes, that are not leaves yet, directly.
+struct online_matcher
+{
+    cstr_exact_matcher matcher;
+    cstr_suffix_tree *st;
+    node_ref *stack;
+    long long top, cap;
+    long long implicit; // The next implicit suffix to check
+    cstr_const_sslice p;
+    uint8_t p_buf[]; // Our own copy of p, which may be a temporary
+};
+
+static void push(struct online_matcher *m, node_ref v)
+{
+    if (m->top == m->cap)
+    {
+        m->cap = m->cap ? 2 * m->cap : 16;
+        m->stack = cstr_realloc_buffer(m->stack, sizeof *m->stack, (size_t)m->cap);
+    }
+    m->stack[m->top++] = v;
+}
+
+static long long online_next_match(struct online_matcher *m)
+{
+    cstr_suffix_tree *st = m->st;
+    while (m->top > 0)
+    {
+        node_ref v = m->stack[--m->top];
+        if (is_leaf(v))
+        {
+            return v; // A leaf is its suffix
+        }
+        node_ref *beg, *end;
+        get_children(st, v, &beg, &end);
+        for (node_ref *w = end; w != beg; w--)
+        {
+            if (w[-1] != NO_NODE)
+            {
+                push(m, w[-1]);
+            }
+        }
+    }
+    for (; m->implicit < st->x.len; m->implicit++)
+    {
+        if (CSTR_SLICE_LCP(CSTR_SUFFIX(st->x, m->implicit), m->p) == m->p.len)
+        {
+            return m->implicit++;
+        }
+    }
+    return -1;
+}
+
+static void online_free(struct online_matcher *m)
+{
+    free(m->stack);
+    free(m);
+}
+
+static cstr_exact_matcher_vtab online_matcher_vtab = {.next = (next_f)online_next_match, .free = (free_f)online_free};
+
+static cstr_exact_matcher *online_matcher(cstr_suffix_tree *st, node_ref v, cstr_const_sslice p)
+{
+    struct online_matcher *m = CSTR_MALLOC_FLEX_ARRAY(m, p_buf, (size_t)p.len);
+    m->matcher.vtab = &online_matcher_vtab;
+    m->st = st;
+    memcpy(m->p_buf, p.buf, (size_t)p.len);
+    m->p = CSTR_SLICE((const uint8_t *)m->p_buf, p.len);
+    m->stack = 0;
+    m->top = m->cap = 0;
+    // If p isn't in the tree, it isn't anywhere in x
+    m->implicit = st->x.len;
+    if (v != NO_NODE)
+    {
+        push(m, v);
+        m->implicit = st->x.len - st->ukkonen.remainder;
+    }
     return (cstr_exact_matcher *)m;
 }
 
 cstr_exact_matcher *cstr_st_exact_search(cstr_suffix_tree *st, cstr_const_sslice p)
 {
-    node *n = 0;
+    node_ref v = NO_NODE;
     scan_res res = slow_scan(st, st->root, p);
     switch (res.result)
     {
     case NODE_MATCH:
-        n = res.node_match.n;
+        v = res.node_match.n;
         break;
 
     case EDGE_MATCH:
-        n = res.edge_match.n;
+        v = res.edge_match.n;
         break;
 
     case NODE_MISMATCH:
         // [[fallthrough]];
     case EDGE_MISMATCH:
-        n = 0;
+        v = NO_NODE;
         break;
     }
 
-    return matcher_from_node(st, n);
+    return st->threaded ? matcher_from_node(st, v) : online_matcher(st, v, p);
 }
 
 cstr_exact_matcher *cstr_st_exact_search_map(cstr_suffix_tree *st, cstr_const_sslice p)
@@ -763,12 +1514,130 @@ cstr_exact_matcher *cstr_st_exact_search_map(cstr_suffix_tree *st, cstr_const_ss
     }
     else
     {
-        m = matcher_from_node(st, 0); // no map means no match
+        // no map means no match
+        m = st->threaded ? matcher_from_node(st, NO_NODE) : online_matcher(st, NO_NODE, p);
     }
     free(p_buf);
     return m;
 }
 
+// MARK: Flattening
+
+// A depth-first traversal that numbers the inner nodes and leaves in the
+// order we see them. We reserve a node's run of children when we see the
+// node, and each child fills in its slot when we get to it.
+struct flat_frame
+{
+    node_ref v;
+    uint32_t slot; // Where v goes in its parent's children
+    uint32_t parent_depth;
+};
+
+#define NO_SLOT UINT32_MAX
+
+static void push_frame(struct flat_frame **stack, long long *top, long long *cap, struct flat_frame f)
+{
+    if (*top == *cap)
+    {
+        *cap = *cap ? 2 * *cap : 64;
+        *stack = cstr_realloc_buffer(*stack, sizeof **stack, (size_t)*cap);
+    }
+    (*stack)[(*top)++] = f;
+}
+
+void cstr_st_flatten(cstr_suffix_tree *st, struct st_flat *flat)
+{
+    assert(st->threaded); // Only complete trees
+    long long n = st->x.len;
+    flat->alpha = st->alpha;
+    flat->x = st->x;
+
+    // There are no more inner nodes than leaves, and every node but the
+    // root is a child.
+    size_t max_nodes = n > 0 ? (size_t)n : 1;
+    flat->nodes = cstr_malloc_buffer(sizeof *flat->nodes, max_nodes);
+    flat->leaves = cstr_malloc_buffer(sizeof *flat->leaves, max_nodes);
+    flat->child_refs = cstr_malloc_buffer(sizeof *flat->child_refs, 2 * max_nodes);
+    flat->child_letters = cstr_malloc_buffer(sizeof *flat->child_letters, 2 * max_nodes);
+
+    long long no_nodes = 0, no_leaves = 0, no_children = 0;
+    struct flat_frame *stack = 0;
+    long long top = 0, cap = 0;
+    push_frame(&stack, &top, &cap, (struct flat_frame){.v = st->root, .slot = NO_SLOT, .parent_depth = 0});
+    while (top > 0)
+    {
+        struct flat_frame f = stack[--top];
+        uint32_t ref;
+        if (is_leaf(f.v))
+        {
+            ref = (uint32_t)no_leaves | ST_FLAT_LEAF;
+            flat->leaves[no_leaves++] = f.v; // A leaf is its suffix
+        }
+        else
+        {
+            ref = (uint32_t)no_nodes;
+            struct st_flat_node *node = &flat->nodes[no_nodes++];
+            // We never look at the root's edge, so we don't use it here either
+            uint32_t depth = (f.v == st->root) ? 0 : f.parent_depth + (uint32_t)get_edge(st, f.v).len;
+            node->depth = depth;
+            node->lo = (uint32_t)no_leaves;
+            node->children = (uint32_t)no_children;
+
+            node_ref *beg, *end;
+            get_children(st, f.v, &beg, &end);
+            uint32_t k = 0;
+            for (node_ref *w = beg; w != end; w++)
+            {
+                if (*w != NO_NODE)
+                {
+                    flat->child_letters[no_children + k++] = get_edge(st, *w).buf[0];
+                }
+            }
+            node->no_children = k;
+            // Backwards, so we pop the first child first
+            for (node_ref *w = end; w != beg; w--)
+            {
+                if (w[-1] != NO_NODE)
+                {
+                    struct flat_frame child = {.v = w[-1], .slot = (uint32_t)no_children + --k, .parent_depth = depth};
+                    push_frame(&stack, &top, &cap, child);
+                }
+            }
+            no_children += node->no_children;
+        }
+        if (f.slot != NO_SLOT)
+        {
+            flat->child_refs[f.slot] = ref;
+        }
+    }
+    free(stack);
+
+    // A node's leaves end where its last child's leaves end, and the
+    // children come after the node, so we go backwards.
+    for (long long i = no_nodes - 1; i >= 0; i--)
+    {
+        struct st_flat_node *node = &flat->nodes[i];
+        if (node->no_children == 0)
+        {
+            node->hi = node->lo; // Only the root of an empty tree
+            continue;
+        }
+        uint32_t last = flat->child_refs[node->children + node->no_children - 1];
+        node->hi = (last & ST_FLAT_LEAF) ? (last & ~ST_FLAT_LEAF) + 1 : flat->nodes[last].hi;
+    }
+
+    flat->no_nodes = no_nodes;
+    flat->no_children = no_children;
+}
+
+void cstr_free_st_flat(struct st_flat *flat)
+{
+    free(flat->nodes);
+    free(flat->leaves);
+    free(flat->child_refs);
+    free(flat->child_letters);
+}
+
 #ifdef GEN_UNIT_TESTS // unit testing of static functions...
 
 TL_TEST(st_constructing_leaves)
@@ -788,9 +1657,9 @@ TL_TEST(st_constructing_leaves)
 
     for (long long i = 0; i < x.len; i++)
     {
-        node *leaf = get_suffix_leaf(st, i);
-        TL_FATAL_IF_NEQ_LL(leaf->range.leaf, i);
-        TL_FATAL_IF_NEQ_LL(leaf->range.beg, i);
+        node_ref leaf = (node_ref)i;
+        TL_FATAL_IF(!is_leaf(leaf));
+        TL_FATAL_IF_NEQ_LL((long long)leaf_ptr(st, leaf)->beg, i);
         TL_FATAL_IF_NEQ_SLICE(CSTR_SUFFIX(x, i), get_edge(st, leaf));
     }
 
@@ -816,17 +1685,17 @@ TL_TEST(st_constructing_inner_nodes)
     cstr_suffix_tree *st = new_suffix_tree(&alpha, x);
 
     // Let's try adding the first leaf as a child to the root
-    set_child(st, st->root, get_suffix_leaf(st, 0));
+    set_child(st, st->root, (node_ref)0);
 
     // The root should have sigma children
-    node **beg, **end;
-    get_children(st, (node *)st->root, &beg, &end);
+    node_ref *beg, *end;
+    get_children(st, st->root, &beg, &end);
     assert(end - beg == st->alpha->size);
 
     int no_children = 0;
-    for (node **n = beg; n != end; n++)
+    for (node_ref *n = beg; n != end; n++)
     {
-        if (*n)
+        if (*n != NO_NODE)
         {
             no_children++;
         }
@@ -835,24 +1704,24 @@ TL_TEST(st_constructing_inner_nodes)
     TL_FATAL_IF_NEQ_INT(no_children, 1);
 
     // The child we inserted should be the one we got if we asked for that out edge
-    node *child = get_child(st->root, st->x.buf[0]);
-    assert(child == get_suffix_leaf(st, 0));
+    node_ref child = get_child(st, st->root, st->x.buf[0]);
+    assert(child == (node_ref)0);
 
     // A leaf should have zero children
-    get_children(st, get_suffix_leaf(st, 0), &beg, &end);
+    get_children(st, (node_ref)0, &beg, &end);
     assert(end == beg);
 
     // Try adding "ississippi"
-    set_child(st, st->root, get_suffix_leaf(st, 1));
+    set_child(st, st->root, (node_ref)1);
     // and "ssissippi"
-    set_child(st, st->root, get_suffix_leaf(st, 2));
+    set_child(st, st->root, (node_ref)2);
     // but not more for now, we don't want to hit used slots...
 
-    get_children(st, (node *)st->root, &beg, &end);
+    get_children(st, st->root, &beg, &end);
     no_children = 0;
-    for (node **n = beg; n != end; n++)
+    for (node_ref *n = beg; n != end; n++)
     {
-        if (*n)
+        if (*n != NO_NODE)
         {
             no_children++;
         }
@@ -882,38 +1751,38 @@ TL_TEST(st_attempted_scans)
     cstr_suffix_tree *st = new_suffix_tree(&alpha, x);
 
     // Adding "mississippi"
-    set_child(st, st->root, get_suffix_leaf(st, 0));
+    set_child(st, st->root, (node_ref)0);
     // "ississippi"
-    set_child(st, st->root, get_suffix_leaf(st, 1));
+    set_child(st, st->root, (node_ref)1);
     // and "ssissippi"
-    set_child(st, st->root, get_suffix_leaf(st, 2));
+    set_child(st, st->root, (node_ref)2);
 
     cstr_const_sslice p = CSTR_SUFFIX(x, 0);
     scan_res res = slow_scan(st, st->root, p);
     assert(res.result == NODE_MATCH);
-    assert(res.node_match.n == get_suffix_leaf(st, 0));
+    assert(res.node_match.n == (node_ref)0);
 
     res = fast_scan(st, st->root, p);
     assert(res.result == NODE_MATCH);
-    assert(res.node_match.n == get_suffix_leaf(st, 0));
+    assert(res.node_match.n == (node_ref)0);
 
     p = CSTR_SUFFIX(x, 1);
     res = slow_scan(st, st->root, p);
     assert(res.result == NODE_MATCH);
-    assert(res.node_match.n == get_suffix_leaf(st, 1));
+    assert(res.node_match.n == (node_ref)1);
 
     res = fast_scan(st, st->root, p);
     assert(res.result == NODE_MATCH);
-    assert(res.node_match.n == get_suffix_leaf(st, 1));
+    assert(res.node_match.n == (node_ref)1);
 
     p = CSTR_SUFFIX(x, 2);
     res = slow_scan(st, st->root, p);
     assert(res.result == NODE_MATCH);
-    assert(res.node_match.n == get_suffix_leaf(st, 2));
+    assert(res.node_match.n == (node_ref)2);
 
     res = fast_scan(st, st->root, p);
     assert(res.result == NODE_MATCH);
-    assert(res.node_match.n == get_suffix_leaf(st, 2));
+    assert(res.node_match.n == (node_ref)2);
 
     /*
      x = [2, 1, 4, 4, 1, 4, 4, 2, 2, 0]
@@ -921,24 +1790,24 @@ TL_TEST(st_attempted_scans)
     cstr_const_sslice w = CSTR_SLICE_STRING((const char *)"\2\1\4\1"); // should mismatch on 3
     res = slow_scan(st, st->root, w);
     assert(res.result == EDGE_MISMATCH);
-    assert(res.edge_mismatch.n == get_suffix_leaf(st, 0));
+    assert(res.edge_mismatch.n == (node_ref)0);
     assert(res.edge_mismatch.shared == 3);
 
     w = CSTR_SLICE_STRING((const char *)"\2\1\4"); // should match on 3
     res = slow_scan(st, st->root, w);
     assert(res.result == EDGE_MATCH);
-    assert(res.edge_match.n == get_suffix_leaf(st, 0));
+    assert(res.edge_match.n == (node_ref)0);
     assert(res.edge_match.shared == 3);
 
     // Try breaking the edge at this location. It won't be a suffix tree now,
     // it has a node with only one child, but its something we need later
-    inner_node *new_node = break_edge(st, get_suffix_leaf(st, 0), 3LL);
-    cstr_const_sslice new_edge = get_edge(st, (node *)new_node);
+    node_ref new_node = break_edge(st, (node_ref)0, 3LL);
+    cstr_const_sslice new_edge = get_edge(st, new_node);
     assert(new_edge.len = 3LL);
     // leaf_id(0) should now have the new node as its parent
     // and a shorter edge.
-    assert(get_suffix_leaf(st, 0)->parent == new_node);
-    TL_FATAL_IF_NEQ_LL(get_edge(st, get_suffix_leaf(st, 0)).len, x.len - 3LL);
+    assert(get_parent(st, 0) == new_node);
+    TL_FATAL_IF_NEQ_LL(get_edge(st, (node_ref)0).len, x.len - 3LL);
 
     cstr_free_suffix_tree(st);
     free(x_buf);
@@ -948,16 +1817,16 @@ TL_TEST(st_attempted_scans)
 
 static void thread_traverse(cstr_suffix_tree *st)
 {
-    node *r = (node *)st->root;
-    printf("r is %p\n", (void *)r);
-    node *n = r->next;
-    while (n)
+    node_ref r = st->root;
+    printf("r is %x\n", r);
+    node_ref n = get_next(st, r);
+    while (n != NO_NODE)
     {
         if (is_leaf(n))
         {
-            printf("%lld\n", n->range.leaf);
+            printf("%u\n", n);
         }
-        n = n->next;
+        n = get_next(st, n);
     }
 }
 
@@ -976,20 +1845,20 @@ TL_TEST(st_dft)
 
     cstr_suffix_tree *st = cstr_naive_suffix_tree(&alpha, x);
 
-    node *sentinel_leaf = get_child(st->root, 0);
+    node_ref sentinel_leaf = get_child(st, st->root, 0);
     assert(is_leaf(sentinel_leaf));
-    assert(sentinel_leaf->range.leaf == 11LL);
+    assert(sentinel_leaf == 11);
 
-    node *i_node = get_child(st->root, 1);
+    node_ref i_node = get_child(st, st->root, 1);
     assert(!is_leaf(i_node));
 
-    node *mississippi_leaf = get_child(st->root, 2);
+    node_ref mississippi_leaf = get_child(st, st->root, 2);
     assert(is_leaf(mississippi_leaf));
-    assert(mississippi_leaf->range.leaf == 0LL);
+    assert(mississippi_leaf == 0);
 
-    node *p_node = get_child(st->root, 3);
+    node_ref p_node = get_child(st, st->root, 3);
     assert(!is_leaf(p_node));
-    node *s_node = get_child(st->root, 4);
+    node_ref s_node = get_child(st, st->root, 4);
     assert(!is_leaf(s_node));
 
     printf("Threaded depth-first traversal\n");
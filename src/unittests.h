@@ -13,6 +13,7 @@ TL_TEST(skew_test_len_calc);
 TL_TEST(buckets_mississippi);
 TL_TEST(sais_classify_sl_mississippi);
 TL_TEST(sais_classify_sl_random);
+TL_TEST(sais_par_classify_sl);
 TL_TEST(buckets_lms_mississippi);
 TL_TEST(induce_mississippi);
 
@@ -235,6 +235,31 @@ static TL_TEST(lcp)
     TL_END();
 }
 
+static TL_TEST(integer_slices)
+{
+    TL_BEGIN();
+
+    uint16_t x16[] = {1, 2, 3, 65535};
+    uint16_t y16[] = {1, 2, 4};
+    cstr_u16slice x = CSTR_SLICE(x16, 4);
+    cstr_u16slice y = CSTR_SLICE(y16, 3);
+    TL_ERROR_IF_NEQ_LL(CSTR_SLICE_LCP(x, y), 2ll);
+    TL_ERROR_IF(!CSTR_SLICE_LE(x, y));
+    TL_ERROR_IF(!CSTR_SLICE_EQ(CSTR_PREFIX(x, 2), CSTR_PREFIX(y, 2)));
+    CSTR_REV_SLICE(x);
+    TL_ERROR_IF_NEQ_LL((long long)CSTR_IDX(x, 0), 65535ll);
+    TL_ERROR_IF_NEQ_LL((long long)CSTR_IDX(CSTR_SLICE_CONST_CAST(x), -1), 1ll);
+
+    cstr_u64slice_buf *buf = cstr_alloc_u64slice_buf(0, 1);
+    CSTR_BUF_APPEND(buf, UINT64_MAX);
+    cstr_u64slice_buf_slice z = CSTR_BUF_APPEND(buf, 42);
+    uint64_t expected[] = {UINT64_MAX, 42};
+    TL_ERROR_IF(!CSTR_SLICE_EQ(CSTR_SLICE(expected, 2), CSTR_BUF_SLICE_DEREF(z)));
+    free(buf);
+
+    TL_END();
+}
+
 int main(void)
 {
     TL_BEGIN_TEST_SUITE("cstr");
@@ -243,5 +268,6 @@ int main(void)
     TL_RUN_TEST(eq);
     TL_RUN_TEST(buf);
     TL_RUN_TEST(lcp);
+    TL_RUN_TEST(integer_slices);
     TL_END_SUITE();
 }
@@ -262,6 +262,44 @@ static cstr_exact_matcher *mcc_st_matcher(cstr_const_sslice x, cstr_const_sslice
     return (cstr_exact_matcher *)matcher;
 }
 
+static cstr_exact_matcher *ukk_st_matcher(cstr_const_sslice x, cstr_const_sslice p)
+{
+    struct st_matcher *matcher = cstr_malloc(sizeof *matcher);
+    matcher->matcher = (cstr_exact_matcher){ .vtab = &st_matcher_vtab };
+
+    matcher->alpha = cstr_malloc(sizeof *matcher->alpha);
+    cstr_init_alphabet(matcher->alpha, x);
+    matcher->x_buf = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*matcher->x_buf, x, matcher->alpha);
+    matcher->st = cstr_ukkonen_suffix_tree(matcher->alpha, CSTR_SLICE_CONST_CAST(*matcher->x_buf));
+    matcher->m = cstr_st_exact_search_map(matcher->st, p);
+
+    return (cstr_exact_matcher *)matcher;
+}
+
+static cstr_exact_matcher *lcp_st_matcher(cstr_const_sslice x, cstr_const_sslice p)
+{
+    struct st_matcher *matcher = cstr_malloc(sizeof *matcher);
+    matcher->matcher = (cstr_exact_matcher){ .vtab = &st_matcher_vtab };
+
+    matcher->alpha = cstr_malloc(sizeof *matcher->alpha);
+    cstr_init_alphabet(matcher->alpha, x);
+    matcher->x_buf = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*matcher->x_buf, x, matcher->alpha);
+    cstr_const_sslice mapped = CSTR_SLICE_CONST_CAST(*matcher->x_buf);
+
+    // The tree doesn't need the arrays once it is built
+    cstr_suffix_array *sa = cstr_alloc_uislice(x.len);
+    cstr_uislice *lcp = cstr_alloc_uislice(x.len);
+    cstr_sais_lcp(*sa, *lcp, mapped, matcher->alpha);
+    matcher->st = cstr_lcp_suffix_tree(matcher->alpha, mapped, *sa, *lcp);
+    free(lcp);
+    free(sa);
+
+    matcher->m = cstr_st_exact_search_map(matcher->st, p);
+
+    return (cstr_exact_matcher *)matcher;
+}
 
 struct sa_matcher
 {
@@ -306,6 +344,143 @@ static cstr_exact_matcher *sa_matcher(cstr_const_sslice x, cstr_const_sslice p)
 }
 
 
+struct esa_matcher
+{
+    cstr_exact_matcher matcher;
+    cstr_suffix_array *sa;
+    cstr_esa *esa;
+    cstr_exact_matcher *m;
+};
+
+static long long esa_next(struct esa_matcher *m)
+{
+    return cstr_exact_next_match(m->m);
+}
+
+static void esa_free(struct esa_matcher *m)
+{
+    cstr_free_exact_matcher(m->m);
+    cstr_free_esa(m->esa);
+    free(m->sa);
+    free(m);
+}
+
+static cstr_exact_matcher_vtab esa_matcher_vtab = {.next = (next_f)esa_next, .free = (free_f)esa_free};
+
+static cstr_exact_matcher *esa_matcher(cstr_const_sslice x, cstr_const_sslice p)
+{
+    struct esa_matcher *m = cstr_malloc(sizeof *m);
+    m->matcher = (cstr_exact_matcher){.vtab = &esa_matcher_vtab};
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_sslice *w_buf = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*w_buf, x, &alpha);
+
+    m->sa = cstr_alloc_uislice(x.len);
+    cstr_sais_sslice(*m->sa, CSTR_SLICE_CONST_CAST(*w_buf), &alpha);
+    m->esa = cstr_esa_preprocess(*m->sa, x);
+    m->m = cstr_esa_search(m->esa, p);
+
+    free(w_buf);
+
+    return (cstr_exact_matcher *)m;
+}
+
+
+// Small enough that k is a few characters even for the longer test strings
+#define KMER_TABLE_BYTES (1 << 12)
+
+struct kmer_matcher
+{
+    cstr_exact_matcher matcher;
+    cstr_suffix_array *sa;
+    cstr_kmer_table *tab;
+    cstr_exact_matcher *m;
+};
+
+static long long kmer_next(struct kmer_matcher *m)
+{
+    return cstr_exact_next_match(m->m);
+}
+
+static void kmer_free(struct kmer_matcher *m)
+{
+    cstr_free_exact_matcher(m->m);
+    cstr_free_kmer_table(m->tab);
+    free(m->sa);
+    free(m);
+}
+
+static cstr_exact_matcher_vtab kmer_matcher_vtab = {.next = (next_f)kmer_next, .free = (free_f)kmer_free};
+
+static cstr_exact_matcher *sa_kmer_matcher(cstr_const_sslice x, cstr_const_sslice p)
+{
+    struct kmer_matcher *m = cstr_malloc(sizeof *m);
+    m->matcher = (cstr_exact_matcher){.vtab = &kmer_matcher_vtab};
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_sslice *w_buf = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*w_buf, x, &alpha);
+
+    m->sa = cstr_alloc_uislice(x.len);
+    cstr_sais_sslice(*m->sa, CSTR_SLICE_CONST_CAST(*w_buf), &alpha);
+    m->tab = cstr_build_kmer_table(x, &alpha, KMER_TABLE_BYTES);
+    m->m = cstr_sa_kmer_search(*m->sa, x, m->tab, p);
+
+    free(w_buf);
+
+    return (cstr_exact_matcher *)m;
+}
+
+
+// Small enough that the small test strings get more than one sample
+#define SAMPLE_INDEX_K 3
+
+struct sample_matcher
+{
+    cstr_exact_matcher matcher;
+    cstr_suffix_array *sa;
+    cstr_sa_sample_index *idx;
+    cstr_exact_matcher *m;
+};
+
+static long long sample_next(struct sample_matcher *m)
+{
+    return cstr_exact_next_match(m->m);
+}
+
+static void sample_free(struct sample_matcher *m)
+{
+    cstr_free_exact_matcher(m->m);
+    cstr_free_sa_sample_index(m->idx);
+    free(m->sa);
+    free(m);
+}
+
+static cstr_exact_matcher_vtab sample_matcher_vtab = {.next = (next_f)sample_next, .free = (free_f)sample_free};
+
+static cstr_exact_matcher *sa_sample_matcher(cstr_const_sslice x, cstr_const_sslice p)
+{
+    struct sample_matcher *m = cstr_malloc(sizeof *m);
+    m->matcher = (cstr_exact_matcher){.vtab = &sample_matcher_vtab};
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_sslice *w_buf = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*w_buf, x, &alpha);
+
+    m->sa = cstr_alloc_uislice(x.len);
+    cstr_sais_sslice(*m->sa, CSTR_SLICE_CONST_CAST(*w_buf), &alpha);
+    m->idx = cstr_sa_sample_index_build(*m->sa, x, SAMPLE_INDEX_K);
+    m->m = cstr_sa_sample_index_search(m->idx, p);
+
+    free(w_buf);
+
+    return (cstr_exact_matcher *)m;
+}
+
 struct bwt_matcher
 {
     cstr_exact_matcher matcher;
@@ -336,16 +511,39 @@ static cstr_exact_matcher *bwt_matcher(cstr_const_sslice x, cstr_const_sslice p)
     return (cstr_exact_matcher *)m;
 }
 
+static cstr_exact_matcher *bwt_kmer_matcher(cstr_const_sslice x, cstr_const_sslice p)
+{
+    struct bwt_matcher *m = cstr_malloc(sizeof *m);
+    m->matcher.vtab = &bwt_matcher_vtab;
+    m->preproc = cstr_bwt_preprocess_kmer(x, KMER_TABLE_BYTES);
+    m->m = cstr_fmindex_search(m->preproc, p);
+    return (cstr_exact_matcher *)m;
+}
+
+// Auto selection when we have no index
+static cstr_exact_matcher *auto_matcher(cstr_const_sslice x, cstr_const_sslice p)
+{
+    return cstr_auto_matcher(0, x, p, 0, 0);
+}
+
 static TL_TEST(simple_test)
 {
     TL_BEGIN();
     TL_RUN_PARAM_TEST(test_simple_cases_p, "naive", cstr_naive_matcher);
     TL_RUN_PARAM_TEST(test_simple_cases_p, "ba", cstr_ba_matcher);
     TL_RUN_PARAM_TEST(test_simple_cases_p, "kmp", cstr_kmp_matcher);
+    TL_RUN_PARAM_TEST(test_simple_cases_p, "packed", cstr_packed_dna_matcher);
+    TL_RUN_PARAM_TEST(test_simple_cases_p, "auto", auto_matcher);
     TL_RUN_PARAM_TEST(test_simple_cases_p, "naive-st", naive_st_matcher);
     TL_RUN_PARAM_TEST(test_simple_cases_p, "mcc-st", mcc_st_matcher);
+    TL_RUN_PARAM_TEST(test_simple_cases_p, "ukk-st", ukk_st_matcher);
+    TL_RUN_PARAM_TEST(test_simple_cases_p, "lcp-st", lcp_st_matcher);
     TL_RUN_PARAM_TEST(test_simple_cases_p, "sa_bsearch", sa_matcher);
+    TL_RUN_PARAM_TEST(test_simple_cases_p, "esa", esa_matcher);
+    TL_RUN_PARAM_TEST(test_simple_cases_p, "sa_kmer", sa_kmer_matcher);
+    TL_RUN_PARAM_TEST(test_simple_cases_p, "sa_sample", sa_sample_matcher);
     TL_RUN_PARAM_TEST(test_simple_cases_p, "fmindex", bwt_matcher);
+    TL_RUN_PARAM_TEST(test_simple_cases_p, "fmindex_kmer", bwt_kmer_matcher);
     TL_END();
 }
 
@@ -355,10 +553,18 @@ static TL_TEST(test_random_string)
     TL_RUN_PARAM_TEST(test_random_string_p, "naive", cstr_naive_matcher);
     TL_RUN_PARAM_TEST(test_random_string_p, "ba", cstr_ba_matcher);
     TL_RUN_PARAM_TEST(test_random_string_p, "kmp", cstr_kmp_matcher);
+    TL_RUN_PARAM_TEST(test_random_string_p, "packed", cstr_packed_dna_matcher);
+    TL_RUN_PARAM_TEST(test_random_string_p, "auto", auto_matcher);
     TL_RUN_PARAM_TEST(test_random_string_p, "naive-st", naive_st_matcher);
     TL_RUN_PARAM_TEST(test_random_string_p, "mcc-st", mcc_st_matcher);
+    TL_RUN_PARAM_TEST(test_random_string_p, "ukk-st", ukk_st_matcher);
+    TL_RUN_PARAM_TEST(test_random_string_p, "lcp-st", lcp_st_matcher);
     TL_RUN_PARAM_TEST(test_random_string_p, "sa_bsearch", sa_matcher);
+    TL_RUN_PARAM_TEST(test_random_string_p, "esa", esa_matcher);
+    TL_RUN_PARAM_TEST(test_random_string_p, "sa_kmer", sa_kmer_matcher);
+    TL_RUN_PARAM_TEST(test_random_string_p, "sa_sample", sa_sample_matcher);
     TL_RUN_PARAM_TEST(test_random_string_p, "fmindex", bwt_matcher);
+    TL_RUN_PARAM_TEST(test_random_string_p, "fmindex_kmer", bwt_kmer_matcher);
     TL_END();
 }
 
@@ -368,10 +574,18 @@ static TL_TEST(test_prefix)
     TL_RUN_PARAM_TEST(test_prefix_p, "naive", cstr_naive_matcher);
     TL_RUN_PARAM_TEST(test_prefix_p, "ba", cstr_ba_matcher);
     TL_RUN_PARAM_TEST(test_prefix_p, "kmp", cstr_kmp_matcher);
+    TL_RUN_PARAM_TEST(test_prefix_p, "packed", cstr_packed_dna_matcher);
+    TL_RUN_PARAM_TEST(test_prefix_p, "auto", auto_matcher);
     TL_RUN_PARAM_TEST(test_prefix_p, "naive-st", naive_st_matcher);
     TL_RUN_PARAM_TEST(test_prefix_p, "mcc-st", mcc_st_matcher);
+    TL_RUN_PARAM_TEST(test_prefix_p, "ukk-st", ukk_st_matcher);
+    TL_RUN_PARAM_TEST(test_prefix_p, "lcp-st", lcp_st_matcher);
     TL_RUN_PARAM_TEST(test_prefix_p, "sa_bsearch", sa_matcher);
+    TL_RUN_PARAM_TEST(test_prefix_p, "esa", esa_matcher);
+    TL_RUN_PARAM_TEST(test_prefix_p, "sa_kmer", sa_kmer_matcher);
+    TL_RUN_PARAM_TEST(test_prefix_p, "sa_sample", sa_sample_matcher);
     TL_RUN_PARAM_TEST(test_prefix_p, "fmindex", bwt_matcher);
+    TL_RUN_PARAM_TEST(test_prefix_p, "fmindex_kmer", bwt_kmer_matcher);
     TL_END();
 }
 
@@ -381,16 +595,212 @@ static TL_TEST(test_suffix)
     TL_RUN_PARAM_TEST(test_suffix_p, "naive", cstr_naive_matcher);
     TL_RUN_PARAM_TEST(test_suffix_p, "ba", cstr_ba_matcher);
     TL_RUN_PARAM_TEST(test_suffix_p, "kmp", cstr_kmp_matcher);
+    TL_RUN_PARAM_TEST(test_suffix_p, "packed", cstr_packed_dna_matcher);
+    TL_RUN_PARAM_TEST(test_suffix_p, "auto", auto_matcher);
     TL_RUN_PARAM_TEST(test_suffix_p, "naive-st", naive_st_matcher);
     TL_RUN_PARAM_TEST(test_suffix_p, "mcc-st", mcc_st_matcher);
+    TL_RUN_PARAM_TEST(test_suffix_p, "ukk-st", ukk_st_matcher);
+    TL_RUN_PARAM_TEST(test_suffix_p, "lcp-st", lcp_st_matcher);
     TL_RUN_PARAM_TEST(test_suffix_p, "sa_bsearch", sa_matcher);
+    TL_RUN_PARAM_TEST(test_suffix_p, "esa", esa_matcher);
+    TL_RUN_PARAM_TEST(test_suffix_p, "sa_kmer", sa_kmer_matcher);
+    TL_RUN_PARAM_TEST(test_suffix_p, "sa_sample", sa_sample_matcher);
     TL_RUN_PARAM_TEST(test_suffix_p, "fmindex", bwt_matcher);
+    TL_RUN_PARAM_TEST(test_suffix_p, "fmindex_kmer", bwt_kmer_matcher);
+    TL_END();
+}
+
+static TL_TEST(test_sample_index_k)
+{
+    TL_BEGIN();
+
+    cstr_const_sslice x = CSTR_SLICE_STRING0((const char *)"acgtacgt");
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_sslice *w_buf = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*w_buf, x, &alpha);
+    cstr_suffix_array *sa = cstr_alloc_uislice(x.len);
+    cstr_sais_sslice(*sa, CSTR_SLICE_CONST_CAST(*w_buf), &alpha);
+
+    // There is no such thing as sampling every zeroth suffix
+    TL_ERROR_IF(cstr_sa_sample_index_build(*sa, x, 0));
+    TL_ERROR_IF(cstr_sa_sample_index_build(*sa, x, -1));
+    cstr_sa_sample_index *idx = cstr_sa_sample_index_build(*sa, x, 1);
+    TL_ERROR_IF(!idx);
+    cstr_free_sa_sample_index(idx);
+
+    free(sa);
+    free(w_buf);
+
+    TL_END();
+}
+
+static bool same_matches(cstr_exact_matcher *expected, cstr_exact_matcher *observed)
+{
+    long long e, o;
+    do
+    {
+        e = NEXT(expected);
+        o = NEXT(observed);
+    } while (e == o && e != END);
+    cstr_free_exact_matcher(expected);
+    cstr_free_exact_matcher(observed);
+    return e == o;
+}
+
+static TL_PARAM_TEST(check_packed_dna, const char *letters)
+{
+    TL_BEGIN();
+
+    // Long enough that patterns span several words.
+    cstr_sslice *x_buf = cstr_alloc_sslice(1000);
+    cstr_sslice *q_buf = cstr_alloc_sslice(100);
+    cstr_sslice x = *x_buf;
+    cstr_const_sslice cx = CSTR_SLICE_CONST_CAST(x);
+
+    for (int k = 0; k < 10; k++)
+    {
+        tl_random_string(x, (const uint8_t *)letters, (int)strlen(letters));
+        cstr_packed_dna_preproc *preproc = cstr_packed_dna_preprocess(cx);
+        for (int j = 0; j < 20; j++)
+        {
+            long long len = 1 + rand() % 100;
+            long long start = rand() % (x.len - len);
+            cstr_const_sslice p = CSTR_SUBSLICE(cx, start, start + len);
+            TL_ERROR_IF(!same_matches(cstr_naive_matcher(cx, p), cstr_packed_dna_matcher(cx, p)));
+            TL_ERROR_IF(!same_matches(cstr_naive_matcher(cx, p), cstr_packed_dna_search(preproc, p)));
+
+            // The same bases in the other case pack to the same words
+            // but must not match.
+            cstr_sslice q = CSTR_SUBSLICE(*q_buf, 0, len);
+            for (long long i = 0; i < len; i++)
+            {
+                q.buf[i] = (uint8_t)(p.buf[i] ^ (rand() % 4 == 0 ? 0x20 : 0));
+            }
+            cstr_const_sslice cq = CSTR_SLICE_CONST_CAST(q);
+            TL_ERROR_IF(!same_matches(cstr_naive_matcher(cx, cq), cstr_packed_dna_search(preproc, cq)));
+        }
+        cstr_free_packed_dna_preproc(preproc);
+    }
+
+    free(q_buf);
+    free(x_buf);
+
+    TL_END();
+}
+
+static TL_TEST(test_packed_dna)
+{
+    TL_BEGIN();
+
+    // Only bases, where we never verify, and with a few non-ACGT
+    // symbols and lower case letters that the packed comparison
+    // can't distinguish from bases.
+    TL_RUN_PARAM_TEST(check_packed_dna, "bases", "ACGT");
+    TL_RUN_PARAM_TEST(check_packed_dna, "mixed", "ACGTACGTACGTACGTNa");
+
+    TL_END();
+}
+
+static TL_TEST(test_auto_choose)
+{
+    TL_BEGIN();
+
+    // Without an index we must scan; with DNA the packed scan should win
+    // over the automata, and a long text with an FM-index should use it.
+    cstr_auto_engine e = cstr_auto_choose(0, 1000000, 10, 4, true, false, false);
+    TL_ERROR_IF(e == CSTR_AUTO_SA || e == CSTR_AUTO_FMINDEX);
+    TL_ERROR_IF_NEQ_LL((long long)e, (long long)CSTR_AUTO_PACKED);
+    e = cstr_auto_choose(0, 1000000, 10, 4, true, false, true);
+    TL_ERROR_IF_NEQ_LL((long long)e, (long long)CSTR_AUTO_FMINDEX);
+    e = cstr_auto_choose(0, 1000000, 10, 4, true, true, false);
+    TL_ERROR_IF_NEQ_LL((long long)e, (long long)CSTR_AUTO_SA);
+
+    // A unary alphabet makes naive quadratic, so an automaton is better
+    e = cstr_auto_choose(0, 1000000, 100, 1, false, false, false);
+    TL_ERROR_IF(e != CSTR_AUTO_BA && e != CSTR_AUTO_KMP);
+
+    // Short texts aren't worth an index look-up
+    e = cstr_auto_choose(0, 8, 4, 20, false, true, true);
+    TL_ERROR_IF_NEQ_LL((long long)e, (long long)CSTR_AUTO_NAIVE);
+
+    // Calibrated costs must all be measured, and with them we must
+    // still scan when we have no index, and use an index when we have
+    // one and a short pattern in a long text.
+    cstr_auto_costs costs = cstr_auto_calibrate();
+    TL_ERROR_IF(!(costs.naive > 0.0 && costs.packed > 0.0 && costs.ba > 0.0 &&
+                  costs.kmp > 0.0 && costs.sa_probe > 0.0 && costs.fm_step > 0.0));
+    e = cstr_auto_choose(&costs, 1000000, 10, 4, true, false, false);
+    TL_ERROR_IF(e == CSTR_AUTO_SA || e == CSTR_AUTO_FMINDEX);
+    e = cstr_auto_choose(&costs, 1000000, 10, 4, true, true, false);
+    TL_ERROR_IF_NEQ_LL((long long)e, (long long)CSTR_AUTO_SA);
+    e = cstr_auto_choose(&costs, 1000000, 10, 4, true, false, true);
+    TL_ERROR_IF_NEQ_LL((long long)e, (long long)CSTR_AUTO_FMINDEX);
+    e = cstr_auto_choose(&costs, 8, 4, 20, false, true, true);
+    TL_ERROR_IF(e == CSTR_AUTO_SA || e == CSTR_AUTO_FMINDEX);
+
+    TL_END();
+}
+
+static TL_TEST(test_auto_with_index)
+{
+    TL_BEGIN();
+
+    cstr_sslice *x_buf = cstr_alloc_sslice(2000);
+    tl_random_string(*x_buf, (const uint8_t *)"acgt", 4);
+    x_buf->buf[x_buf->len - 1] = 0; // Sentinel
+    cstr_const_sslice x = CSTR_SLICE_CONST_CAST(*x_buf);
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_uislice *u_buf = cstr_alloc_uislice(x.len);
+    cstr_alphabet_map_to_uint(*u_buf, x, &alpha);
+    cstr_suffix_array *sa = cstr_alloc_uislice(x.len);
+    cstr_sais(*sa, CSTR_SLICE_CONST_CAST(*u_buf), &alpha);
+    cstr_bwt_preproc *fmindex = cstr_bwt_preprocess(x);
+
+    for (int j = 0; j < 20; j++)
+    {
+        long long len = 1 + rand() % 10;
+        long long start = rand() % (x.len - len - 1);
+        cstr_const_sslice p = CSTR_SUBSLICE(x, start, start + len);
+
+        // Indices report matches in suffix order, so compare sets
+        cstr_bit_vector *expected = cstr_new_bv_init(x.len);
+        cstr_bit_vector *observed = cstr_new_bv_init(x.len);
+        cstr_exact_matcher *m = cstr_naive_matcher(x, p);
+        for (long long i = NEXT(m); i != END; i = NEXT(m))
+        {
+            cstr_bv_set(expected, i, true);
+        }
+        cstr_free_exact_matcher(m);
+        m = cstr_auto_matcher(0, x, p, sa, fmindex);
+        for (long long i = NEXT(m); i != END; i = NEXT(m))
+        {
+            cstr_bv_set(observed, i, true);
+        }
+        cstr_free_exact_matcher(m);
+
+        TL_ERROR_IF(!cstr_bv_eq(expected, observed));
+        free(expected);
+        free(observed);
+    }
+
+    cstr_free_bwt_preproc(fmindex);
+    free(sa);
+    free(u_buf);
+    free(x_buf);
+
     TL_END();
 }
 
 int main(void)
 {
     TL_BEGIN_TEST_SUITE("exact_test");
+    TL_RUN_TEST(test_sample_index_k);
+    TL_RUN_TEST(test_packed_dna);
+    TL_RUN_TEST(test_auto_choose);
+    TL_RUN_TEST(test_auto_with_index);
     TL_RUN_TEST(simple_test);
     TL_RUN_TEST(test_random_string);
     TL_RUN_TEST(test_prefix);
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testlib.h"
+#include <cstr.h>
+
+static TL_TEST(test_locate)
+{
+    TL_BEGIN();
+
+    cstr_const_sslice x[] = {
+        CSTR_SLICE_STRING((const char *)"abc"),
+        CSTR_SLICE_STRING((const char *)""),
+        CSTR_SLICE_STRING((const char *)"ba"),
+    };
+    cstr_gsa *gsa = cstr_gsa_build(3, x);
+    TL_FATAL_IF(!gsa);
+    TL_ERROR_IF_NEQ_LL(cstr_gsa_records(gsa), 3LL);
+
+    // abc$ $ ba$
+    long long record[] = {0, 0, 0, 0, 1, 2, 2};
+    long long pos[] = {0, 1, 2, 3, 0, 0, 1};
+    for (long long i = 0; i < 7; i++)
+    {
+        cstr_gsa_match m = cstr_gsa_locate(gsa, i);
+        TL_ERROR_IF_NEQ_LL(m.record, record[i]);
+        TL_ERROR_IF_NEQ_LL(m.pos, pos[i]);
+    }
+
+    // "cb" only occurs across the boundary, so it must not match,
+    // and "d" isn't in the alphabet at all.
+    cstr_gsa_matcher *m = cstr_gsa_search(gsa, CSTR_SLICE_STRING((const char *)"cb"));
+    TL_ERROR_IF_NEQ_LL(cstr_gsa_next_match(m).record, -1LL);
+    cstr_free_gsa_matcher(m);
+    m = cstr_gsa_search(gsa, CSTR_SLICE_STRING((const char *)"d"));
+    TL_ERROR_IF_NEQ_LL(cstr_gsa_next_match(m).record, -1LL);
+    cstr_free_gsa_matcher(m);
+
+    cstr_free_gsa(gsa);
+
+    TL_END();
+}
+
+// The empty pattern matches everywhere in the records, and
+// nowhere on the separators or the sentinel.
+static TL_TEST(test_empty_pattern)
+{
+    TL_BEGIN();
+
+    cstr_const_sslice empty = CSTR_SLICE_STRING((const char *)"");
+    cstr_const_sslice x[] = {
+        CSTR_SLICE_STRING((const char *)"ab"),
+        CSTR_SLICE_STRING((const char *)"c"),
+    };
+    cstr_gsa *gsa = cstr_gsa_build(2, x);
+    TL_FATAL_IF(!gsa);
+
+    bool seen[2][2] = {{false, false}, {false, false}};
+    long long no_matches = 0;
+    cstr_gsa_matcher *m = cstr_gsa_search(gsa, empty);
+    for (cstr_gsa_match match = cstr_gsa_next_match(m); match.record != -1; match = cstr_gsa_next_match(m))
+    {
+        TL_FATAL_IF(match.record < 0 || match.record >= 2);
+        TL_FATAL_IF(match.pos < 0 || match.pos >= x[match.record].len);
+        TL_ERROR_IF(seen[match.record][match.pos]);
+        seen[match.record][match.pos] = true;
+        no_matches++;
+    }
+    cstr_free_gsa_matcher(m);
+    TL_ERROR_IF_NEQ_LL(no_matches, 3LL);
+    cstr_free_gsa(gsa);
+
+    // Without records there is nothing to match
+    gsa = cstr_gsa_build(0, x);
+    TL_FATAL_IF(!gsa);
+    m = cstr_gsa_search(gsa, empty);
+    TL_ERROR_IF_NEQ_LL(cstr_gsa_next_match(m).record, -1LL);
+    cstr_free_gsa_matcher(m);
+    cstr_free_gsa(gsa);
+
+    TL_END();
+}
+
+// All matches in all records, compared with the naive matcher on each record
+static TL_TEST(test_random_records)
+{
+    TL_BEGIN();
+
+    const long long k = 10;
+    cstr_sslice *bufs[10];
+    cstr_const_sslice x[10];
+    for (long long r = 0; r < k; r++)
+    {
+        bufs[r] = cstr_alloc_sslice(50 + rand() % 200);
+        tl_random_string(*bufs[r], (const uint8_t *)"acgt", 4);
+        x[r] = CSTR_SLICE_CONST_CAST(*bufs[r]);
+    }
+    cstr_gsa *gsa = cstr_gsa_build(k, x);
+    TL_FATAL_IF(!gsa);
+
+    for (int rep = 0; rep < 100; rep++)
+    {
+        long long r = rand() % k;
+        long long len = 1 + rand() % 8;
+        long long i = rand() % (x[r].len - len);
+        cstr_const_sslice p = CSTR_SUBSLICE(x[r], i, i + len);
+
+        cstr_bit_vector *expected[10], *observed[10];
+        for (long long s = 0; s < k; s++)
+        {
+            expected[s] = cstr_new_bv_init(x[s].len);
+            observed[s] = cstr_new_bv_init(x[s].len);
+            cstr_exact_matcher *naive = cstr_naive_matcher(x[s], p);
+            for (long long pos = cstr_exact_next_match(naive); pos != -1; pos = cstr_exact_next_match(naive))
+            {
+                cstr_bv_set(expected[s], pos, true);
+            }
+            cstr_free_exact_matcher(naive);
+        }
+
+        cstr_gsa_matcher *m = cstr_gsa_search(gsa, p);
+        for (cstr_gsa_match match = cstr_gsa_next_match(m); match.record != -1; match = cstr_gsa_next_match(m))
+        {
+            TL_FATAL_IF(match.record >= k || match.pos >= x[match.record].len);
+            cstr_bv_set(observed[match.record], match.pos, true);
+        }
+        cstr_free_gsa_matcher(m);
+
+        for (long long s = 0; s < k; s++)
+        {
+            TL_ERROR_IF(!cstr_bv_eq(expected[s], observed[s]));
+            free(expected[s]);
+            free(observed[s]);
+        }
+    }
+
+    cstr_free_gsa(gsa);
+    for (long long r = 0; r < k; r++)
+    {
+        free(bufs[r]);
+    }
+
+    TL_END();
+}
+
+int main(void)
+{
+    TL_BEGIN_TEST_SUITE("gsa_test");
+    TL_RUN_TEST(test_locate);
+    TL_RUN_TEST(test_empty_pattern);
+    TL_RUN_TEST(test_random_records);
+    TL_END_SUITE();
+}
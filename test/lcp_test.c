@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testlib.h"
+#include <cstr.h>
+
+// The LCP array the slow way, comparing neighbouring suffixes directly
+static void naive_lcp(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x)
+{
+    lcp.buf[0] = 0;
+    for (long long r = 1; r < sa.len; r++)
+    {
+        long long i = sa.buf[r - 1], j = sa.buf[r], h = 0;
+        while (i + h < x.len && j + h < x.len && x.buf[i + h] == x.buf[j + h])
+        {
+            h++;
+        }
+        lcp.buf[r] = (unsigned int)h;
+    }
+}
+
+typedef void (*lcp_alg)(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x);
+
+static TL_PARAM_TEST(check_lcp, lcp_alg alg, cstr_const_sslice x)
+{
+    TL_BEGIN();
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_sslice *mapped = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*mapped, x, &alpha);
+    cstr_const_sslice y = CSTR_SLICE_CONST_CAST(*mapped);
+
+    cstr_suffix_array *sa = cstr_alloc_uislice(x.len);
+    cstr_uislice *expected = cstr_alloc_uislice(x.len);
+    cstr_uislice *observed = cstr_alloc_uislice(x.len);
+
+    cstr_sais_sslice(*sa, y, &alpha);
+    naive_lcp(*expected, *sa, y);
+    alg(*observed, *sa, y);
+    TL_ERROR_IF(!CSTR_SLICE_EQ(*expected, *observed));
+
+    // The combined construction must give the same arrays
+    cstr_suffix_array *sa2 = cstr_alloc_uislice(x.len);
+    cstr_sais_lcp(*sa2, *observed, y, &alpha);
+    TL_ERROR_IF(!CSTR_SLICE_EQ(*sa, *sa2));
+    TL_ERROR_IF(!CSTR_SLICE_EQ(*expected, *observed));
+
+    free(mapped);
+    free(sa);
+    free(sa2);
+    free(expected);
+    free(observed);
+
+    TL_END();
+}
+
+static TL_PARAM_TEST(test_lcp, lcp_alg alg)
+{
+    TL_BEGIN();
+
+    TL_RUN_PARAM_TEST(check_lcp, "mississippi", alg,
+                      CSTR_SLICE_STRING0((const char *)"mississippi"));
+    TL_RUN_PARAM_TEST(check_lcp, "sentinel only", alg,
+                      CSTR_SLICE_STRING0((const char *)""));
+    TL_RUN_PARAM_TEST(check_lcp, "one letter", alg,
+                      CSTR_SLICE_STRING0((const char *)"aaaaaaaaaaaaaaaaaaaa"));
+
+    const long long n = 10000;
+    cstr_sslice *x = cstr_alloc_sslice(n);
+    for (int k = 0; k < 10; k++)
+    {
+        tl_random_string0(*x, (const uint8_t *)"acgt", 4);
+        TL_RUN_PARAM_TEST(check_lcp, "acgt", alg, CSTR_SLICE_CONST_CAST(*x));
+        tl_random_string0(*x, (const uint8_t *)"ab", 2);
+        TL_RUN_PARAM_TEST(check_lcp, "ab", alg, CSTR_SLICE_CONST_CAST(*x));
+    }
+    // periodic, so the LCP values are long
+    for (long long i = 0; i < n - 1; i++)
+    {
+        x->buf[i] = (uint8_t)"abc"[i % 3];
+    }
+    x->buf[n - 1] = 0;
+    TL_RUN_PARAM_TEST(check_lcp, "periodic", alg, CSTR_SLICE_CONST_CAST(*x));
+    free(x);
+
+    TL_END();
+}
+
+// With a thread count that doesn't divide the lengths evenly
+static void phi_parallel(cstr_uislice lcp, cstr_suffix_array sa, cstr_const_sslice x)
+{
+    cstr_lcp_phi_parallel(lcp, sa, x, 3);
+}
+
+int main(void)
+{
+    TL_BEGIN_TEST_SUITE("lcp_test");
+    TL_RUN_PARAM_TEST(test_lcp, "kasai", cstr_lcp_kasai);
+    TL_RUN_PARAM_TEST(test_lcp, "phi", cstr_lcp_phi);
+    TL_RUN_PARAM_TEST(test_lcp, "phi_parallel", phi_parallel);
+    TL_END_SUITE();
+}
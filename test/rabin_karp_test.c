@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cstr.h>
+
+#include "testlib.h"
+
+static TL_TEST(rk_simple_cases)
+{
+    TL_BEGIN();
+
+    cstr_const_sslice x = CSTR_SLICE_STRING((const char *)"abaabab");
+    cstr_const_sslice p[] = {
+        CSTR_SLICE_STRING((const char *)"ab"),
+        CSTR_SLICE_STRING((const char *)"ba"),
+        CSTR_SLICE_STRING((const char *)"ab"), // duplicates should be reported too
+        CSTR_SLICE_STRING((const char *)"cc"),
+    };
+    long long k = sizeof p / sizeof p[0];
+
+    cstr_rk_preproc *preproc = cstr_rk_preprocess(k, p);
+    cstr_multi_matcher *m = cstr_rk_search(preproc, x);
+
+    // ab at 0, 3, 5; ba at 1, 4
+    long long counts[4] = {0};
+    long long pos_sum[4] = {0};
+    for (cstr_multi_match match = cstr_multi_next_match(m);
+         match.pos != -1;
+         match = cstr_multi_next_match(m))
+    {
+        counts[match.pattern]++;
+        pos_sum[match.pattern] += match.pos;
+    }
+    TL_ERROR_IF_NEQ_LL(counts[0], 3LL);
+    TL_ERROR_IF_NEQ_LL(pos_sum[0], 8LL);
+    TL_ERROR_IF_NEQ_LL(counts[1], 2LL);
+    TL_ERROR_IF_NEQ_LL(pos_sum[1], 5LL);
+    TL_ERROR_IF_NEQ_LL(counts[2], 3LL);
+    TL_ERROR_IF_NEQ_LL(counts[3], 0LL);
+
+    cstr_free_multi_matcher(m);
+
+    // Patterns longer than the text can't match
+    m = cstr_rk_search(preproc, CSTR_SLICE_STRING((const char *)"a"));
+    TL_ERROR_IF_NEQ_LL(cstr_multi_next_match(m).pos, -1LL);
+    cstr_free_multi_matcher(m);
+
+    cstr_free_rk_preproc(preproc);
+
+    TL_END();
+}
+
+static TL_TEST(rk_random_against_naive)
+{
+    TL_BEGIN();
+
+    const long long k = 20, m = 4;
+    cstr_sslice *x = cstr_alloc_sslice(200);
+    cstr_sslice *p_buf = cstr_alloc_sslice(k * m);
+    cstr_const_sslice p[20];
+
+    for (int rep = 0; rep < 10; rep++)
+    {
+        tl_random_string(*x, (const uint8_t *)"acgt", 4);
+        tl_random_string(*p_buf, (const uint8_t *)"acgt", 4);
+        for (long long i = 0; i < k; i++)
+        {
+            p[i] = CSTR_SUBSLICE(CSTR_SLICE_CONST_CAST(*p_buf), i * m, (i + 1) * m);
+        }
+
+        cstr_rk_preproc *preproc = cstr_rk_preprocess(k, p);
+        cstr_multi_matcher *mm = cstr_rk_search(preproc, CSTR_SLICE_CONST_CAST(*x));
+
+        cstr_bit_vector *observed[20];
+        for (long long i = 0; i < k; i++)
+        {
+            observed[i] = cstr_new_bv_init(x->len);
+        }
+        for (cstr_multi_match match = cstr_multi_next_match(mm);
+             match.pos != -1;
+             match = cstr_multi_next_match(mm))
+        {
+            TL_ERROR_IF(cstr_bv_get(observed[match.pattern], match.pos)); // reported twice
+            cstr_bv_set(observed[match.pattern], match.pos, true);
+        }
+        cstr_free_multi_matcher(mm);
+        cstr_free_rk_preproc(preproc);
+
+        for (long long i = 0; i < k; i++)
+        {
+            cstr_bit_vector *expected = cstr_new_bv_init(x->len);
+            cstr_exact_matcher *nm = cstr_naive_matcher(CSTR_SLICE_CONST_CAST(*x), p[i]);
+            for (long long pos = cstr_exact_next_match(nm); pos != -1; pos = cstr_exact_next_match(nm))
+            {
+                cstr_bv_set(expected, pos, true);
+            }
+            cstr_free_exact_matcher(nm);
+
+            TL_ERROR_IF(!cstr_bv_eq(expected, observed[i]));
+            free(expected);
+            free(observed[i]);
+        }
+    }
+
+    free(x);
+    free(p_buf);
+
+    TL_END();
+}
+
+int main(void)
+{
+    TL_BEGIN_TEST_SUITE("rabin_karp_test");
+    TL_RUN_TEST(rk_simple_cases);
+    TL_RUN_TEST(rk_random_against_naive);
+    TL_END_SUITE();
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testlib.h"
+#include <cstr.h>
+
+static const char *fname = "sa_file_test.sa";
+
+static cstr_suffix_array *build_sa(cstr_sslice x, cstr_alphabet *alpha)
+{
+    cstr_const_sslice cx = CSTR_SLICE_CONST_CAST(x);
+    cstr_init_alphabet(alpha, cx);
+    cstr_sslice *mapped = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*mapped, cx, alpha);
+    cstr_suffix_array *sa = cstr_alloc_uislice(x.len);
+    cstr_sais_sslice(*sa, CSTR_SLICE_CONST_CAST(*mapped), alpha);
+    free(mapped);
+    return sa;
+}
+
+static TL_TEST(test_round_trip)
+{
+    TL_BEGIN();
+
+    for (long long n = 1; n < 5000; n = 3 * n + 1)
+    {
+        cstr_sslice *x = cstr_alloc_sslice(n);
+        tl_random_string0(*x, (const uint8_t *)"acgt", 4);
+        cstr_alphabet alpha;
+        cstr_suffix_array *sa = build_sa(*x, &alpha);
+
+        TL_FATAL_IF(!cstr_write_sa(fname, *sa, &alpha));
+        cstr_sa_file *file = cstr_load_sa(fname, true);
+        TL_FATAL_IF(!file);
+        TL_ERROR_IF(!CSTR_SLICE_EQ(*sa, cstr_sa_file_sa(file)));
+        cstr_alphabet const *loaded = cstr_sa_file_alphabet(file);
+        TL_FATAL_IF(!loaded);
+        TL_ERROR_IF_NEQ_UINT(loaded->size, alpha.size);
+        TL_ERROR_IF(memcmp(loaded->map, alpha.map, sizeof alpha.map) != 0);
+        TL_ERROR_IF(memcmp(loaded->revmap, alpha.revmap, sizeof alpha.revmap) != 0);
+
+        // The loaded array works like the one we built
+        cstr_exact_matcher *m = cstr_sa_bsearch(cstr_sa_file_sa(file), CSTR_SLICE_CONST_CAST(*x),
+                                                CSTR_SLICE_STRING((const char *)"a"));
+        long long hits = 0;
+        while (cstr_exact_next_match(m) != -1)
+        {
+            hits++;
+        }
+        cstr_free_exact_matcher(m);
+        long long expected = 0;
+        for (long long i = 0; i < n; i++)
+        {
+            expected += x->buf[i] == 'a';
+        }
+        TL_ERROR_IF_NEQ_LL(hits, expected);
+
+        cstr_free_sa_file(file);
+        free(sa);
+        free(x);
+    }
+
+    // Without an alphabet
+    cstr_suffix_array *empty = cstr_alloc_uislice(0);
+    TL_FATAL_IF(!cstr_write_sa(fname, *empty, 0));
+    cstr_sa_file *file = cstr_load_sa(fname, true);
+    TL_FATAL_IF(!file);
+    TL_ERROR_IF_NEQ_LL(cstr_sa_file_sa(file).len, 0LL);
+    TL_ERROR_IF(cstr_sa_file_alphabet(file));
+    cstr_free_sa_file(file);
+    free(empty);
+
+    remove(fname);
+
+    TL_END();
+}
+
+struct sa_and_alpha
+{
+    cstr_suffix_array *sa;
+    cstr_alphabet alpha;
+};
+
+static void write_sa(const char *name, void *ctx)
+{
+    struct sa_and_alpha *sa = ctx;
+    cstr_write_sa(name, *sa->sa, &sa->alpha);
+}
+
+static bool load_sa(const char *name, bool verify, void *ctx)
+{
+    cstr_sa_file *file = cstr_load_sa(name, verify);
+    if (!file)
+    {
+        return false;
+    }
+    cstr_free_sa_file(file);
+    return true;
+}
+
+static TL_TEST(test_rejected)
+{
+    TL_BEGIN();
+
+    const long long n = 1000;
+    cstr_sslice *x = cstr_alloc_sslice(n);
+    tl_random_string0(*x, (const uint8_t *)"acgt", 4);
+    struct sa_and_alpha ctx;
+    ctx.sa = build_sa(*x, &ctx.alpha);
+
+    TL_RUN_PARAM_TEST(tl_check_rejected_files, "sa", fname, write_sa, load_sa, &ctx);
+
+    free(ctx.sa);
+    free(x);
+
+    TL_END();
+}
+
+int main(void)
+{
+    TL_BEGIN_TEST_SUITE("sa_file_test");
+    TL_RUN_TEST(test_round_trip);
+    TL_RUN_TEST(test_rejected);
+    TL_END_SUITE();
+}
@@ -84,6 +84,487 @@ static TL_PARAM_TEST(test_random, const_alg alg)
     TL_END();
 }
 
+// The parallel constructions must give exactly the same array as the
+// sequential ones. The strings are long enough to use several induce
+// blocks, and the runs test the fix-up of classification across threads.
+typedef void (*par_alg)(cstr_suffix_array sa, cstr_const_uislice x,
+                        cstr_alphabet *alpha, int no_threads);
+typedef void (*par_bytes_alg)(cstr_suffix_array sa, cstr_const_sslice x,
+                              cstr_alphabet *alpha, int no_threads);
+static TL_PARAM_TEST(test_parallel, const_alg seq, par_alg par, par_bytes_alg par_bytes)
+{
+    TL_BEGIN();
+
+    const long long n = 100000;
+    cstr_sslice *x = cstr_alloc_sslice(n);
+    cstr_sslice *bytes = cstr_alloc_sslice(n);
+    cstr_uislice *mapped = cstr_alloc_uislice(n);
+    cstr_suffix_array *expected = cstr_alloc_uislice(n);
+    cstr_suffix_array *observed = cstr_alloc_uislice(n);
+
+    for (int k = 0; k < 4; k++)
+    {
+        switch (k)
+        {
+        case 0:
+            tl_random_string0(*x, (const uint8_t *)"acgt", 4);
+            break;
+        case 1:
+            tl_random_string0(*x, (const uint8_t *)"ab", 2);
+            break;
+        case 2: // long runs, shorter than a thread's block
+            for (long long i = 0; i < n - 1; i++)
+            {
+                x->buf[i] = (i / 1000) % 2 ? 'a' : 'b';
+            }
+            x->buf[n - 1] = 0;
+            break;
+        case 3: // one run longer than a thread's block
+            for (long long i = 0; i < n - 1; i++)
+            {
+                x->buf[i] = i < n / 10 ? 'b' : 'a';
+            }
+            x->buf[n - 1] = 0;
+            break;
+        }
+
+        cstr_alphabet alpha;
+        cstr_init_alphabet(&alpha, CSTR_SLICE_CONST_CAST(*x));
+        cstr_alphabet_map_to_uint(*mapped, CSTR_SLICE_CONST_CAST(*x), &alpha);
+        cstr_const_uislice u = CSTR_SLICE_CONST_CAST(*mapped);
+
+        seq(*expected, u, &alpha);
+        for (int no_threads = 1; no_threads <= 4; no_threads++)
+        {
+            par(*observed, u, &alpha, no_threads);
+            TL_ERROR_IF(!CSTR_SLICE_EQ(*expected, *observed));
+        }
+
+        // and the same from the mapped bytes, if we have it for those
+        cstr_alphabet_map(*bytes, CSTR_SLICE_CONST_CAST(*x), &alpha);
+        for (int no_threads = 1; par_bytes && no_threads <= 4; no_threads++)
+        {
+            par_bytes(*observed, CSTR_SLICE_CONST_CAST(*bytes), &alpha, no_threads);
+            TL_ERROR_IF(!CSTR_SLICE_EQ(*expected, *observed));
+        }
+    }
+
+    free(x);
+    free(bytes);
+    free(mapped);
+    free(expected);
+    free(observed);
+
+    TL_END();
+}
+
+// Constructions that work on the mapped bytes
+typedef void (*bytes_alg)(cstr_suffix_array sa, cstr_const_sslice x, cstr_alphabet *alpha);
+static void sacak(cstr_suffix_array sa, cstr_const_sslice x, cstr_alphabet *alpha)
+{
+    cstr_sacak(sa, x, alpha);
+}
+
+// Compare with cstr_sais on all short strings over a, b and c, and on longer
+// random strings and strings with long runs.
+static TL_PARAM_TEST(test_bytes, bytes_alg alg)
+{
+    TL_BEGIN();
+
+    cstr_const_sslice letters = CSTR_SLICE_STRING0((const char *)"abc");
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, letters);
+
+    for (long long n = 1; n <= 10; n++)
+    {
+        cstr_sslice *x = cstr_alloc_sslice(n);
+        cstr_sslice *mapped = cstr_alloc_sslice(n);
+        cstr_uislice *u = cstr_alloc_uislice(n);
+        cstr_suffix_array *expected = cstr_alloc_uislice(n);
+        cstr_suffix_array *observed = cstr_alloc_uislice(n);
+
+        long long no_strings = 1;
+        for (long long i = 0; i < n - 1; i++)
+        {
+            no_strings *= 3;
+        }
+        for (long long k = 0; k < no_strings; k++)
+        {
+            for (long long i = 0, code = k; i < n - 1; i++, code /= 3)
+            {
+                x->buf[i] = (uint8_t)('a' + code % 3);
+            }
+            x->buf[n - 1] = 0;
+
+            cstr_alphabet_map(*mapped, CSTR_SLICE_CONST_CAST(*x), &alpha);
+            cstr_alphabet_map_to_uint(*u, CSTR_SLICE_CONST_CAST(*x), &alpha);
+            cstr_sais(*expected, CSTR_SLICE_CONST_CAST(*u), &alpha);
+            alg(*observed, CSTR_SLICE_CONST_CAST(*mapped), &alpha);
+            TL_ERROR_IF(!CSTR_SLICE_EQ(*expected, *observed));
+        }
+
+        free(x);
+        free(mapped);
+        free(u);
+        free(expected);
+        free(observed);
+    }
+
+    const long long n = 100000;
+    cstr_sslice *x = cstr_alloc_sslice(n);
+    cstr_sslice *mapped = cstr_alloc_sslice(n);
+    cstr_uislice *u = cstr_alloc_uislice(n);
+    cstr_suffix_array *expected = cstr_alloc_uislice(n);
+    cstr_suffix_array *observed = cstr_alloc_uislice(n);
+    for (int k = 0; k < 4; k++)
+    {
+        switch (k)
+        {
+        case 0:
+            tl_random_string0(*x, (const uint8_t *)"acgt", 4);
+            break;
+        case 1:
+            tl_random_string0(*x, (const uint8_t *)"ab", 2);
+            break;
+        case 2: // periodic, which gives the most LMS suffixes
+            for (long long i = 0; i < n - 1; i++)
+            {
+                x->buf[i] = (uint8_t)"ba"[i % 2];
+            }
+            x->buf[n - 1] = 0;
+            break;
+        case 3: // many different short LMS substrings
+            tl_random_string0(*x, (const uint8_t *)"abcdefghijklmnopqrstuvwxyz", 26);
+            break;
+        }
+        cstr_init_alphabet(&alpha, CSTR_SLICE_CONST_CAST(*x));
+        cstr_alphabet_map(*mapped, CSTR_SLICE_CONST_CAST(*x), &alpha);
+        cstr_alphabet_map_to_uint(*u, CSTR_SLICE_CONST_CAST(*x), &alpha);
+        cstr_sais(*expected, CSTR_SLICE_CONST_CAST(*u), &alpha);
+        alg(*observed, CSTR_SLICE_CONST_CAST(*mapped), &alpha);
+        TL_ERROR_IF(!CSTR_SLICE_EQ(*expected, *observed));
+    }
+    free(x);
+    free(mapped);
+    free(u);
+    free(expected);
+    free(observed);
+
+    TL_END();
+}
+
+// Batch search must give the intervals that cstr_sa_bsearch walks through.
+// The batch has duplicates, patterns that are prefixes of others, patterns
+// that don't occur, and enough of them that the radix sort recurses.
+static TL_TEST(test_batch)
+{
+    TL_BEGIN();
+
+    const long long n = 2000, k = 500;
+    cstr_sslice *x_buf = cstr_alloc_sslice(n);
+    tl_random_string0(*x_buf, (const uint8_t *)"acgt", 4);
+    cstr_const_sslice x = CSTR_SLICE_CONST_CAST(*x_buf);
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_sslice *mapped = cstr_alloc_sslice(n);
+    cstr_alphabet_map(*mapped, x, &alpha);
+    cstr_suffix_array *sa = cstr_alloc_uislice(n);
+    cstr_sais_sslice(*sa, CSTR_SLICE_CONST_CAST(*mapped), &alpha);
+
+    cstr_sslice *random_buf = cstr_alloc_sslice(20);
+    tl_random_string(*random_buf, (const uint8_t *)"acgtn", 5);
+    cstr_const_sslice *p = cstr_malloc_buffer(sizeof *p, (size_t)k);
+    for (long long i = 0; i < k; i++)
+    {
+        long long len = rand() % 30, start = rand() % (n - 30);
+        switch (i % 4)
+        {
+        case 0:
+        case 1:
+            p[i] = CSTR_SUBSLICE(x, start, start + len);
+            break;
+        case 2: // a prefix of, or a copy of, an earlier pattern
+            p[i] = CSTR_PREFIX(p[i - 1], rand() % (p[i - 1].len + 1));
+            break;
+        case 3: // probably not in x
+            p[i] = CSTR_PREFIX(CSTR_SLICE_CONST_CAST(*random_buf), len % 20);
+            break;
+        }
+    }
+
+    cstr_sa_interval *iv = cstr_malloc_buffer(sizeof *iv, (size_t)k);
+    cstr_sa_batch_search(*sa, x, k, p, iv);
+    for (long long i = 0; i < k; i++)
+    {
+        cstr_exact_matcher *m = cstr_sa_bsearch(*sa, x, p[i]);
+        long long r = iv[i].lo;
+        for (long long pos = cstr_exact_next_match(m); pos != -1; pos = cstr_exact_next_match(m), r++)
+        {
+            TL_ERROR_IF(r >= iv[i].hi);
+            TL_ERROR_IF(r < iv[i].hi && sa->buf[r] != pos);
+        }
+        TL_ERROR_IF_NEQ_LL(r, iv[i].hi);
+        cstr_free_exact_matcher(m);
+    }
+
+    free(iv);
+    free(p);
+    free(random_buf);
+    free(sa);
+    free(mapped);
+    free(x_buf);
+
+    TL_END();
+}
+
+// Sparse suffix arrays must list the sampled positions in the order the
+// full suffix array has them, and searching must find the sampled matches.
+static void check_sparse(cstr_suffix_array sa, cstr_suffix_array ssa,
+                         cstr_const_sslice x, cstr_bit_vector *sampled,
+                         bool *ok)
+{
+    long long j = 0;
+    for (long long i = 0; i < sa.len; i++)
+    {
+        if (cstr_bv_get(sampled, sa.buf[i]))
+        {
+            *ok = *ok && j < ssa.len && ssa.buf[j] == sa.buf[i];
+            j++;
+        }
+    }
+    *ok = *ok && j == ssa.len;
+
+    for (long long i = 0; i + 3 < x.len; i += 7)
+    {
+        cstr_const_sslice p = CSTR_SUBSLICE(x, i, i + 3);
+        cstr_exact_matcher *m = cstr_sa_bsearch(ssa, x, p);
+        long long hits = 0;
+        for (long long pos = cstr_exact_next_match(m); pos != -1; pos = cstr_exact_next_match(m))
+        {
+            *ok = *ok && cstr_bv_get(sampled, pos) && CSTR_SLICE_EQ(CSTR_SUBSLICE(x, pos, pos + 3), p);
+            hits++;
+        }
+        cstr_free_exact_matcher(m);
+        for (long long pos = 0; pos + 3 < x.len; pos++)
+        {
+            hits -= cstr_bv_get(sampled, pos) && CSTR_SLICE_EQ(CSTR_SUBSLICE(x, pos, pos + 3), p);
+        }
+        *ok = *ok && hits == 0;
+    }
+}
+
+static TL_TEST(test_sparse)
+{
+    TL_BEGIN();
+
+    const long long n = 3000;
+    cstr_sslice *x_buf = cstr_alloc_sslice(n);
+    cstr_suffix_array *sa = cstr_alloc_uislice(n);
+    cstr_uislice *pos = cstr_alloc_uislice(n);
+    cstr_suffix_array *ssa = cstr_alloc_uislice(n);
+    cstr_bit_vector *sampled = cstr_new_bv(n);
+
+    for (int rep = 0; rep < 3; rep++)
+    {
+        if (rep == 0)
+        {
+            tl_random_string0(*x_buf, (const uint8_t *)"acgt", 4);
+        }
+        else if (rep == 1)
+        {
+            tl_random_string0(*x_buf, (const uint8_t *)"ab", 2);
+        }
+        else // periodic, so suffixes share long prefixes
+        {
+            for (long long i = 0; i < n - 1; i++)
+            {
+                x_buf->buf[i] = (uint8_t)"abc"[i % 3];
+            }
+            x_buf->buf[n - 1] = 0;
+        }
+        cstr_const_sslice x = CSTR_SLICE_CONST_CAST(*x_buf);
+        cstr_alphabet alpha;
+        cstr_init_alphabet(&alpha, x);
+        cstr_sslice *mapped = cstr_alloc_sslice(n);
+        cstr_alphabet_map(*mapped, x, &alpha);
+        cstr_sais_sslice(*sa, CSTR_SLICE_CONST_CAST(*mapped), &alpha);
+        free(mapped);
+
+        for (long long k = 1; k <= 5; k++)
+        {
+            cstr_bv_clear(sampled);
+            for (long long i = 0; i < n; i += k)
+            {
+                cstr_bv_set(sampled, i, true);
+            }
+            cstr_suffix_array every = CSTR_PREFIX(*ssa, (n + k - 1) / k);
+            cstr_sparse_sa_every(every, x, k);
+            bool ok = true;
+            check_sparse(*sa, every, x, sampled, &ok);
+            TL_ERROR_IF(!ok);
+        }
+
+        // Random positions, as word starts or minimizers would give
+        cstr_bv_clear(sampled);
+        long long m = 0;
+        for (long long i = 0; i < n; i++)
+        {
+            if (rand() % 4 == 0)
+            {
+                pos->buf[m++] = (unsigned int)i;
+                cstr_bv_set(sampled, i, true);
+            }
+        }
+        cstr_suffix_array some = CSTR_PREFIX(*ssa, m);
+        cstr_sparse_sa(some, x, CSTR_SLICE_CONST_CAST(CSTR_PREFIX(*pos, m)));
+        bool ok = true;
+        check_sparse(*sa, some, x, sampled, &ok);
+        TL_ERROR_IF(!ok);
+    }
+
+    free(sampled);
+    free(ssa);
+    free(pos);
+    free(sa);
+    free(x_buf);
+
+    TL_END();
+}
+
+// The semi-external construction must write the same array as SA-IS, also
+// when the budget forces many runs and single k-mers that exceed it.
+static TL_TEST(test_external)
+{
+    TL_BEGIN();
+
+    const char *fname = "sa_test_external.sa";
+    const long long n = 5000;
+    cstr_sslice *x_buf = cstr_alloc_sslice(n);
+    cstr_sslice *mapped = cstr_alloc_sslice(n);
+    cstr_suffix_array *expected = cstr_alloc_uislice(n);
+
+    for (int rep = 0; rep < 3; rep++)
+    {
+        switch (rep)
+        {
+        case 0:
+            tl_random_string0(*x_buf, (const uint8_t *)"acgt", 4);
+            break;
+        case 1: // one letter, so one k-mer has almost all the suffixes
+            for (long long i = 0; i < n - 1; i++)
+            {
+                x_buf->buf[i] = 'a';
+            }
+            x_buf->buf[n - 1] = 0;
+            break;
+        case 2:
+            tl_random_string0(*x_buf, (const uint8_t *)"ab", 2);
+            break;
+        }
+        cstr_const_sslice x = CSTR_SLICE_CONST_CAST(*x_buf);
+        cstr_alphabet alpha;
+        cstr_init_alphabet(&alpha, x);
+        cstr_alphabet_map(*mapped, x, &alpha);
+        cstr_sais_sslice(*expected, CSTR_SLICE_CONST_CAST(*mapped), &alpha);
+
+        // The smallest budget can't hold the sample we compare with, the
+        // largest holds the whole array, and the ones in between split
+        // the array into blocks, and the homopolymer's one k-mer as well.
+        for (size_t ram_bytes = 256; ram_bytes <= 1 << 16; ram_bytes *= 4)
+        {
+            bool ok = cstr_sa_external(fname, CSTR_SLICE_CONST_CAST(*mapped), &alpha, ram_bytes);
+            TL_ERROR_IF(ok && ram_bytes == 256);
+            TL_ERROR_IF(!ok && ram_bytes >= 1 << 14);
+            if (!ok)
+            {
+                continue;
+            }
+            cstr_sa_file *file = cstr_load_sa(fname, true);
+            TL_FATAL_IF(!file);
+            TL_ERROR_IF(!CSTR_SLICE_EQ(*expected, cstr_sa_file_sa(file)));
+            cstr_free_sa_file(file);
+        }
+    }
+    remove(fname);
+
+    free(x_buf);
+    free(mapped);
+    free(expected);
+
+    TL_END();
+}
+
+// The verifier must accept what SA-IS builds and reject every kind of
+// damage we can do to it.
+static TL_TEST(test_verify)
+{
+    TL_BEGIN();
+
+    const long long n = 1000;
+    cstr_sslice *x_buf = cstr_alloc_sslice(n);
+    cstr_sslice *mapped = cstr_alloc_sslice(n);
+    cstr_suffix_array *sa = cstr_alloc_uislice(n);
+
+    for (int rep = 0; rep < 3; rep++)
+    {
+        switch (rep)
+        {
+        case 0:
+            tl_random_string0(*x_buf, (const uint8_t *)"acgt", 4);
+            break;
+        case 1:
+            for (long long i = 0; i < n - 1; i++)
+            {
+                x_buf->buf[i] = 'a';
+            }
+            x_buf->buf[n - 1] = 0;
+            break;
+        case 2:
+            tl_random_string0(*x_buf, (const uint8_t *)"ab", 2);
+            break;
+        }
+        cstr_const_sslice x = CSTR_SLICE_CONST_CAST(*x_buf);
+        cstr_alphabet alpha;
+        cstr_init_alphabet(&alpha, x);
+        cstr_alphabet_map(*mapped, x, &alpha);
+        cstr_sais_sslice(*sa, CSTR_SLICE_CONST_CAST(*mapped), &alpha);
+
+        TL_ERROR_IF(!cstr_sa_verify(*sa, x));
+        TL_ERROR_IF(!cstr_sa_verify(*sa, CSTR_SLICE_CONST_CAST(*mapped)));
+        TL_ERROR_IF(!cstr_sa_verify_sampled(*sa, x, 10));
+        TL_ERROR_IF(!cstr_sa_verify_sampled(*sa, x, n));
+        TL_ERROR_IF(cstr_sa_verify(CSTR_PREFIX(*sa, n - 1), x));
+
+        // Two suffixes swapped. The sampled check sees it when it looks at all pairs.
+        long long r = 1 + rand() % (n - 1);
+        unsigned int tmp = sa->buf[r];
+        sa->buf[r] = sa->buf[r - 1];
+        sa->buf[r - 1] = tmp;
+        TL_ERROR_IF(cstr_sa_verify(*sa, x));
+        TL_ERROR_IF(cstr_sa_verify_sampled(*sa, x, n));
+        sa->buf[r - 1] = sa->buf[r];
+        sa->buf[r] = tmp;
+
+        // Not a permutation
+        tmp = sa->buf[r];
+        sa->buf[r] = sa->buf[(r + n / 2) % n];
+        TL_ERROR_IF(cstr_sa_verify(*sa, x));
+        sa->buf[r] = (unsigned int)n;
+        TL_ERROR_IF(cstr_sa_verify(*sa, x));
+        TL_ERROR_IF(cstr_sa_verify_sampled(*sa, x, n));
+        sa->buf[r] = tmp;
+
+        TL_ERROR_IF(!cstr_sa_verify(*sa, x));
+    }
+
+    free(x_buf);
+    free(mapped);
+    free(sa);
+
+    TL_END();
+}
+
 int main(void)
 {
     TL_BEGIN_TEST_SUITE("sa_test");
@@ -91,5 +572,13 @@ int main(void)
     TL_RUN_PARAM_TEST(test_mississippi, "sais", cstr_sais);
     TL_RUN_PARAM_TEST(test_random, "skew", cstr_skew);
     TL_RUN_PARAM_TEST(test_random, "sais", cstr_sais);
+    TL_RUN_PARAM_TEST(test_parallel, "sais", cstr_sais, cstr_sais_parallel, cstr_sais_parallel_sslice);
+    TL_RUN_PARAM_TEST(test_parallel, "skew", cstr_skew, cstr_skew_parallel, NULL);
+    TL_RUN_PARAM_TEST(test_bytes, "sacak", sacak);
+    TL_RUN_PARAM_TEST(test_bytes, "sais_sslice", cstr_sais_sslice);
+    TL_RUN_TEST(test_batch);
+    TL_RUN_TEST(test_sparse);
+    TL_RUN_TEST(test_external);
+    TL_RUN_TEST(test_verify);
     TL_END_SUITE();
 }
@@ -11,6 +11,7 @@ int main(void)
     TL_RUN_TEST(buckets_mississippi);
     TL_RUN_TEST(sais_classify_sl_mississippi);
     TL_RUN_TEST(sais_classify_sl_random);
+    TL_RUN_TEST(sais_par_classify_sl);
     TL_RUN_TEST(buckets_lms_mississippi);
     TL_END_SUITE();
 }
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testlib.h"
+#include <cstr.h>
+
+static const char *fname = "st_file_test.st";
+
+// The file gives the same matches, in the same order, as the tree
+static bool same_matches(cstr_exact_matcher *expected, cstr_exact_matcher *observed)
+{
+    long long i, j;
+    do
+    {
+        i = cstr_exact_next_match(expected);
+        j = cstr_exact_next_match(observed);
+    } while (i == j && i != -1);
+    cstr_free_exact_matcher(expected);
+    cstr_free_exact_matcher(observed);
+    return i == j;
+}
+
+static TL_PARAM_TEST(check_round_trip, cstr_const_sslice letters, int sigma)
+{
+    TL_BEGIN();
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, letters);
+
+    for (long long n = 1; n < 5000; n = 3 * n + 1)
+    {
+        cstr_sslice *orig = cstr_alloc_sslice(n);
+        cstr_sslice *x = cstr_alloc_sslice(n);
+        tl_random_string0(*orig, letters.buf, sigma);
+        cstr_alphabet_map(*x, CSTR_SLICE_CONST_CAST(*orig), &alpha);
+        cstr_const_sslice cx = CSTR_SLICE_CONST_CAST(*x);
+        cstr_suffix_tree *st = cstr_mccreight_suffix_tree(&alpha, cx);
+
+        TL_FATAL_IF(!cstr_write_suffix_tree(fname, st));
+        cstr_st_file *file = cstr_load_suffix_tree(fname, true);
+        TL_FATAL_IF(!file);
+        TL_ERROR_IF(!CSTR_SLICE_EQ(cx, cstr_st_file_string(file)));
+        cstr_alphabet const *loaded = cstr_st_file_alphabet(file);
+        TL_ERROR_IF_NEQ_UINT(loaded->size, alpha.size);
+        TL_ERROR_IF(memcmp(loaded->map, alpha.map, sizeof alpha.map) != 0);
+        TL_ERROR_IF(memcmp(loaded->revmap, alpha.revmap, sizeof alpha.revmap) != 0);
+
+        // All suffixes, then substrings that start at every 7th position,
+        // some of them running into the sentinel
+        cstr_const_sslice empty = CSTR_SLICE_STRING((const char *)"");
+        TL_ERROR_IF(!same_matches(cstr_st_exact_search(st, empty), cstr_st_file_search(file, empty)));
+        for (long long i = 0; i < n; i += 7)
+        {
+            cstr_const_sslice p = CSTR_SUBSLICE(cx, i, i + 1 + rand() % (n - i));
+            TL_ERROR_IF(!same_matches(cstr_st_exact_search(st, p), cstr_st_file_search(file, p)));
+        }
+        // and unmapped, where the last letter is often wrong or not in x
+        for (long long i = 0; i + 1 < n; i += 11)
+        {
+            long long len = 1 + rand() % (n - i - 1);
+            char *p_buf = malloc((size_t)len);
+            memcpy(p_buf, orig->buf + i, (size_t)len);
+            p_buf[len - 1] = (char)letters.buf[rand() % letters.len];
+            cstr_const_sslice p = CSTR_SLICE((const uint8_t *)p_buf, len);
+            TL_ERROR_IF(!same_matches(cstr_st_exact_search_map(st, p), cstr_st_file_search_map(file, p)));
+            free(p_buf);
+        }
+        cstr_exact_matcher *m = cstr_st_file_search_map(file, CSTR_SLICE_STRING((const char *)"\n"));
+        TL_ERROR_IF_NEQ_LL(cstr_exact_next_match(m), -1LL);
+        cstr_free_exact_matcher(m);
+
+        cstr_free_st_file(file);
+        cstr_free_suffix_tree(st);
+        free(x);
+        free(orig);
+    }
+
+    remove(fname);
+
+    TL_END();
+}
+
+static TL_TEST(test_round_trip)
+{
+    TL_BEGIN();
+
+    TL_RUN_PARAM_TEST(check_round_trip, "dna", CSTR_SLICE_STRING0((const char *)"acgt"), 4);
+    TL_RUN_PARAM_TEST(check_round_trip, "repeats", CSTR_SLICE_STRING0((const char *)"acgt"), 1);
+
+    // Enough letters that the tree packs its children
+    uint8_t letter_buf[101];
+    for (int a = 0; a < 100; a++)
+    {
+        letter_buf[a] = (uint8_t)('!' + a);
+    }
+    letter_buf[100] = 0;
+    cstr_const_sslice letters = CSTR_SLICE((const uint8_t *)letter_buf, 101);
+    TL_RUN_PARAM_TEST(check_round_trip, "large", letters, 100);
+
+    TL_END();
+}
+
+static void write_st(const char *name, void *st)
+{
+    cstr_write_suffix_tree(name, st);
+}
+
+static bool load_st(const char *name, bool verify, void *ctx)
+{
+    cstr_st_file *file = cstr_load_suffix_tree(name, verify);
+    if (!file)
+    {
+        return false;
+    }
+    cstr_free_st_file(file);
+    return true;
+}
+
+static TL_TEST(test_rejected)
+{
+    TL_BEGIN();
+
+    const long long n = 1000;
+    cstr_sslice *orig = cstr_alloc_sslice(n);
+    cstr_sslice *x = cstr_alloc_sslice(n);
+    tl_random_string0(*orig, (const uint8_t *)"acgt", 4);
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, CSTR_SLICE_CONST_CAST(*orig));
+    cstr_alphabet_map(*x, CSTR_SLICE_CONST_CAST(*orig), &alpha);
+    cstr_suffix_tree *st = cstr_mccreight_suffix_tree(&alpha, CSTR_SLICE_CONST_CAST(*x));
+
+    TL_RUN_PARAM_TEST(tl_check_rejected_files, "st", fname, write_st, load_st, st);
+
+    cstr_free_suffix_tree(st);
+    free(x);
+    free(orig);
+
+    TL_END();
+}
+
+// Without verify we load damaged trees, but searching them must
+// stay inside the file (which the sanitizers check).
+static TL_TEST(test_damaged_search)
+{
+    TL_BEGIN();
+
+    const long long n = 1000;
+    cstr_sslice *x = cstr_alloc_sslice(n);
+    tl_random_string0(*x, (const uint8_t *)"acgt", 4);
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, CSTR_SLICE_CONST_CAST(*x));
+    cstr_alphabet_map(*x, CSTR_SLICE_CONST_CAST(*x), &alpha);
+    cstr_const_sslice cx = CSTR_SLICE_CONST_CAST(*x);
+    cstr_suffix_tree *st = cstr_mccreight_suffix_tree(&alpha, cx);
+
+    for (int k = 0; k < 20; k++)
+    {
+        TL_FATAL_IF(!cstr_write_suffix_tree(fname, st));
+        for (int j = 0; j < 50; j++)
+        {
+            // Anywhere in the sections; they take more than 10n bytes
+            tl_damage_file(fname, -1 - rand() % (10 * n), false);
+        }
+        cstr_st_file *file = cstr_load_suffix_tree(fname, false);
+        TL_FATAL_IF(!file);
+        for (long long i = 0; i < n; i += 3)
+        {
+            cstr_const_sslice p = CSTR_SUBSLICE(cx, i, i + 1 + rand() % (n - i));
+            cstr_exact_matcher *m = cstr_st_file_search(file, p);
+            long long no_matches = 0;
+            while (cstr_exact_next_match(m) != -1)
+            {
+                no_matches++;
+            }
+            cstr_free_exact_matcher(m);
+            TL_ERROR_IF(no_matches > n);
+        }
+        cstr_free_st_file(file);
+    }
+
+    remove(fname);
+    cstr_free_suffix_tree(st);
+    free(x);
+
+    TL_END();
+}
+
+int main(void)
+{
+    TL_BEGIN_TEST_SUITE("st_file_test");
+    TL_RUN_TEST(test_round_trip);
+    TL_RUN_TEST(test_rejected);
+    TL_RUN_TEST(test_damaged_search);
+    TL_END_SUITE();
+}
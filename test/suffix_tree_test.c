@@ -31,6 +31,17 @@ static TL_PARAM_TEST(check_suffix_ordered_for_construction,
 }
 #undef next
 
+static cstr_suffix_tree *lcp_tree(cstr_alphabet *alpha, cstr_const_sslice x)
+{
+    cstr_suffix_array *sa = cstr_alloc_uislice(x.len);
+    cstr_uislice *lcp = cstr_alloc_uislice(x.len);
+    cstr_sais_lcp(*sa, *lcp, x, alpha);
+    cstr_suffix_tree *st = cstr_lcp_suffix_tree(alpha, x, *sa, *lcp);
+    free(lcp);
+    free(sa);
+    return st;
+}
+
 static TL_TEST(check_suffix_ordered)
 {
     TL_BEGIN();
@@ -58,6 +69,100 @@ static TL_TEST(check_suffix_ordered)
         st = cstr_mccreight_suffix_tree(&alpha, CSTR_SLICE_CONST_CAST(*x));
         TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "mccreight", CSTR_SLICE_CONST_CAST(*x), st);
         cstr_free_suffix_tree(st);
+
+        st = cstr_ukkonen_suffix_tree(&alpha, CSTR_SLICE_CONST_CAST(*x));
+        TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "ukkonen", CSTR_SLICE_CONST_CAST(*x), st);
+        cstr_free_suffix_tree(st);
+
+        st = lcp_tree(&alpha, CSTR_SLICE_CONST_CAST(*x));
+        TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "lcp", CSTR_SLICE_CONST_CAST(*x), st);
+        cstr_free_suffix_tree(st);
+    }
+
+    free(x);
+    free(orig);
+
+    TL_END();
+}
+
+// Every match of substrings that start at every 7th position, compared
+// with the naive matcher.
+static TL_PARAM_TEST(check_search, cstr_const_sslice x, cstr_suffix_tree *st)
+{
+    TL_BEGIN();
+    for (long long i = 0; i < x.len - 1; i += 7)
+    {
+        cstr_const_sslice p = CSTR_SUBSLICE(x, i, i + 1 + rand() % (x.len - 1 - i));
+        cstr_exact_matcher *naive = cstr_naive_matcher(x, p);
+        cstr_exact_matcher *m = cstr_st_exact_search(st, p);
+        long long expected = 0, observed = 0;
+        while (cstr_exact_next_match(naive) != -1)
+        {
+            expected++;
+        }
+        while (cstr_exact_next_match(m) != -1)
+        {
+            observed++;
+        }
+        TL_ERROR_IF_NEQ_LL(observed, expected);
+        cstr_free_exact_matcher(naive);
+        cstr_free_exact_matcher(m);
+    }
+    TL_END();
+}
+
+// With more letters than fit in the dense layout, the trees use packed children
+static TL_TEST(check_large_alphabet)
+{
+    TL_BEGIN();
+
+    const long long n = 200;
+
+    uint8_t letter_buf[101];
+    for (int a = 0; a < 100; a++)
+    {
+        letter_buf[a] = (uint8_t)(' ' + a);
+    }
+    letter_buf[100] = 0;
+    cstr_const_sslice letters = CSTR_SLICE((const uint8_t *)letter_buf, 101);
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, letters);
+
+    cstr_sslice *orig = cstr_alloc_sslice(n);
+    cstr_sslice *x = cstr_alloc_sslice(n);
+
+    for (int k = 0; k < 10; k++)
+    {
+        // Few letters in half of them, so we get deep trees as well
+        tl_random_string0(*orig, letters.buf, k < 5 ? 100 : 3);
+        bool ok = cstr_alphabet_map(*x, CSTR_SLICE_CONST_CAST(*orig), &alpha);
+        TL_ERROR_IF(!ok);
+        cstr_const_sslice cx = CSTR_SLICE_CONST_CAST(*x);
+
+        cstr_suffix_tree *st = cstr_naive_suffix_tree(&alpha, cx);
+        TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "naive", cx, st);
+        TL_RUN_PARAM_TEST(check_search, "naive", cx, st);
+        cstr_free_suffix_tree(st);
+
+        st = cstr_mccreight_suffix_tree(&alpha, cx);
+        TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "mccreight", cx, st);
+        TL_RUN_PARAM_TEST(check_search, "mccreight", cx, st);
+        cstr_free_suffix_tree(st);
+
+        st = cstr_ukkonen_suffix_tree(&alpha, cx);
+        TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "ukkonen", cx, st);
+        TL_RUN_PARAM_TEST(check_search, "ukkonen", cx, st);
+        cstr_free_suffix_tree(st);
+
+        st = lcp_tree(&alpha, cx);
+        TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "lcp", cx, st);
+        TL_RUN_PARAM_TEST(check_search, "lcp", cx, st);
+        cstr_free_suffix_tree(st);
+
+        st = cstr_parallel_suffix_tree(&alpha, cx, 3);
+        TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "parallel", cx, st);
+        TL_RUN_PARAM_TEST(check_search, "parallel", cx, st);
+        cstr_free_suffix_tree(st);
     }
 
     free(x);
@@ -66,6 +171,113 @@ static TL_TEST(check_suffix_ordered)
     TL_END();
 }
 
+// With more threads than buckets, some threads get nothing, and with few
+// letters, the buckets are uneven.
+static TL_TEST(check_parallel)
+{
+    TL_BEGIN();
+
+    cstr_alphabet alpha;
+    cstr_const_sslice letters = CSTR_SLICE_STRING0((const char *)"acgt");
+    cstr_init_alphabet(&alpha, letters);
+
+    for (long long n = 1; n < 5000; n = 3 * n + 1)
+    {
+        cstr_sslice *orig = cstr_alloc_sslice(n);
+        cstr_sslice *x = cstr_alloc_sslice(n);
+        for (int sigma = 1; sigma <= 4; sigma += 3)
+        {
+            tl_random_string0(*orig, letters.buf, sigma);
+            cstr_alphabet_map(*x, CSTR_SLICE_CONST_CAST(*orig), &alpha);
+            cstr_const_sslice cx = CSTR_SLICE_CONST_CAST(*x);
+            for (int no_threads = 1; no_threads <= 5; no_threads++)
+            {
+                cstr_suffix_tree *st = cstr_parallel_suffix_tree(&alpha, cx, no_threads);
+                TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "parallel", cx, st);
+                TL_RUN_PARAM_TEST(check_search, "parallel", cx, st);
+                cstr_free_suffix_tree(st);
+            }
+        }
+        free(x);
+        free(orig);
+    }
+
+    TL_END();
+}
+
+// Appending in chunks and searching in between must find the same as the
+// naive matcher on what we have appended so far.
+static TL_TEST(check_online)
+{
+    TL_BEGIN();
+
+    const long long n = 300;
+
+    cstr_alphabet alpha;
+    cstr_const_sslice letters = CSTR_SLICE_STRING0((const char *)"acgt");
+    cstr_init_alphabet(&alpha, letters);
+
+    cstr_sslice *orig = cstr_alloc_sslice(n);
+    cstr_sslice *x = cstr_alloc_sslice(n);
+
+    for (int k = 0; k < 10; k++)
+    {
+        // Two letters in half of them, so many suffixes stay implicit
+        tl_random_string0(*orig, letters.buf, k < 5 ? 4 : 2);
+        cstr_alphabet_map(*x, CSTR_SLICE_CONST_CAST(*orig), &alpha);
+        cstr_const_sslice cx = CSTR_SLICE_CONST_CAST(*x);
+
+        cstr_suffix_tree *st = cstr_new_online_suffix_tree(&alpha);
+        for (long long i = 0; i < n;)
+        {
+            long long len = 1 + rand() % 30;
+            len = i + len < n ? len : n - i;
+            cstr_st_append(st, CSTR_SUBSLICE(cx, i, i + len));
+            i += len;
+            // Without the sentinel until we append the very last chunk
+            cstr_const_sslice prefix = CSTR_PREFIX(cx, i < n ? i : n - 1);
+            TL_RUN_PARAM_TEST(check_search, "online", prefix, st);
+        }
+        TL_RUN_PARAM_TEST(check_suffix_ordered_for_construction, "online", cx, st);
+        cstr_free_suffix_tree(st);
+    }
+
+    free(x);
+    free(orig);
+
+    TL_END();
+}
+
+// The trees can't hold strings of 2^31 or more, so we must refuse them.
+// We never look at x, so it needn't be that long.
+static TL_TEST(check_too_long)
+{
+    TL_BEGIN();
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, CSTR_SLICE_STRING0((const char *)"acgt"));
+    uint8_t sentinel = 0;
+    cstr_const_sslice x = CSTR_SLICE((const uint8_t *)&sentinel, CSTR_ST_MAX_LEN + 1);
+
+    TL_ERROR_IF(cstr_naive_suffix_tree(&alpha, x));
+    TL_ERROR_IF(cstr_mccreight_suffix_tree(&alpha, x));
+    TL_ERROR_IF(cstr_ukkonen_suffix_tree(&alpha, x));
+    TL_ERROR_IF(cstr_parallel_suffix_tree(&alpha, x, 2));
+    unsigned int zero = 0;
+    cstr_uislice arrays = CSTR_SLICE(&zero, x.len);
+    TL_ERROR_IF(cstr_lcp_suffix_tree(&alpha, x, arrays, arrays));
+
+    cstr_suffix_tree *st = cstr_new_online_suffix_tree(&alpha);
+    TL_ERROR_IF(cstr_st_append(st, x));
+    uint8_t a = 1;
+    TL_ERROR_IF(!cstr_st_append(st, CSTR_SLICE((const uint8_t *)&a, 1)));
+    TL_ERROR_IF(cstr_st_append(st, CSTR_SLICE((const uint8_t *)&sentinel, CSTR_ST_MAX_LEN)));
+    TL_ERROR_IF(!cstr_st_append(st, CSTR_SLICE((const uint8_t *)&sentinel, 1)));
+    cstr_free_suffix_tree(st);
+
+    TL_END();
+}
+
 int main(void)
 {
     TL_BEGIN_TEST_SUITE("suffix tree test");
@@ -78,6 +290,10 @@ int main(void)
 
     // Interface tests
     TL_RUN_TEST(check_suffix_ordered);
+    TL_RUN_TEST(check_large_alphabet);
+    TL_RUN_TEST(check_parallel);
+    TL_RUN_TEST(check_online);
+    TL_RUN_TEST(check_too_long);
 
     TL_END_SUITE();
 }
@@ -52,3 +52,59 @@ cstr_sslice tl_random_suffix(cstr_sslice x)
     int suf = rand() % (x.len - 1);
     return CSTR_SUFFIX(x, suf);
 }
+
+// damaged files
+void tl_damage_file(const char *fname, long offset, bool truncate)
+{
+    FILE *f = fopen(fname, "rb");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc((size_t)size);
+    size_t read = fread(data, 1, (size_t)size, f);
+    fclose(f);
+    assert(read == (size_t)size);
+
+    long pos = offset < 0 ? size + offset : offset;
+    if (!truncate)
+    {
+        data[pos] ^= 1;
+    }
+    f = fopen(fname, "wb");
+    fwrite(data, 1, (size_t)(truncate ? pos : size), f);
+    fclose(f);
+    free(data);
+}
+
+TL_PARAM_TEST(tl_check_rejected_files, const char *fname,
+              tl_write_file_fn write, tl_load_file_fn load, void *ctx)
+{
+    TL_BEGIN();
+
+    TL_ERROR_IF(load("no such file", false, ctx));
+
+    // Bad magic
+    write(fname, ctx);
+    tl_damage_file(fname, 0, false);
+    TL_ERROR_IF(load(fname, false, ctx));
+
+    // Unknown version
+    write(fname, ctx);
+    tl_damage_file(fname, 8, false);
+    TL_ERROR_IF(load(fname, false, ctx));
+
+    // Truncated
+    write(fname, ctx);
+    tl_damage_file(fname, -1, true);
+    TL_ERROR_IF(load(fname, false, ctx));
+
+    // Damaged last byte; we only notice if we verify
+    write(fname, ctx);
+    tl_damage_file(fname, -1, false);
+    TL_ERROR_IF(load(fname, true, ctx));
+    TL_ERROR_IF(!load(fname, false, ctx));
+
+    remove(fname);
+
+    TL_END();
+}
@@ -259,4 +259,19 @@ void tl_random_string0(cstr_sslice x, const uint8_t *alpha, int alpha_size);
 cstr_sslice tl_random_prefix(cstr_sslice x);
 cstr_sslice tl_random_suffix(cstr_sslice x);
 
+// MARK: Damaged files
+// Flips a bit in the byte at offset, counted from the end if it is
+// negative, or cuts the file there if truncate is set.
+void tl_damage_file(const char *fname, long offset, bool truncate);
+
+// Checks that a loader rejects a missing file, a damaged magic number
+// (at offset 0) or version (at offset 8) and a truncated file, and that
+// it notices a damaged last byte if, and only if, it verifies. write
+// writes a good file to fname; load loads it, frees what it got, and
+// returns whether it got anything.
+typedef void (*tl_write_file_fn)(const char *fname, void *ctx);
+typedef bool (*tl_load_file_fn)(const char *fname, bool verify, void *ctx);
+TL_PARAM_TEST(tl_check_rejected_files, const char *fname,
+              tl_write_file_fn write, tl_load_file_fn load, void *ctx);
+
 #endif // TESTLIB_H
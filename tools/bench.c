@@ -0,0 +1,46 @@
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fasta.h"
+
+cstr_sslice *random_text(long long n, const char *letters)
+{
+    long long k = (long long)strlen(letters);
+    cstr_sslice *x = cstr_alloc_sslice(n + 1);
+    for (long long i = 0; i < n; i++)
+    {
+        x->buf[i] = (uint8_t)letters[rand() % k];
+    }
+    x->buf[n] = 0;
+    return x;
+}
+
+cstr_sslice *fasta_text(const char *fname)
+{
+    struct fasta_records *recs = load_fasta_records(fname);
+    if (!recs || !fasta_records(recs))
+    {
+        return 0;
+    }
+    cstr_const_sslice seq = fasta_records(recs)->seq;
+    cstr_sslice *x = cstr_alloc_sslice(seq.len + 1);
+    memcpy(x->buf, seq.buf, (size_t)seq.len);
+    x->buf[seq.len] = 0;
+    free_fasta_records(recs);
+    return x;
+}
+
+double wall_clock(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+double seconds_since(double start)
+{
+    return wall_clock() - start;
+}
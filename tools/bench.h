@@ -0,0 +1,18 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstr.h>
+
+// Texts for the benchmarks, both with the sentinel at the end.
+// Random text over letters:
+cstr_sslice *random_text(long long n, const char *letters);
+// The first sequence in a fasta file, or NULL if there isn't one:
+cstr_sslice *fasta_text(const char *fname);
+
+// Wall-clock time in seconds, from some fixed point, and the time since
+// start. Not clock(), which sums the CPU time of all threads, so it would
+// hide any speedup from the parallel constructions.
+double wall_clock(void);
+double seconds_since(double start);
+
+#endif
@@ -21,12 +21,266 @@ struct alg_choice algorithms[] = {
     {"kmp", cstr_kmp_matcher},
 };
 
+// The fastq iterator reuses its buffers, so for batch algorithms we
+// need to copy the reads.
+struct reads {
+    long long n, cap;
+    cstr_sslice **names; // nul-terminated so we can print them
+    cstr_const_sslice *seqs;
+    cstr_sslice **seq_bufs;
+};
+
+static cstr_sslice *copy_string(cstr_const_sslice s) {
+    cstr_sslice *buf = cstr_alloc_sslice(s.len + 1);
+    memcpy(buf->buf, s.buf, (size_t)s.len);
+    buf->buf[s.len] = 0;
+    return buf;
+}
+
+static void load_reads(struct reads *reads, FILE *fq) {
+    struct fastq_iter fqiter;
+    struct fastq_record fqrec;
+    *reads = (struct reads){.n = 0, .cap = 0, .names = 0, .seqs = 0, .seq_bufs = 0};
+
+    init_fastq_iter(&fqiter, fq);
+    while (next_fastq_record(&fqiter, &fqrec)) {
+        // The records include a terminal nul that isn't part of the read
+        cstr_const_sslice seq = CSTR_PREFIX(fqrec.seq, -1);
+        if (seq.len == 0) {
+            continue; // blank line at the end of the file
+        }
+        if (reads->n == reads->cap) {
+            reads->cap = reads->cap ? 2 * reads->cap : 256;
+            reads->names = cstr_realloc_buffer(reads->names, sizeof *reads->names, (size_t)reads->cap);
+            reads->seqs = cstr_realloc_buffer(reads->seqs, sizeof *reads->seqs, (size_t)reads->cap);
+            reads->seq_bufs = cstr_realloc_buffer(reads->seq_bufs, sizeof *reads->seq_bufs, (size_t)reads->cap);
+        }
+        reads->names[reads->n] = copy_string(CSTR_PREFIX(fqrec.name, -1));
+        reads->seq_bufs[reads->n] = copy_string(seq);
+        reads->seqs[reads->n] = CSTR_PREFIX(CSTR_SLICE_CONST_CAST(*reads->seq_bufs[reads->n]), -1);
+        reads->n++;
+    }
+    dealloc_fastq_iter(&fqiter);
+}
+
+static void free_reads(struct reads *reads) {
+    for (long long i = 0; i < reads->n; i++) {
+        free(reads->names[i]);
+        free(reads->seq_bufs[i]);
+    }
+    free(reads->names);
+    free(reads->seqs);
+    free(reads->seq_bufs);
+}
+
+// Rabin-Karp over the whole batch of reads: one pass over each chromosome
+// finds the matches for all reads at once.
+static int rk_batch(struct fasta_records *chromosomes, FILE *fq) {
+    struct reads reads;
+    load_reads(&reads, fq);
+
+    for (long long i = 1; i < reads.n; i++) {
+        if (reads.seqs[i].len != reads.seqs[0].len) {
+            printf("The rk algorithm needs all reads to have the same length.\n");
+            free_reads(&reads);
+            return 1;
+        }
+    }
+
+    char cigarbuf[2048];
+    sprintf(cigarbuf, "%lldM", reads.n ? reads.seqs[0].len : 0);
+
+    cstr_rk_preproc *preproc = cstr_rk_preprocess(reads.n, reads.seqs);
+    for (struct fasta_record *farec = fasta_records(chromosomes); farec; farec = farec->next) {
+        cstr_multi_matcher *matcher = cstr_rk_search(preproc, farec->seq);
+        for (cstr_multi_match m = cstr_multi_next_match(matcher); m.pos != -1;
+             m = cstr_multi_next_match(matcher)) {
+            print_sam_line(stdout, (const char *)reads.names[m.pattern]->buf, farec->name, m.pos,
+                           cigarbuf, (const char *)reads.seq_bufs[m.pattern]->buf);
+        }
+        cstr_free_multi_matcher(matcher);
+    }
+    cstr_free_rk_preproc(preproc);
+
+    free_reads(&reads);
+    return 0;
+}
+
+static long long count_chromosomes(struct fasta_records *chromosomes) {
+    long long k = 0;
+    for (struct fasta_record *farec = fasta_records(chromosomes); farec; farec = farec->next) {
+        k++;
+    }
+    return k;
+}
+
+// One generalized suffix array over all the chromosomes, so each read
+// is a single search.
+static int gsa_search(struct fasta_records *chromosomes, FILE *fq) {
+    long long k = count_chromosomes(chromosomes);
+    cstr_const_sslice *seqs = cstr_malloc_buffer(sizeof *seqs, (size_t)k);
+    const char **names = cstr_malloc_buffer(sizeof *names, (size_t)k);
+    k = 0;
+    for (struct fasta_record *farec = fasta_records(chromosomes); farec; farec = farec->next, k++) {
+        seqs[k] = farec->seq;
+        names[k] = farec->name;
+    }
+    cstr_gsa *gsa = cstr_gsa_build(k, seqs);
+    if (!gsa) {
+        printf("The chromosomes use too many different letters.\n");
+        free(seqs);
+        free(names);
+        return 1;
+    }
+
+    struct fastq_iter fqiter;
+    struct fastq_record fqrec;
+    char cigarbuf[2048];
+    init_fastq_iter(&fqiter, fq);
+    while (next_fastq_record(&fqiter, &fqrec)) {
+        cstr_const_sslice seq = CSTR_PREFIX(fqrec.seq, -1);
+        if (seq.len == 0) {
+            continue;
+        }
+        sprintf(cigarbuf, "%lldM", seq.len);
+        cstr_gsa_matcher *matcher = cstr_gsa_search(gsa, seq);
+        for (cstr_gsa_match m = cstr_gsa_next_match(matcher); m.record != -1;
+             m = cstr_gsa_next_match(matcher)) {
+            print_sam_line(stdout, (const char *)fqrec.name.buf, names[m.record], m.pos,
+                           cigarbuf, (const char *)fqrec.seq.buf);
+        }
+        cstr_free_gsa_matcher(matcher);
+    }
+    dealloc_fastq_iter(&fqiter);
+
+    cstr_free_gsa(gsa);
+    free(seqs);
+    free(names);
+    return 0;
+}
+
+// Searches every chromosome for every read, with matchers built from
+// preprocessed chromosomes; search gets texts[k] for chromosome k and
+// converts it back to whatever the mode put there.
+typedef cstr_exact_matcher *(*search_fn)(void *text, cstr_const_sslice p);
+static void search_reads(struct fasta_records *chromosomes, FILE *fq, void **texts, search_fn search) {
+    struct fastq_iter fqiter;
+    struct fastq_record fqrec;
+    char cigarbuf[2048];
+    init_fastq_iter(&fqiter, fq);
+    while (next_fastq_record(&fqiter, &fqrec)) {
+        // The record includes a terminal nul that isn't part of the read
+        cstr_const_sslice seq = CSTR_PREFIX(fqrec.seq, -1);
+        if (seq.len == 0) {
+            continue; // blank line at the end of the file
+        }
+        sprintf(cigarbuf, "%lldM", seq.len);
+        long long k = 0;
+        for (struct fasta_record *farec = fasta_records(chromosomes); farec; farec = farec->next, k++) {
+            cstr_exact_matcher *matcher = search(texts[k], seq);
+            for (long long pos = cstr_exact_next_match(matcher); pos != -1;
+                 pos = cstr_exact_next_match(matcher)) {
+                print_sam_line(stdout, (const char *)fqrec.name.buf, farec->name, pos, cigarbuf,
+                               (const char *)fqrec.seq.buf);
+            }
+            cstr_free_exact_matcher(matcher);
+        }
+    }
+    dealloc_fastq_iter(&fqiter);
+}
+
+// The scanners need nothing but the chromosome itself.
+static algorithm_fn scan_algo;
+static cstr_exact_matcher *scan_text_search(void *text, cstr_const_sslice p) {
+    cstr_const_sslice const *x = text;
+    return scan_algo(*x, p);
+}
+
+static int scan_search(struct fasta_records *chromosomes, FILE *fq, algorithm_fn algo) {
+    scan_algo = algo;
+    long long no_chromosomes = count_chromosomes(chromosomes);
+    void **texts = cstr_malloc_buffer(sizeof *texts, (size_t)no_chromosomes);
+    long long k = 0;
+    for (struct fasta_record *farec = fasta_records(chromosomes); farec; farec = farec->next, k++) {
+        texts[k] = &farec->seq;
+    }
+
+    search_reads(chromosomes, fq, texts, scan_text_search);
+
+    free(texts);
+    return 0;
+}
+
+// Packs each chromosome once, rather than once per read.
+static cstr_exact_matcher *packed_text_search(void *text, cstr_const_sslice p) {
+    cstr_packed_dna_preproc const *packed = text;
+    return cstr_packed_dna_search(packed, p);
+}
+
+static int packed_search(struct fasta_records *chromosomes, FILE *fq) {
+    long long no_chromosomes = count_chromosomes(chromosomes);
+    void **packed = cstr_malloc_buffer(sizeof *packed, (size_t)no_chromosomes);
+    long long k = 0;
+    for (struct fasta_record *farec = fasta_records(chromosomes); farec; farec = farec->next, k++) {
+        packed[k] = cstr_packed_dna_preprocess(farec->seq);
+    }
+
+    search_reads(chromosomes, fq, packed, packed_text_search);
+
+    for (k = 0; k < no_chromosomes; k++) {
+        cstr_free_packed_dna_preproc(packed[k]);
+    }
+    free(packed);
+    return 0;
+}
+
+// The auto matcher gets an FM-index of each chromosome, built once, so
+// it can choose between it and the scanners for each read. The index
+// needs the sentinel, which the fasta records have just past the end.
+struct auto_text {
+    cstr_const_sslice x;
+    cstr_bwt_preproc *fmindex;
+};
+
+static cstr_auto_costs auto_costs;
+static cstr_exact_matcher *auto_text_search(void *text, cstr_const_sslice p) {
+    struct auto_text const *t = text;
+    return cstr_auto_matcher(&auto_costs, t->x, p, 0, t->fmindex);
+}
+
+static int auto_search(struct fasta_records *chromosomes, FILE *fq) {
+    auto_costs = cstr_auto_calibrate();
+
+    long long no_chromosomes = count_chromosomes(chromosomes);
+    struct auto_text *texts = cstr_malloc_buffer(sizeof *texts, (size_t)no_chromosomes);
+    void **text_ptrs = cstr_malloc_buffer(sizeof *text_ptrs, (size_t)no_chromosomes);
+    long long k = 0;
+    for (struct fasta_record *farec = fasta_records(chromosomes); farec; farec = farec->next, k++) {
+        texts[k].x = CSTR_SLICE(farec->seq.buf, farec->seq.len + 1);
+        texts[k].fmindex = cstr_bwt_preprocess(texts[k].x);
+        text_ptrs[k] = &texts[k];
+    }
+
+    search_reads(chromosomes, fq, text_ptrs, auto_text_search);
+
+    for (k = 0; k < no_chromosomes; k++) {
+        cstr_free_bwt_preproc(texts[k].fmindex);
+    }
+    free(text_ptrs);
+    free(texts);
+    return 0;
+}
+
 int main(int argc, const char *argv[]) {
     if (argc != 4) {
         printf("Usage: %s algo fasta fastq\n", argv[0]);
         return 1;
     }
 
+    bool batch = strcmp(argv[1], "rk") == 0;
+    bool gsa = strcmp(argv[1], "gsa") == 0;
+    bool packed = strcmp(argv[1], "packed") == 0;
+    bool automatic = strcmp(argv[1], "auto") == 0;
     algorithm_fn algo = 0;
     for (int i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
         if (strcmp(argv[1], algorithms[i].name) == 0) {
@@ -34,36 +288,37 @@ int main(int argc, const char *argv[]) {
             break;
         }
     }
-    if (!algo) {
+    if (!algo && !batch && !gsa && !packed && !automatic) {
         printf("Unknown algorithm: %s\n", argv[1]);
         return 1;
     }
 
     struct fasta_records *chromosomes = load_fasta_records(argv[2]);
 
-    struct fastq_iter fqiter;
-    struct fastq_record fqrec;
-    cstr_exact_matcher *matcher = 0;
-    char cigarbuf[2048];
-
     FILE *fq = fopen(argv[3], "r");
-    init_fastq_iter(&fqiter, fq);
 
-    while (next_fastq_record(&fqiter, &fqrec)) {
-        sprintf(cigarbuf, "%lldM", fqrec.seq.len);
-        for (struct fasta_record *farec = fasta_records(chromosomes); farec; farec = farec->next) {
-            matcher = algo(farec->seq, fqrec.seq);
-            
-            for (long long pos = cstr_exact_next_match(matcher); pos != -1;
-                 pos = cstr_exact_next_match(matcher)) {
-                print_sam_line(stdout, (const char *)fqrec.name.buf, farec->name, pos, cigarbuf, (const char *)fqrec.seq.buf);
-            }
-            cstr_free_exact_matcher(matcher);
-        }
+    if (batch) {
+        int res = rk_batch(chromosomes, fq);
+        fclose(fq);
+        return res;
+    }
+    if (gsa) {
+        int res = gsa_search(chromosomes, fq);
+        fclose(fq);
+        return res;
+    }
+    if (packed) {
+        int res = packed_search(chromosomes, fq);
+        fclose(fq);
+        return res;
+    }
+    if (automatic) {
+        int res = auto_search(chromosomes, fq);
+        fclose(fq);
+        return res;
     }
-    
-    dealloc_fastq_iter(&fqiter);
-    fclose(fq);
 
-    return 0;
+    int res = scan_search(chromosomes, fq, algo);
+    fclose(fq);
+    return res;
 }
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cstr.h>
+
+#include "bench.h"
+
+// Times suffix array construction, either on random text over a given
+// set of letters or on the first sequence in a fasta file. Run it on two
+// builds to compare them, e.g. before and after a change to induced sorting.
+
+#define PAR_THREADS 4
+
+// The constructions get the text mapped to the alphabet both as bytes, x,
+// and as unsigned int, u, and use the one they want.
+typedef void (*construction_fn)(cstr_suffix_array, cstr_const_sslice, cstr_const_uislice, cstr_alphabet *);
+
+static void run_skew(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_skew(sa, u, alpha);
+}
+static void run_skew_par(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_skew_parallel(sa, u, alpha, PAR_THREADS);
+}
+static void run_sais(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_sais(sa, u, alpha);
+}
+static void run_sais_bytes(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_sais_sslice(sa, x, alpha);
+}
+static void run_sais_par(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_sais_parallel(sa, u, alpha, PAR_THREADS);
+}
+static void run_sais_lcp(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_uislice *lcp = cstr_alloc_uislice(x.len);
+    cstr_sais_lcp(sa, *lcp, x, alpha);
+    free(lcp);
+}
+// Sparse arrays over every SPARSE_K'th suffix, by reduction and by sorting
+#define SPARSE_K 4
+static void run_sparse_every(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_sparse_sa_every(CSTR_PREFIX(sa, (x.len + SPARSE_K - 1) / SPARSE_K), x, SPARSE_K);
+}
+static void run_sparse_sort(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_suffix_array ssa = CSTR_PREFIX(sa, (x.len + SPARSE_K - 1) / SPARSE_K);
+    for (long long i = 0; i < ssa.len; i++) {
+        ssa.buf[i] = (unsigned int)(i * SPARSE_K);
+    }
+    cstr_sparse_sa(ssa, x, CSTR_SLICE_CONST_CAST(ssa));
+}
+// Semi-external, with a quarter of the suffix array's size as the budget.
+// It doesn't fill sa, only the file.
+static void run_external(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    if (!cstr_sa_external("sa_bench.sa", x, alpha, (size_t)x.len)) {
+        printf("Couldn't write sa_bench.sa\n");
+    }
+    remove("sa_bench.sa");
+}
+static void run_sacak(cstr_suffix_array sa, cstr_const_sslice x, cstr_const_uislice u, cstr_alphabet *alpha) {
+    cstr_sacak(sa, x, alpha);
+}
+
+struct construction_choice {
+    const char *name;
+    construction_fn construction;
+};
+
+struct construction_choice constructions[] = {
+    {"skew", run_skew},
+    {"skew-par", run_skew_par},
+    {"sais", run_sais},
+    {"sais-bytes", run_sais_bytes},
+    {"sais-par", run_sais_par},
+    {"sais-lcp", run_sais_lcp},
+    {"sacak", run_sacak},
+    {"sparse-every", run_sparse_every},
+    {"external", run_external},
+    {"sparse-sort", run_sparse_sort},
+};
+
+int main(int argc, const char *argv[]) {
+    if (argc < 3 || argc > 4) {
+        printf("Usage: %s algo n [letters]\n", argv[0]);
+        printf("       %s algo fasta\n", argv[0]);
+        return 1;
+    }
+
+    construction_fn construction = 0;
+    for (int i = 0; i < sizeof(constructions) / sizeof(constructions[0]); i++) {
+        if (strcmp(argv[1], constructions[i].name) == 0) {
+            construction = constructions[i].construction;
+            break;
+        }
+    }
+    if (!construction) {
+        printf("Unknown algorithm: %s\n", argv[1]);
+        return 1;
+    }
+
+    char *end;
+    long long n = strtoll(argv[2], &end, 10);
+    cstr_sslice *x_buf = (*end == '\0' && n > 0) ? random_text(n, argc == 4 ? argv[3] : "acgt")
+                                                 : fasta_text(argv[2]);
+    if (!x_buf) {
+        printf("Couldn't read a sequence from %s\n", argv[2]);
+        return 1;
+    }
+    cstr_const_sslice x = CSTR_SLICE_CONST_CAST(*x_buf);
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_uislice *u_buf = cstr_alloc_uislice(x.len);
+    if (!cstr_alphabet_map_to_uint(*u_buf, x, &alpha)) {
+        printf("Couldn't map the text to its alphabet\n");
+        return 1;
+    }
+    // The byte-based constructions want the mapped bytes, and we don't
+    // need the text itself any more, so we map it in place.
+    cstr_alphabet_map(*x_buf, x, &alpha);
+    cstr_suffix_array *sa = cstr_alloc_uislice(x.len);
+
+    double start = wall_clock();
+    construction(*sa, x, CSTR_SLICE_CONST_CAST(*u_buf), &alpha);
+    double secs = seconds_since(start);
+    printf("%s\t%lld\t%u\t%.3f\n", argv[1], x.len, alpha.size, secs);
+
+    free(sa);
+    free(u_buf);
+    free(x_buf);
+    return 0;
+}
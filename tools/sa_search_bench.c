@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cstr.h>
+
+#include "bench.h"
+
+// Times suffix array searches for patterns sampled from the text, with
+// plain binary search, binary search from a k-mer table of at most
+// kmer_bytes, binary search from an index of every SAMPLE_K'th suffix, the
+// enhanced suffix array, and batch search over all the patterns at once. The text is either
+// random over a set of letters or the first sequence in a fasta file.
+
+#define DEFAULT_KMER_BYTES (64ll << 20)
+#define SAMPLE_K 16
+
+int main(int argc, const char *argv[]) {
+    if (argc < 4 || argc > 5) {
+        printf("Usage: %s n|fasta m queries [kmer_bytes]\n", argv[0]);
+        return 1;
+    }
+
+    char *end;
+    long long n = strtoll(argv[1], &end, 10);
+    cstr_sslice *x_buf = (*end == '\0' && n > 0) ? random_text(n, "acgt") : fasta_text(argv[1]);
+    if (!x_buf) {
+        printf("Couldn't read a sequence from %s\n", argv[1]);
+        return 1;
+    }
+    cstr_const_sslice x = CSTR_SLICE_CONST_CAST(*x_buf);
+    long long m = atoll(argv[2]), queries = atoll(argv[3]);
+    long long kmer_bytes = argc == 5 ? atoll(argv[4]) : DEFAULT_KMER_BYTES;
+    if (m <= 0 || m >= x.len) {
+        printf("The pattern length must be between 1 and %lld\n", x.len - 1);
+        return 1;
+    }
+
+    cstr_alphabet alpha;
+    cstr_init_alphabet(&alpha, x);
+    cstr_sslice *w_buf = cstr_alloc_sslice(x.len);
+    cstr_alphabet_map(*w_buf, x, &alpha);
+    cstr_suffix_array *sa = cstr_alloc_uislice(x.len);
+    cstr_sais_sslice(*sa, CSTR_SLICE_CONST_CAST(*w_buf), &alpha);
+    free(w_buf);
+
+    double start = wall_clock();
+    cstr_esa *esa = cstr_esa_preprocess(*sa, x);
+    printf("esa-build\t%lld\t%lld\t%.3f\n", x.len, m, seconds_since(start));
+
+    start = wall_clock();
+    cstr_kmer_table *tab = cstr_build_kmer_table(x, &alpha, (size_t)kmer_bytes);
+    printf("kmer-build\t%lld\t%lld\t%.3f\tk=%lld\n", x.len, m, seconds_since(start), cstr_kmer_table_k(tab));
+
+    start = wall_clock();
+    cstr_sa_sample_index *idx = cstr_sa_sample_index_build(*sa, x, SAMPLE_K);
+    printf("sample-build\t%lld\t%lld\t%.3f\n", x.len, m, seconds_since(start));
+
+    long long *pos = malloc((size_t)queries * sizeof *pos);
+    for (long long q = 0; q < queries; q++) {
+        pos[q] = rand() % (x.len - m);
+    }
+
+    // Count the hits, so both searches must find them all
+    long long hits = 0;
+    start = wall_clock();
+    for (long long q = 0; q < queries; q++) {
+        cstr_exact_matcher *match = cstr_sa_bsearch(*sa, x, CSTR_SUBSLICE(x, pos[q], pos[q] + m));
+        while (cstr_exact_next_match(match) != -1) hits++;
+        cstr_free_exact_matcher(match);
+    }
+    printf("bsearch\t%lld\t%lld\t%.3f\t%lld\n", x.len, m, seconds_since(start), hits);
+
+    hits = 0;
+    start = wall_clock();
+    for (long long q = 0; q < queries; q++) {
+        cstr_exact_matcher *match = cstr_sa_kmer_search(*sa, x, tab, CSTR_SUBSLICE(x, pos[q], pos[q] + m));
+        while (cstr_exact_next_match(match) != -1) hits++;
+        cstr_free_exact_matcher(match);
+    }
+    printf("kmer\t%lld\t%lld\t%.3f\t%lld\n", x.len, m, seconds_since(start), hits);
+
+    hits = 0;
+    start = wall_clock();
+    for (long long q = 0; q < queries; q++) {
+        cstr_exact_matcher *match = cstr_sa_sample_index_search(idx, CSTR_SUBSLICE(x, pos[q], pos[q] + m));
+        while (cstr_exact_next_match(match) != -1) hits++;
+        cstr_free_exact_matcher(match);
+    }
+    printf("sample\t%lld\t%lld\t%.3f\t%lld\n", x.len, m, seconds_since(start), hits);
+
+    hits = 0;
+    start = wall_clock();
+    for (long long q = 0; q < queries; q++) {
+        cstr_exact_matcher *match = cstr_esa_search(esa, CSTR_SUBSLICE(x, pos[q], pos[q] + m));
+        while (cstr_exact_next_match(match) != -1) hits++;
+        cstr_free_exact_matcher(match);
+    }
+    printf("esa\t%lld\t%lld\t%.3f\t%lld\n", x.len, m, seconds_since(start), hits);
+
+    cstr_const_sslice *p = malloc((size_t)queries * sizeof *p);
+    cstr_sa_interval *iv = malloc((size_t)queries * sizeof *iv);
+    for (long long q = 0; q < queries; q++) {
+        p[q] = CSTR_SUBSLICE(x, pos[q], pos[q] + m);
+    }
+    hits = 0;
+    start = wall_clock();
+    cstr_sa_batch_search(*sa, x, queries, p, iv);
+    for (long long q = 0; q < queries; q++) {
+        hits += iv[q].hi - iv[q].lo;
+    }
+    printf("batch\t%lld\t%lld\t%.3f\t%lld\n", x.len, m, seconds_since(start), hits);
+
+    free(iv);
+    free(p);
+    free(pos);
+    cstr_free_sa_sample_index(idx);
+    cstr_free_kmer_table(tab);
+    cstr_free_esa(esa);
+    free(sa);
+    free(x_buf);
+    return 0;
+}